@@ -0,0 +1,132 @@
+#!/bin/bash
+
+# Performance regression gate for minitalk.
+#
+# Runs the microbenchmarks and a short end-to-end matrix, reduces them to
+# one line per metric and compares the result with bench/baseline.csv.
+# A metric regresses when it is worse than the baseline by more than the
+# relative threshold AND by more than k times the combined noise (the
+# root sum of squares of both standard deviations). A baseline metric the
+# current run no longer produces fails. Any regression or failure makes
+# the script exit with status 1 after printing a comparison table.
+#
+# Usage: bench/check.sh [-u] [-t threshold_pct] [-k sigmas] [-r reps]
+#
+#   -u  Record the current results as the new baseline instead of checking
+#   -t  Relative threshold in percent                  (default 10)
+#   -k  Noise multiplier                               (default 3)
+#   -r  End-to-end repetitions per configuration       (default 3)
+#
+# Run from the repository root after `make` and `make microbench`.
+
+set -u
+set -o pipefail
+
+BASELINE="bench/baseline.csv"
+THRESHOLD=10
+SIGMAS=3
+REPS=3
+UPDATE=0
+E2E_SIZES="64 1K"
+
+while getopts "ut:k:r:" opt; do
+	case "$opt" in
+	u) UPDATE=1 ;;
+	t) THRESHOLD="$OPTARG" ;;
+	k) SIGMAS="$OPTARG" ;;
+	r) REPS="$OPTARG" ;;
+	*) sed -n '3,18p' "$0" >&2; exit 1 ;;
+	esac
+done
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+CURRENT="$TMP/current.csv"
+
+# metric,value,stddev,better  where better is "lower" or "higher"
+echo "metric,value,stddev,better" > "$CURRENT"
+
+./microbench -c | awk -F, 'NR > 1 {
+	printf "micro.%s.median_ns_per_byte,%s,%s,lower\n", $1, $5, $7
+}' >> "$CURRENT" || exit 1
+
+for rep in $(seq "$REPS"); do
+	./bench/e2e.sh -s "$E2E_SIZES" -c 1 -o "$TMP/e2e.$rep" > /dev/null || exit 1
+done
+awk -F, 'FNR > 1 {
+	key = $3
+	if ($5 != "ok") failed[key] = 1
+	n[key]++
+	rate[key] += $8; rate2[key] += $8 * $8
+	tail[key] += $10; tail2[key] += $10 * $10
+}
+function sd(sum, sum2, count) {
+	if (count < 2) return 0
+	v = (sum2 - sum * sum / count) / (count - 1)
+	return v > 0 ? sqrt(v) : 0
+}
+END {
+	for (k in n) {
+		if (k in failed) {
+			printf "e2e.%s.status,0,0,higher\n", k
+			continue
+		}
+		printf "e2e.%s.throughput_Bps,%.1f,%.1f,higher\n", k,
+			rate[k] / n[k], sd(rate[k], rate2[k], n[k])
+		printf "e2e.%s.client_max_s,%.6f,%.6f,lower\n", k,
+			tail[k] / n[k], sd(tail[k], tail2[k], n[k])
+	}
+}' "$TMP"/e2e.*.csv | sort >> "$CURRENT"
+
+if [ "$UPDATE" = 1 ]; then
+	cp "$CURRENT" "$BASELINE"
+	echo "Baseline updated: $BASELINE"
+	exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+	echo "Error: no baseline at $BASELINE, run 'make bench-baseline' first." >&2
+	exit 1
+fi
+
+awk -F, -v pct="$THRESHOLD" -v k="$SIGMAS" '
+FNR == 1 { next }
+NR == FNR { base[$1] = $2; bsd[$1] = $3; next }
+{
+	metric = $1; value = $2; sd = $3; better = $4
+	seen[metric] = 1
+	if (!(metric in base)) {
+		printf "%-44s %14s %14s %9s  %s\n", metric, "-", value, "-", "new"
+		next
+	}
+	b = base[metric]
+	delta = (better == "lower") ? value - b : b - value
+	change = (b != 0) ? 100 * (value - b) / b : 0
+	noise = sqrt(sd * sd + bsd[metric] * bsd[metric])
+	verdict = "ok"
+	if (metric ~ /\.status$/ && value == 0)
+		verdict = "FAILED"
+	else if (delta > 0 && (b == 0 || 100 * delta / b > pct) && delta > k * noise)
+		verdict = "REGRESSED"
+	else if (delta < 0 && b != 0 && -100 * delta / b > pct && -delta > k * noise)
+		verdict = "improved"
+	if (verdict == "REGRESSED" || verdict == "FAILED")
+		bad++
+	printf "%-44s %14s %14s %+8.1f%%  %s\n", metric, b, value, change, verdict
+}
+END {
+	for (metric in base) {
+		if (metric in seen)
+			continue
+		printf "%-44s %14s %14s %9s  %s\n", metric, base[metric], "missing",
+			"-", "FAILED"
+		bad++
+	}
+	printf "\nThreshold: %s%% and %s sigma. ", pct, k
+	if (bad) { printf "%d metric(s) regressed or failed.\n", bad; exit 1 }
+	printf "No regression.\n"
+}' "$BASELINE" "$CURRENT" | {
+	printf "%-44s %14s %14s %9s  %s\n" "metric" "baseline" "current" "change" "verdict"
+	cat
+}
+exit "${PIPESTATUS[0]}"
@@ -0,0 +1,165 @@
+#!/bin/bash
+
+# End-to-end throughput benchmark for minitalk.
+#
+# Starts a fresh server for every combination of transport, encoding,
+# message size and concurrency level, runs the clients against it and
+# checks that every byte came out. Results are written as CSV and JSON,
+# the JSON file also carrying host metadata.
+#
+# Usage: bench/e2e.sh [-s sizes] [-c levels] [-t transports] [-e encodings]
+#                     [-T timeout_s] [-o output_prefix]
+#
+#   -s  Message sizes in bytes, K/M suffixes allowed   (default "1 64 1K 16K")
+#   -c  Number of concurrent clients                   (default "1 2")
+#   -t  Transports                                     (default "signals")
+#   -e  Encodings                                      (default "bits8")
+#   -T  Per-run timeout in seconds                     (default 120)
+#   -o  Output prefix, writes <prefix>.csv/.json       (default bench_e2e)
+#
+# Run from the repository root after `make`.
+
+set -u
+
+SIZES="1 64 1K 16K"
+LEVELS="1 2"
+TRANSPORTS="signals"
+ENCODINGS="bits8"
+TIMEOUT=120
+OUT="bench_e2e"
+
+while getopts "s:c:t:e:T:o:" opt; do
+	case "$opt" in
+	s) SIZES="$OPTARG" ;;
+	c) LEVELS="$OPTARG" ;;
+	t) TRANSPORTS="$OPTARG" ;;
+	e) ENCODINGS="$OPTARG" ;;
+	T) TIMEOUT="$OPTARG" ;;
+	o) OUT="$OPTARG" ;;
+	*) sed -n '3,20p' "$0" >&2; exit 1 ;;
+	esac
+done
+
+if [ ! -x ./server ] || [ ! -x ./client ]; then
+	echo "Error: build the project with 'make' first." >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"; [ -n "${SERVER:-}" ] && kill "$SERVER" 2>/dev/null' EXIT
+
+# Converts a size such as 16K or 100M to bytes.
+to_bytes() {
+	case "$1" in
+	*K) echo $(( ${1%K} * 1024 )) ;;
+	*M) echo $(( ${1%M} * 1024 * 1024 )) ;;
+	*) echo "$1" ;;
+	esac
+}
+
+# Prints the client options selecting a transport and an encoding.
+client_flags() {
+	case "$1/$2" in
+	signals/bits8) echo "" ;;
+	*) return 1 ;;
+	esac
+}
+
+now_ns() {
+	date +%s%N
+}
+
+json_escape() {
+	printf '%s' "$1" | sed 's/\\/\\\\/g; s/"/\\"/g'
+}
+
+HOST_NAME=$(hostname)
+HOST_KERNEL=$(uname -sr)
+HOST_ARCH=$(uname -m)
+HOST_CPUS=$(nproc)
+HOST_CPU=$(grep -m1 'model name' /proc/cpuinfo 2>/dev/null | cut -d: -f2- | sed 's/^ //')
+HOST_COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+HOST_DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+echo "transport,encoding,size,concurrency,status,elapsed_s,bytes,throughput_Bps,client_p50_s,client_max_s" > "$OUT.csv"
+ROWS=""
+
+for transport in $TRANSPORTS; do
+for encoding in $ENCODINGS; do
+	if ! FLAGS=$(client_flags "$transport" "$encoding"); then
+		echo "Skipping unsupported combination $transport/$encoding" >&2
+		continue
+	fi
+for size_arg in $SIZES; do
+	size=$(to_bytes "$size_arg")
+	tr -dc 'A-Za-z0-9' < /dev/urandom | head -c "$size" > "$TMP/msg"
+for level in $LEVELS; do
+	./server > "$TMP/out" 2>/dev/null &
+	SERVER=$!
+	while ! grep -q '^Waiting' "$TMP/out" 2>/dev/null; do sleep 0.01; done
+	header=$(stat -c %s "$TMP/out")
+
+	start=$(now_ns)
+	pids=""
+	for i in $(seq "$level"); do
+		(
+			t0=$(now_ns)
+			# shellcheck disable=SC2086
+			timeout "$TIMEOUT" ./client $FLAGS "$SERVER" - < "$TMP/msg" > /dev/null
+			rc=$?
+			echo "$rc $(( $(now_ns) - t0 ))" > "$TMP/client.$i"
+		) &
+		pids="$pids $!"
+	done
+	# shellcheck disable=SC2086
+	wait $pids
+	elapsed_ns=$(( $(now_ns) - start ))
+	sleep 0.05
+	kill "$SERVER" 2>/dev/null
+	wait "$SERVER" 2>/dev/null
+	SERVER=""
+
+	status="ok"
+	durations=""
+	for i in $(seq "$level"); do
+		read -r rc ns < "$TMP/client.$i"
+		[ "$rc" = 124 ] && status="timeout"
+		[ "$rc" != 0 ] && [ "$status" = ok ] && status="client_error"
+		durations="$durations $ns"
+	done
+	received=$(( $(stat -c %s "$TMP/out") - header ))
+	expected=$(( (size + 1) * level ))
+	[ "$status" = ok ] && [ "$received" != "$expected" ] && status="corrupt"
+
+	sorted=$(echo "$durations" | tr ' ' '\n' | sed '/^$/d' | sort -n)
+	p50=$(echo "$sorted" | awk '{ a[NR] = $1 } END { printf "%.6f", a[int((NR + 1) / 2)] / 1e9 }')
+	pmax=$(echo "$sorted" | tail -n1 | awk '{ printf "%.6f", $1 / 1e9 }')
+	elapsed=$(awk -v ns="$elapsed_ns" 'BEGIN { printf "%.6f", ns / 1e9 }')
+	rate=$(awk -v b="$((size * level))" -v ns="$elapsed_ns" 'BEGIN { printf "%.1f", b / (ns / 1e9) }')
+
+	echo "$transport,$encoding,$size,$level,$status,$elapsed,$((size * level)),$rate,$p50,$pmax" >> "$OUT.csv"
+	ROWS="$ROWS${ROWS:+,}
+    {\"transport\": \"$transport\", \"encoding\": \"$encoding\", \"size\": $size, \"concurrency\": $level, \"status\": \"$status\", \"elapsed_s\": $elapsed, \"bytes\": $((size * level)), \"throughput_Bps\": $rate, \"client_p50_s\": $p50, \"client_max_s\": $pmax}"
+	printf '%-8s %-6s %10s x%-3s %-12s %10s B/s\n' "$transport" "$encoding" "$size" "$level" "$status" "$rate"
+done
+done
+done
+done
+
+cat > "$OUT.json" <<EOF
+{
+  "host": {
+    "hostname": "$(json_escape "$HOST_NAME")",
+    "kernel": "$(json_escape "$HOST_KERNEL")",
+    "arch": "$(json_escape "$HOST_ARCH")",
+    "cpus": $HOST_CPUS,
+    "cpu_model": "$(json_escape "$HOST_CPU")",
+    "commit": "$HOST_COMMIT",
+    "date": "$HOST_DATE"
+  },
+  "results": [$ROWS
+  ]
+}
+EOF
+
+echo "Results written to $OUT.csv and $OUT.json"
@@ -0,0 +1,662 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   microbench.c                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 12:10:44 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 12:10:44 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file microbench.c
+ * @brief Microbenchmarks for the encoding, decoding and output kernels.
+ *
+ * @details
+ * Each kernel runs over a fixed payload a few times to warm caches and
+ * branch predictors, then a number of timed repetitions. The report gives
+ * the minimum, median, mean and standard deviation in nanoseconds per
+ * payload byte, either as a table or, with `-c`, as CSV.
+ *
+ * Usage: ./microbench [-c] [-w warmup] [-r repetitions] [kernel...]
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup bench
+ */
+#include "minitalk.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+
+/**
+ * @typedef t_bench_ctx
+ * @brief Inputs shared by every kernel.
+ *
+ * @details
+ * Prepared once before any measurement so that setup costs never show up
+ * in the timings.
+ */
+typedef struct s_bench_ctx
+{
+	char*  msg;     ///< Null-terminated printable payload.
+	size_t len;     ///< Payload length, terminator excluded.
+	int*   signals; ///< Payload pre-encoded as signals.
+	size_t nsig;    ///< Number of pre-encoded signals.
+	char*  packed;  ///< Payload packed with `MT_CODEC_STRONG`, header included.
+	size_t npacked; ///< Length of the packed payload.
+	char*  out;     ///< Scratch buffer for the compressing kernels.
+	int    devnull; ///< Descriptor on /dev/null.
+	t_sink sink;    ///< Sink on /dev/null, io_uring if available.
+	t_sink vsink;   ///< Sink on /dev/null forced to `writev()`.
+	char   json[MT_SESSION_BUFFER]; ///< JSON document of one session buffer.
+	size_t njson;   ///< Length of the document.
+} t_bench_ctx;
+
+/**
+ * @typedef t_bench_kernel
+ * @brief A named kernel and the number of payload bytes it processes.
+ *
+ * @details
+ * `bytes` lets slow kernels run over a prefix of the payload and still
+ * report per-byte figures.
+ */
+typedef struct s_bench_kernel
+{
+	const char* name;                    ///< Name used on the command line.
+	size_t (*run)(t_bench_ctx*, size_t); ///< Kernel, returns a checksum.
+	size_t bytes;                        ///< Payload bytes per run.
+} t_bench_kernel;
+
+/**
+ * @brief Encodes the payload into signals.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload is encoded.
+ * @return A checksum of the produced signals.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_encode(t_bench_ctx* ctx, size_t bytes)
+{
+	t_encoder enc;
+	size_t    sum;
+	int       sig;
+
+	(void) bytes;
+	sum = 0;
+	encoder_init(&enc, ctx->msg);
+	while ((sig = encoder_next_signal(&enc)))
+		sum += (size_t) sig;
+	return (sum);
+}
+
+/**
+ * @brief Decodes the pre-encoded payload, as the server's handler does.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload is decoded.
+ * @return A checksum of the decoded characters.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_decode(t_bench_ctx* ctx, size_t bytes)
+{
+	t_decoder dec;
+	size_t    sum;
+	size_t    i;
+	int       c;
+
+	(void) bytes;
+	sum = 0;
+	i   = 0;
+	decoder_init(&dec);
+	while (i < ctx->nsig)
+	{
+		c = decoder_feed(&dec, ctx->signals[i++]);
+		if (c >= 0)
+			sum += (size_t) c;
+	}
+	return (sum);
+}
+
+/**
+ * @brief Encodes the payload straight into the decoder.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload goes through both sides.
+ * @return A checksum of the decoded characters.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_roundtrip(t_bench_ctx* ctx, size_t bytes)
+{
+	t_encoder enc;
+	t_decoder dec;
+	size_t    sum;
+	int       sig;
+	int       c;
+
+	(void) bytes;
+	sum = 0;
+	encoder_init(&enc, ctx->msg);
+	decoder_init(&dec);
+	while ((sig = encoder_next_signal(&enc)))
+	{
+		c = decoder_feed(&dec, sig);
+		if (c >= 0)
+			sum += (size_t) c;
+	}
+	return (sum);
+}
+
+/**
+ * @brief Compresses the payload with `MT_CODEC_FAST`.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Number of payload bytes compressed.
+ * @return Length of the compressed output.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_pack_fast(t_bench_ctx* ctx, size_t bytes)
+{
+	return (codec_compress(MT_CODEC_FAST, ctx->msg, bytes, ctx->out));
+}
+
+/**
+ * @brief Compresses the payload with `MT_CODEC_STRONG`.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Number of payload bytes compressed.
+ * @return Length of the compressed output.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_pack_strong(t_bench_ctx* ctx, size_t bytes)
+{
+	return (codec_compress(MT_CODEC_STRONG, ctx->msg, bytes, ctx->out));
+}
+
+/**
+ * @brief Decompresses the packed payload, as a server session does.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole packed payload is decoded.
+ * @return Number of bytes decoded.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_unpack(t_bench_ctx* ctx, size_t bytes)
+{
+	static t_unpack u;
+	char            out[MT_LZ_MAX_OUTPUT];
+	size_t          sum;
+	size_t          i;
+	int             n;
+
+	(void) bytes;
+	unpack_init(&u);
+	sum = 0;
+	i   = 0;
+	while (i < ctx->npacked)
+	{
+		n = unpack_feed(&u, (unsigned char) ctx->packed[i++], out);
+		if (n > 0)
+			sum += n;
+	}
+	return (sum);
+}
+
+/**
+ * @brief Feeds the pre-encoded payload through a server session.
+ *
+ * @details
+ * Covers the server's whole per-signal path except signal delivery:
+ * session lookup, decoding, buffering and the `write()` of each full
+ * buffer, here to /dev/null.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload is fed.
+ * @return Number of bytes written.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_session(t_bench_ctx* ctx, size_t bytes)
+{
+	static t_sessions table;
+	t_session*        s;
+	size_t            i;
+
+	(void) bytes;
+	sessions_init(&table, ctx->devnull);
+	i = 0;
+	while (i < ctx->nsig)
+	{
+		s = session_get(&table, 4242, true);
+		session_feed(&table, s, ctx->signals[i++]);
+	}
+	return (table.stats.bytes);
+}
+
+/**
+ * @brief Feeds the pre-encoded payload through a session backed by the
+ * output queue, as the server does.
+ *
+ * @details
+ * Includes starting the writer thread and waiting for it to write the
+ * last chunk, to /dev/null.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload is fed.
+ * @return Number of bytes queued.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_session_async(t_bench_ctx* ctx, size_t bytes)
+{
+	static t_sessions table;
+	static t_writer   writer;
+	t_session*        s;
+	size_t            i;
+
+	(void) bytes;
+	sessions_init(&table, ctx->devnull);
+	writer_start(&writer, ctx->devnull, MT_WRITER_DEPTH, MT_POLICY_BLOCK, 0);
+	table.writer = &writer;
+	i            = 0;
+	while (i < ctx->nsig)
+	{
+		s = session_get(&table, 4242, true);
+		session_feed(&table, s, ctx->signals[i++]);
+	}
+	writer_stop(&writer);
+	return (table.stats.bytes);
+}
+
+/**
+ * @brief Pushes the payload through the output queue in 64-byte chunks.
+ *
+ * @details
+ * Small chunks make the hand-off between the pushing thread and the
+ * writer thread dominate, which is where false sharing between the two
+ * would show.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Unused; the whole payload is pushed.
+ * @return Number of chunks written.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_queue(t_bench_ctx* ctx, size_t bytes)
+{
+	static t_writer writer;
+	size_t          off;
+
+	(void) bytes;
+	writer_start(&writer, ctx->devnull, MT_WRITER_DEPTH, MT_POLICY_BLOCK, 0);
+	off = 0;
+	while (off < ctx->len)
+	{
+		writer_push(&writer, ctx->msg + off, 64);
+		off += 64;
+	}
+	writer_stop(&writer);
+	return (writer.written);
+}
+
+/**
+ * @brief Writes the payload in session-sized chunks, batched as the
+ * writer thread does.
+ *
+ * @param ctx The benchmark inputs.
+ * @param sink The sink to write through.
+ * @return Number of write submissions so far.
+ *
+ * @ingroup bench
+ */
+static size_t run_sink(t_bench_ctx* ctx, t_sink* sink)
+{
+	struct iovec iov[MT_WRITER_BATCH];
+	size_t       off;
+	int          n;
+
+	off = 0;
+	while (off < ctx->len)
+	{
+		n = 0;
+		while (n < MT_WRITER_BATCH && off < ctx->len)
+		{
+			iov[n].iov_base = ctx->msg + off;
+			iov[n].iov_len  = MT_SESSION_BUFFER;
+			if (off + MT_SESSION_BUFFER > ctx->len)
+				iov[n].iov_len = ctx->len - off;
+			off += iov[n++].iov_len;
+		}
+		sink_writev(sink, iov, n);
+	}
+	return (sink->submits);
+}
+
+/**
+ * @brief Batched output through io_uring, or `writev()` if unavailable.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_sink(t_bench_ctx* ctx, size_t bytes)
+{
+	(void) bytes;
+	return (run_sink(ctx, &ctx->sink));
+}
+
+/**
+ * @brief Batched output through `writev()`.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_sink_writev(t_bench_ctx* ctx, size_t bytes)
+{
+	(void) bytes;
+	return (run_sink(ctx, &ctx->vsink));
+}
+
+/**
+ * @brief Records eight trace entries per byte, as `./server -r` does.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Number of payload bytes whose signals are recorded.
+ * @return Number of records written.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_trace(t_bench_ctx* ctx, size_t bytes)
+{
+	static t_trace trace;
+	siginfo_t      info;
+	size_t         i;
+
+	memset(&info, 0, sizeof(info));
+	info.si_pid = 4242;
+	trace.fd    = ctx->devnull;
+	trace.len   = 0;
+	i           = 0;
+	while (i < bytes * 8)
+		trace_record(&trace, ctx->signals[i++], &info);
+	trace_flush(&trace);
+	return (i);
+}
+
+/**
+ * @brief Validates and indexes a JSON message, as the server does with
+ * `-J`.
+ *
+ * @param ctx The benchmark inputs.
+ * @param bytes Number of document bytes indexed, in whole documents.
+ * @return Number of tape words produced.
+ *
+ * @ingroup bench
+ */
+static size_t kernel_json(t_bench_ctx* ctx, size_t bytes)
+{
+	static uint32_t idx[MT_SESSION_BUFFER];
+	static uint64_t tape[MT_SESSION_BUFFER];
+	size_t          done;
+	size_t          sum;
+
+	sum  = 0;
+	done = 0;
+	while (done < bytes)
+	{
+		sum += json_index(ctx->json, ctx->njson, idx, tape);
+		done += ctx->njson;
+	}
+	return (sum);
+}
+
+/**
+ * @brief Kernels known to the suite, in reporting order.
+ *
+ * @ingroup bench
+ */
+static const t_bench_kernel g_kernels[] = {
+	{"encode", kernel_encode, 1 << 20},
+	{"decode", kernel_decode, 1 << 20},
+	{"roundtrip", kernel_roundtrip, 1 << 20},
+	{"pack_fast", kernel_pack_fast, 1 << 20},
+	{"pack_strong", kernel_pack_strong, 1 << 20},
+	{"unpack", kernel_unpack, 1 << 20},
+	{"session", kernel_session, 1 << 20},
+	{"session_async", kernel_session_async, 1 << 20},
+	{"queue", kernel_queue, 1 << 20},
+	{"sink", kernel_sink, 1 << 20},
+	{"sink_writev", kernel_sink_writev, 1 << 20},
+	{"trace_record", kernel_trace, 1 << 18},
+	{"json_index", kernel_json, 1 << 20},
+};
+
+/**
+ * @brief Builds the payload and its pre-encoded forms.
+ *
+ * @param ctx The benchmark inputs to fill.
+ * @param len Payload length in bytes.
+ *
+ * @ingroup bench
+ */
+static void bench_setup(t_bench_ctx* ctx, size_t len)
+{
+	t_encoder     enc;
+	unsigned long rng;
+	size_t        i;
+	int           sig;
+
+	ctx->len     = len;
+	ctx->msg     = malloc(len + 1);
+	ctx->signals = malloc((len + 1) * 8 * sizeof(int));
+	ctx->packed  = malloc(MT_CODEC_HEADER + codec_bound(len));
+	ctx->out     = malloc(codec_bound(len));
+	ctx->devnull = open("/dev/null", O_WRONLY);
+	if (!ctx->msg || !ctx->signals || !ctx->packed || !ctx->out
+		|| ctx->devnull == -1)
+		sys_error("Bench: setup failed");
+	sink_open(&ctx->sink, ctx->devnull, 0);
+	sink_open(&ctx->vsink, ctx->devnull, MT_SINK_WRITEV);
+	rng = 88172645463325252UL;
+	i   = 0;
+	while (i < len)
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		ctx->msg[i++] = (char) (' ' + rng % 95);
+	}
+	ctx->msg[len] = '\0';
+	ctx->nsig     = 0;
+	encoder_init(&enc, ctx->msg);
+	while ((sig = encoder_next_signal(&enc)))
+		ctx->signals[ctx->nsig++] = sig;
+	ctx->npacked = codec_compress(MT_CODEC_STRONG, ctx->msg, len,
+								  ctx->packed + MT_CODEC_HEADER);
+	codec_header(ctx->packed, MT_CODEC_STRONG, ctx->npacked);
+	ctx->npacked += MT_CODEC_HEADER;
+	ctx->njson = snprintf(ctx->json, sizeof(ctx->json), "[");
+	i          = 0;
+	while (ctx->njson < sizeof(ctx->json) - 128)
+	{
+		if (i > 0)
+			ctx->json[ctx->njson++] = ',';
+		ctx->njson += snprintf(ctx->json + ctx->njson, 128,
+							   "{\"id\": %zu, \"name\": \"user\\t%.*s\", "
+							   "\"score\": %zu.25, \"tags\": [true, null]}",
+							   i, (int) (i % 8 + 1), "abcdefgh", i * 37);
+		i++;
+	}
+	ctx->json[ctx->njson++] = ']';
+}
+
+/**
+ * @internal
+ * @brief qsort comparator for doubles.
+ */
+static int cmp_double(const void* a, const void* b)
+{
+	double x;
+	double y;
+
+	x = *(const double*) a;
+	y = *(const double*) b;
+	return ((x > y) - (x < y));
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in nanoseconds.
+ *
+ * @ingroup bench
+ */
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/**
+ * @brief Measures one kernel and prints its statistics.
+ *
+ * @param ctx The benchmark inputs.
+ * @param k The kernel to measure.
+ * @param warmup Number of untimed runs.
+ * @param reps Number of timed runs.
+ * @param csv Print a CSV row instead of a table row.
+ *
+ * @ingroup bench
+ */
+static void bench_run(t_bench_ctx* ctx, const t_bench_kernel* k, int warmup,
+					  int reps, bool csv)
+{
+	volatile size_t sink;
+	double*         samples;
+	double          start;
+	double          mean;
+	double          var;
+	int             i;
+
+	samples = malloc(reps * sizeof(double));
+	if (!samples)
+		sys_error("Bench: malloc failed");
+	i = 0;
+	while (i++ < warmup)
+		sink = k->run(ctx, k->bytes);
+	mean = 0;
+	i    = 0;
+	while (i < reps)
+	{
+		start      = now_ns();
+		sink       = k->run(ctx, k->bytes);
+		samples[i] = (now_ns() - start) / k->bytes;
+		mean += samples[i++];
+	}
+	(void) sink;
+	mean /= reps;
+	var = 0;
+	i   = 0;
+	while (i < reps)
+	{
+		var += (samples[i] - mean) * (samples[i] - mean);
+		i++;
+	}
+	var = reps > 1 ? var / (reps - 1) : 0;
+	qsort(samples, reps, sizeof(double), cmp_double);
+	if (csv)
+		printf("%s,%zu,%d,%.3f,%.3f,%.3f,%.3f\n", k->name, k->bytes, reps,
+			   samples[0], samples[reps / 2], mean, sqrt(var));
+	else
+		printf("%-14s %10zu %5d %10.3f %10.3f %10.3f %10.3f\n", k->name,
+			   k->bytes, reps, samples[0], samples[reps / 2], mean, sqrt(var));
+	free(samples);
+}
+
+/**
+ * @brief Returns whether a kernel was selected on the command line.
+ *
+ * @param name Kernel name.
+ * @param argc Argument count.
+ * @param argv Argument vector; operands start at `optind`.
+ * @return true if no kernel was named or if `name` was.
+ *
+ * @ingroup bench
+ */
+static bool selected(const char* name, int argc, char** argv)
+{
+	int i;
+
+	if (optind >= argc)
+		return (true);
+	i = optind;
+	while (i < argc)
+		if (strcmp(argv[i++], name) == 0)
+			return (true);
+	return (false);
+}
+
+/**
+ * @brief Entry point of the microbenchmark suite.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS on success, or exits with error otherwise.
+ *
+ * @ingroup bench
+ */
+int main(int argc, char** argv)
+{
+	t_bench_ctx ctx;
+	size_t      i;
+	int         warmup;
+	int         reps;
+	int         opt;
+	bool        csv;
+
+	warmup = 3;
+	reps   = 15;
+	csv    = false;
+	while ((opt = getopt(argc, argv, "cw:r:")) != -1)
+	{
+		if (opt == 'c')
+			csv = true;
+		else if (opt == 'w')
+			warmup = atoi(optarg);
+		else if (opt == 'r')
+			reps = atoi(optarg);
+		else
+			break;
+	}
+	if (opt != -1 || reps < 1 || warmup < 0)
+	{
+		fprintf(stderr, "Usage: ./microbench [-c] [-w warmup] "
+						"[-r repetitions] [kernel...]\n");
+		return (EXIT_FAILURE);
+	}
+	bench_setup(&ctx, 1 << 20);
+	if (csv)
+		printf("kernel,bytes,reps,min_ns_per_byte,median_ns_per_byte,"
+			   "mean_ns_per_byte,stddev_ns_per_byte\n");
+	else
+		printf("%-14s %10s %5s %10s %10s %10s %10s\n", "kernel", "bytes",
+			   "reps", "min", "median", "mean", "stddev");
+	i = 0;
+	while (i < sizeof(g_kernels) / sizeof(*g_kernels))
+	{
+		if (selected(g_kernels[i].name, argc, argv))
+			bench_run(&ctx, &g_kernels[i], warmup, reps, csv);
+		i++;
+	}
+	sink_close(&ctx.sink);
+	sink_close(&ctx.vsink);
+	close(ctx.devnull);
+	free(ctx.signals);
+	free(ctx.msg);
+	return (EXIT_SUCCESS);
+}
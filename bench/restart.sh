@@ -0,0 +1,112 @@
+#!/bin/bash
+
+# Server restart check for the aggregator's spool.
+#
+# Runs an aggregator with a spool against a server that publishes its PID
+# with -i, stops the server, sends messages that must be spooled, then
+# starts a new server on the same PID file. The aggregator finds it with
+# -P and must deliver the spooled messages to it, in order, along with the
+# ones sent afterwards. Exits with status 1 if any message is missing.
+#
+# Usage: bench/restart.sh [-T timeout_s]
+#
+#   -T  Longest wait for the spool to drain, in seconds   (default 20)
+#
+# Run from the repository root after `make` and `make aggregator`.
+
+set -u
+
+TIMEOUT=20
+
+while getopts "T:" opt; do
+	case "$opt" in
+	T) TIMEOUT="$OPTARG" ;;
+	*) sed -n '3,15p' "$0" >&2; exit 1 ;;
+	esac
+done
+
+if [ ! -x ./server ] || [ ! -x ./aggregator ]; then
+	echo "Error: build the project with 'make' and 'make aggregator' first." >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+PIDFILE="$TMP/server.pid"
+SOCK="$TMP/aggregator.sock"
+trap 'kill $SERVER $AGG 2>/dev/null; wait 2>/dev/null; rm -rf "$TMP"' EXIT
+SERVER=
+AGG=
+
+# Sends one message through the aggregator and prints its answer.
+produce() {
+	python3 - "$SOCK" "$1" <<'EOF'
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.sendall(sys.argv[2].encode())
+s.shutdown(socket.SHUT_WR)
+print(s.recv(64).decode().strip())
+EOF
+}
+
+# Starts a server publishing its PID, output in the given file.
+start_server() {
+	./server -i "$PIDFILE" > "$1" 2>&1 &
+	SERVER=$!
+	for _ in $(seq 50); do
+		[ -s "$PIDFILE" ] && [ "$(cat "$PIDFILE")" = "$SERVER" ] && return
+		sleep 0.1
+	done
+	echo "Error: the server did not publish its PID." >&2
+	exit 1
+}
+
+fail=0
+expect() {
+	if [ "$2" != "$3" ]; then
+		echo "FAILED: $1 answered '$2', expected '$3'"
+		fail=1
+	fi
+}
+
+start_server "$TMP/first.out"
+FIRST=$SERVER
+./aggregator -s "$SOCK" -l 1 -f "$TMP/spool" -P "$PIDFILE" \
+	2> "$TMP/aggregator.err" &
+AGG=$!
+for _ in $(seq 50); do
+	[ -S "$SOCK" ] && break
+	sleep 0.1
+done
+
+expect "before" "$(produce "restart-check before")" OK
+kill -INT "$FIRST"
+wait "$FIRST"
+for i in 1 2 3; do
+	expect "down $i" "$(produce "restart-check down $i")" SPOOLED
+done
+
+start_server "$TMP/second.out"
+deadline=$((SECONDS + TIMEOUT))
+while [ "$(grep -c '^restart-check down' "$TMP/second.out")" -lt 3 ] \
+	&& [ $SECONDS -lt $deadline ]; do
+	sleep 0.2
+done
+expect "after" "$(produce "restart-check after")" OK
+sleep 0.2
+
+got=$(grep -h '^restart-check' "$TMP/first.out" "$TMP/second.out")
+want=$(printf 'restart-check %s\n' before "down 1" "down 2" "down 3" after)
+if [ "$got" != "$want" ]; then
+	echo "FAILED: messages delivered:"
+	echo "$got"
+	fail=1
+fi
+if [ "$SERVER" = "$FIRST" ]; then
+	echo "FAILED: the new server got the same PID"
+	fail=1
+fi
+if [ $fail -eq 0 ]; then
+	echo "Spool delivered to the restarted server (PID $FIRST -> $SERVER)."
+fi
+exit $fail
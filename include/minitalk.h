@@ -45,6 +45,57 @@
  * as input validation and error handling utilities.
  */
 
+/**
+ * @defgroup protocol Protocol Codec
+ * @brief Bit-level encoder and decoder shared by every Minitalk component.
+ *
+ * @details
+ * The encoder turns a message into the stream of signals sent by the
+ * client and the decoder rebuilds characters from them on the server side.
+ * Neither performs any I/O, so the same code runs in the real client and
+ * server, in the transport simulator and in the benchmarks.
+ */
+
+/**
+ * @defgroup simulator Transport Simulator
+ * @brief Deterministic, in-process model of the signal transport.
+ *
+ * @details
+ * Links the protocol codec against a simulated transport with configurable
+ * latency, processing cost, coalescing, loss and queue limits, and runs
+ * whole transfers in virtual time.
+ */
+
+/**
+ * @defgroup trace Signal Traces
+ * @brief Recording and replay of the raw signals received by the server.
+ *
+ * @details
+ * The server can record every received signal, with its sender and a
+ * timestamp, to a binary trace file. The replay tool feeds such a file
+ * back through the decoder at full speed, without the kernel in the loop.
+ */
+
+/**
+ * @defgroup stats Statistics Page
+ * @brief Live server counters in shared memory.
+ *
+ * @details
+ * The server publishes its counters, latency histograms and busiest
+ * clients in a shared-memory page, each section guarded by a seqlock, so
+ * that monitoring tools can read them at any rate without the server
+ * noticing.
+ */
+
+/**
+ * @defgroup bench Benchmarks
+ * @brief Microbenchmarks for the protocol and output kernels.
+ *
+ * @details
+ * Self-contained benchmark programs built by `make bench`, reporting
+ * nanoseconds per byte with warmup and repetition statistics.
+ */
+
 #ifndef MINITALK_H
 #define MINITALK_H
 
@@ -53,16 +104,1121 @@
 #endif
 
 #include "libft.h"
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 
-void  validate_input_server(int argc, char** argv);
+/**
+ * @typedef t_encoder
+ * @brief Cursor over a message being turned into signals.
+ *
+ * @details
+ * Walks the message bit by bit, most significant bit first, including the
+ * terminating null byte, which is sent at `end` whatever the buffer holds
+ * there, so that packed messages may contain null bytes.
+ */
+typedef struct s_encoder
+{
+	const char* msg;  ///< Current character of the message.
+	const char* end;  ///< Where the terminator goes.
+	int         bit;  ///< Index of the next bit to emit (7 to 0).
+	bool        done; ///< Set once the terminator has been emitted.
+} t_encoder;
+
+/**
+ * @typedef t_decoder
+ * @brief Character being rebuilt from received signals.
+ *
+ * @details
+ * Holds the partially assembled character and the index of the next bit
+ * expected, most significant bit first.
+ */
+typedef struct s_decoder
+{
+	int  bit; ///< Index of the next expected bit (7 to 0).
+	char c;   ///< Character under construction.
+} t_decoder;
+
+/** First byte of a packed message; it never occurs in UTF-8 text. */
+#define MT_CODEC_MARK 0xff
+/** Bytes before the payload of a packed message: mark, codec, length. */
+#define MT_CODEC_HEADER 6
+/** Messages shorter than this are always sent plain. */
+#define MT_CODEC_MIN 64
+/** Bytes of a message the codecs are timed on before choosing one. */
+#define MT_CODEC_SAMPLE 4096
+/** Distance a match may reach back, also the decoder's window. */
+#define MT_LZ_WINDOW 4096
+/** Earlier positions `MT_CODEC_STRONG` tries for each match. */
+#define MT_LZ_CHAIN 32
+/** Most bytes one payload byte may decode to. */
+#define MT_LZ_MAX_OUTPUT 18
+/** Returned by unpack_feed() for a match reaching before the message. */
+#define MT_UNPACK_CORRUPT (-2)
+
+/**
+ * @enum e_codec
+ * @brief Encodings of the payload of a packed message.
+ */
+typedef enum e_codec
+{
+	MT_CODEC_NONE,  ///< Stored as is.
+	MT_CODEC_FAST,  ///< LZSS, first match candidate only.
+	MT_CODEC_STRONG, ///< LZSS, best of `MT_LZ_CHAIN` candidates.
+	MT_CODEC_PROBE   ///< Transport probe, discarded by the server.
+} t_codec;
+
+/**
+ * @enum e_unpack_state
+ * @brief Where a `t_unpack` stands in the message.
+ */
+enum e_unpack_state
+{
+	MT_UNPACK_START,  ///< Nothing received yet.
+	MT_UNPACK_PLAIN,  ///< Plain message, passed through.
+	MT_UNPACK_HEADER, ///< Reading the codec and the payload length.
+	MT_UNPACK_BODY,   ///< Decoding the payload.
+	MT_UNPACK_TAIL    ///< Payload done, the terminator comes next.
+};
+
+/**
+ * @typedef t_unpack
+ * @brief Decoder turning received characters back into the message.
+ *
+ * @details
+ * Plain messages go through untouched; packed ones are decoded with the
+ * last `MT_LZ_WINDOW` bytes kept in `hist` for matches. Only the first
+ * `filled` bytes of `hist` belong to the message, the rest being left
+ * over from earlier ones. Fixed-size, so
+ * that it can live in a session.
+ */
+typedef struct s_unpack
+{
+	uint8_t  state;              ///< An `e_unpack_state`.
+	uint8_t  codec;              ///< Codec of the payload.
+	uint8_t  hdr;                ///< Header bytes read after the mark.
+	uint8_t  ctrl;               ///< Flags of the current item group.
+	uint8_t  nflags;             ///< Items left in that group.
+	int16_t  hi;                 ///< First byte of a match, or -1.
+	uint16_t pos;                ///< Next position in `hist`.
+	uint16_t filled;             ///< Bytes of `hist` decoded, at most full.
+	uint32_t remain;             ///< Payload bytes still to come.
+	char     hist[MT_LZ_WINDOW]; ///< Last decoded bytes.
+} t_unpack;
+
+/**
+ * @enum e_transport
+ * @brief Ways a sender can carry frames, all understood by the server.
+ */
+typedef enum e_transport
+{
+	MT_TRANSPORT_QUEUED,  ///< Numbered frames with `sigqueue()`, SACK acks.
+	MT_TRANSPORT_CLASSIC, ///< Bare signals with `kill()`, one at a time.
+	MT_TRANSPORT_COUNT
+} t_transport;
+
+/**
+ * @typedef t_link
+ * @brief What a sender measured of its transport and codec choices.
+ */
+typedef struct s_link
+{
+	double        bytes_per_s; ///< Transfer rate, moving average.
+	unsigned long codec[3];    ///< Messages sent with each `t_codec`.
+	size_t        raw;         ///< Bytes of the messages.
+	size_t        wire;        ///< Bytes actually sent, headers included.
+	t_transport   transport;   ///< Transport in use.
+	bool          cached;      ///< Whether it came from the tuning cache.
+	double        probed[MT_TRANSPORT_COUNT]; ///< Probe rates, B/s, or 0.
+} t_link;
+
+/** Transfer rate assumed until a first message has been timed, in B/s. */
+#define MT_LINK_INITIAL_BPS 4000.0
+/** Tuning cache of a user, holding the transport chosen on this host. */
+#define MT_TUNE_PATH "/tmp/minitalk-transport.%d"
+/** Seconds a cached transport choice is trusted before probing again. */
+#define MT_TUNE_TTL 3600
+/** Payload bytes of the message each transport is probed with. */
+#define MT_PROBE_BYTES 96
+
+/** Initial estimate of the time between sending a bit and its ack, in ns. */
+#define MT_RTT_INITIAL_NS 20000L
+/** Longest the client busy-waits for an ack before blocking, in ns. */
+#define MT_SPIN_MAX_NS 50000L
+
+/**
+ * @typedef t_ack_wait
+ * @brief State of the client's adaptive wait for acknowledgments.
+ *
+ * @details
+ * `rtt_ns` is an exponentially weighted moving average of the observed
+ * round-trip times; `spin_ns` is the busy-wait budget derived from it, 0
+ * when only blocking makes sense.
+ */
+typedef struct s_ack_wait
+{
+	long          rtt_ns;     ///< Smoothed round-trip time.
+	long          spin_ns;    ///< Current busy-wait budget.
+	bool          single_cpu; ///< Never spin: the server needs this CPU.
+	unsigned long spun;       ///< Acks caught while busy-waiting.
+	unsigned long blocked;    ///< Acks that needed a blocking wait.
+} t_ack_wait;
+
+/**
+ * Real-time signal carrying SACK acknowledgments. Unlike `SIGUSR1`, each
+ * one is queued with its own payload instead of merging with a pending one.
+ */
+#define MT_SIG_ACK (SIGRTMIN + 2)
+/** Most frames a client keeps unacknowledged; also the SACK bitmap width. */
+#define MT_SACK_WINDOW 16
+/** Frame numbers travel modulo this mask plus one. */
+#define MT_FRAME_MASK 0x7fff
+/** Position of the message ID in a frame's value. */
+#define MT_MSG_SHIFT 16
+/** Message IDs travel modulo this mask plus one. */
+#define MT_MSG_MASK 0x3fff
+/** Bits of a frame's value the server reads: message ID and frame number. */
+#define MT_FRAME_VALUE (MT_MSG_MASK << MT_MSG_SHIFT | MT_FRAME_MASK)
+/** Flag of an ack asking the client to send its message again. */
+#define MT_ACK_RESTART 0x80000000u
+/** How long copies of the frames of an ended message are expected, in ns. */
+#define MT_LATE_COPY_NS MT_RTO_MAX_NS
+/** Shortest time before unacknowledged frames are sent again, in ns. */
+#define MT_RTO_MIN_NS 2000000L
+/** Longest time before unacknowledged frames are sent again, in ns. */
+#define MT_RTO_MAX_NS 1000000000L
+
+/**
+ * @enum e_send_status
+ * @brief Outcome of sending a message.
+ */
+typedef enum e_send_status
+{
+	MT_SEND_OK,      ///< The server acknowledged the whole message.
+	MT_SEND_REFUSED, ///< The server answered that it is closing.
+	MT_SEND_GONE     ///< The server process no longer exists.
+} t_send_status;
+
+/**
+ * @typedef t_window
+ * @brief Frames a client has sent and not yet seen acknowledged.
+ *
+ * @details
+ * Each bit of the message is a frame, numbered from 0 and sent with
+ * `sigqueue()` with its number, modulo `MT_FRAME_MASK + 1`, as value,
+ * along with `id` from bit `MT_MSG_SHIFT`, so that the server tells
+ * copies of the previous message's frames from the new ones. The server's
+ * ack, an `MT_SIG_ACK` signal, carries the number of the first frame it
+ * is missing in its upper 16 bits and a bitmap of the frames after it
+ * that it holds in the lower 16 (bit i for frame `base + i`), or
+ * `MT_ACK_RESTART` with the ID of a message it holds no session for,
+ * which must then be sent again from frame 0. Frames are indexed by their
+ * number modulo `MT_SACK_WINDOW`. With `classic` set, frames are sent
+ * with `kill()` instead and answered with a bare `SIGUSR1`, one at a time.
+ */
+typedef struct s_window
+{
+	int           sig[MT_SACK_WINDOW];     ///< Signal carrying each frame.
+	long          sent_ns[MT_SACK_WINDOW]; ///< Last time each was sent.
+	bool          resent[MT_SACK_WINDOW];  ///< Whether it was sent again.
+	uint32_t      base;    ///< First frame not acknowledged.
+	uint32_t      next;    ///< Next frame to send for the first time.
+	uint32_t      sack;    ///< Frames after `base` the server holds.
+	uint32_t      id;      ///< ID of this message, up to `MT_MSG_MASK`.
+	size_t        size;    ///< Frames allowed in flight.
+	bool          sack_ok; ///< Whether the server sends SACK payloads.
+	bool          classic; ///< Frames go with `kill()`, unnumbered.
+	long          rto_ns;  ///< Current retransmission timeout.
+	unsigned long resends; ///< Frames sent more than once.
+	t_send_status status;  ///< Set once the message cannot be delivered.
+} t_window;
+
+/** Magic bytes opening every trace file. */
+#define MT_TRACE_MAGIC "MTTRACE1"
+/** Number of records staged in memory before a trace write. */
+#define MT_TRACE_BUFFER 256
+
+/**
+ * @typedef t_trace_record
+ * @brief One received signal as stored in a trace file.
+ *
+ * @details
+ * Records are 24 bytes long and stored in host byte order, directly after
+ * the `MT_TRACE_MAGIC` header.
+ */
+typedef struct s_trace_record
+{
+	uint64_t ns;    ///< `CLOCK_MONOTONIC` reception time in nanoseconds.
+	int32_t  sig;   ///< Received signal number.
+	int32_t  pid;   ///< Sender PID (`si_pid`).
+	int32_t  value; ///< Signal payload (`si_value.sival_int`).
+	int32_t  code;  ///< Origin (`si_code`); 0 (`SI_USER`) in older traces.
+} t_trace_record;
+
+/**
+ * @typedef t_trace
+ * @brief Trace file being recorded.
+ *
+ * @details
+ * Records are staged in `buf` and written out when it fills up or on an
+ * explicit flush. A negative `fd` disables recording.
+ */
+typedef struct s_trace
+{
+	int            fd;                  ///< Trace file, or -1 when disabled.
+	size_t         len;                 ///< Number of staged records.
+	t_trace_record buf[MT_TRACE_BUFFER]; ///< Staged records.
+} t_trace;
+
+/** Maximum number of clients the server reassembles messages for at once. */
+#define MT_MAX_SESSIONS 64
+/** Bytes buffered per session before they are written out. */
+#define MT_SESSION_BUFFER 4096
+/** Default time, in seconds, given to active sessions on shutdown. */
+#define MT_DRAIN_TIMEOUT 5
+/** Room kept in an output chunk for the header of a stream record. */
+#define MT_STREAM_HEADER 32
+
+/**
+ * @typedef t_session
+ * @brief Message being received from one client.
+ *
+ * @details
+ * A slot with `pid` 0 is free. Decoded characters accumulate in `buf`
+ * until the message ends or the buffer fills up. Clients that number
+ * their frames may get them through out of order; frames ahead of
+ * `frame` wait in `sack` and `sack_bits` until the gap is filled.
+ */
+typedef struct s_session
+{
+	pid_t     pid;                    ///< Client PID, 0 for a free slot.
+	t_decoder dec;                    ///< Bit decoder of this client.
+	t_unpack  unpack;                 ///< Decompressor of this client.
+	uint16_t  frame;                  ///< Next frame expected in order.
+	uint16_t  sack;                   ///< Frames held ahead, bit i: frame+i.
+	uint16_t  sack_bits;              ///< Bits carried by those frames.
+	int16_t   id;                     ///< ID of its message, or -1.
+	size_t    len;                    ///< Number of buffered bytes.
+	long      start_ns;               ///< When the session was opened.
+	bool      flushed;                ///< Part of the message was written.
+	char      buf[MT_SESSION_BUFFER]; ///< Decoded, not yet written bytes.
+} t_session;
+
+/**
+ * @typedef t_server_stats
+ * @brief Counters reported by the server when it shuts down.
+ *
+ * @details
+ * All counters are cumulative since the server started.
+ */
+typedef struct s_server_stats
+{
+	unsigned long messages; ///< Messages received up to their terminator.
+	unsigned long bytes;    ///< Bytes written to the output.
+	unsigned long sessions; ///< Sessions opened.
+	unsigned long aborted;  ///< Sessions ended before their terminator.
+	unsigned long rejected; ///< Signals refused while closing or full.
+} t_server_stats;
+
+/** Default number of chunks the output queue holds. */
+#define MT_WRITER_DEPTH 256
+
+/**
+ * @enum e_writer_policy
+ * @brief What the server does with output when the writer queue is full.
+ */
+typedef enum e_writer_policy
+{
+	MT_POLICY_BLOCK, ///< Wait for the writer to free a slot.
+	MT_POLICY_DROP,  ///< Discard the oldest queued chunk.
+	MT_POLICY_SPILL  ///< Spill to a temporary file until the writer catches up.
+} t_writer_policy;
+
+/** Size of the huge pages regions are rounded up to. */
+#define MT_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+/**
+ * @enum e_page_kind
+ * @brief Pages a memory region ended up backed by.
+ */
+typedef enum e_page_kind
+{
+	MT_PAGES_SMALL,  ///< Normal pages.
+	MT_PAGES_THP,    ///< Transparent huge pages, advised.
+	MT_PAGES_HUGETLB ///< Reserved huge pages from `MAP_HUGETLB`.
+} t_page_kind;
+
+/**
+ * @typedef t_region
+ * @brief Anonymous memory mapping, pre-faulted when created.
+ */
+typedef struct s_region
+{
+	void*       addr; ///< Start of the mapping.
+	size_t      len;  ///< Length of the mapping.
+	t_page_kind kind; ///< Pages backing it.
+} t_region;
+
+/** Maximum number of queued chunks written out in one submission. */
+#define MT_WRITER_BATCH 32
+/** Sink flag: never use io_uring, write with `writev()`. */
+#define MT_SINK_WRITEV 1u
+/** Sink flag: make each batch durable if the output is a regular file. */
+#define MT_SINK_SYNC 2u
+/** Writer flag: back the queue with huge pages if possible. */
+#define MT_WRITER_HUGE 4u
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @typedef t_sink
+ * @brief Output descriptor written in batches, through io_uring if possible.
+ *
+ * @details
+ * `ring_fd` is -1 when the `writev()` fallback is used; the other ring
+ * fields are then unused. See sink.c.
+ */
+typedef struct s_sink
+{
+	int                  fd;        ///< Output descriptor.
+	bool                 sync;      ///< Whether batches are synced to disk.
+	int                  ring_fd;   ///< io_uring descriptor, or -1.
+	bool                 uring;     ///< Whether io_uring was set up.
+	void*                sq_ptr;    ///< Mapped submission ring.
+	size_t               sq_len;    ///< Size of the submission mapping.
+	void*                cq_ptr;    ///< Mapped completion ring.
+	size_t               cq_len;    ///< Size of the completion mapping.
+	struct io_uring_sqe* sqes;      ///< Mapped submission entries.
+	size_t               sqes_len;  ///< Size of the entries mapping.
+	unsigned*            sq_tail;   ///< Submission ring tail.
+	unsigned*            sq_array;  ///< Submission ring index array.
+	unsigned             sq_mask;   ///< Submission ring mask.
+	unsigned*            cq_head;   ///< Completion ring head.
+	unsigned*            cq_tail;   ///< Completion ring tail.
+	unsigned             cq_mask;   ///< Completion ring mask.
+	struct io_uring_cqe* cqes;      ///< Completion entries.
+	struct iovec*        iov;       ///< Rest of the batch in flight.
+	int                  cnt;       ///< Entries left in `iov`, 0 if none.
+	unsigned             pending;   ///< Completions still awaited.
+	unsigned             unsent;    ///< Entries queued, not yet submitted.
+	long                 res;       ///< Result of the last `WRITEV`.
+	unsigned long        submits;   ///< Write submissions issued.
+} t_sink;
+
+/** Size of a cache line, the unit of false sharing between cores. */
+#define MT_CACHE_LINE 64
+
+/**
+ * @typedef t_writer_cell
+ * @brief One slot of the output queue.
+ *
+ * @details
+ * `seq` equals the slot's position when the slot is free for a producer
+ * and the position plus one once it holds a chunk for the writer. Cells
+ * start on a cache line, so the header of one never shares a line with
+ * the bytes of its neighbour.
+ */
+typedef struct s_writer_cell
+{
+	_Alignas(MT_CACHE_LINE) atomic_size_t seq; ///< Sequence number.
+	size_t len;                                ///< Number of bytes in `data`.
+	char   data[MT_SESSION_BUFFER];            ///< Queued bytes.
+} t_writer_cell;
+
+/**
+ * @typedef t_writer_stats
+ * @brief Counters kept by the producers of the output queue.
+ */
+typedef struct s_writer_stats
+{
+	atomic_ulong pushed;  ///< Chunks handed to the writer.
+	atomic_ulong dropped; ///< Chunks discarded by `MT_POLICY_DROP`.
+	atomic_ulong spilled; ///< Chunks sent to the spill file.
+	atomic_ulong blocked; ///< Pushes that had to wait for a free slot.
+} t_writer_stats;
+
+/**
+ * @typedef t_writer_batch
+ * @brief Cells the writer thread has claimed and hands to its sink.
+ *
+ * @details
+ * The cells stay claimed, so their bytes stay valid, until the sink has
+ * written them; `iov` is the vector the sink works through meanwhile.
+ */
+typedef struct s_writer_batch
+{
+	t_writer_cell* cells[MT_WRITER_BATCH]; ///< Claimed cells.
+	size_t         pos[MT_WRITER_BATCH];   ///< Their positions.
+	struct iovec   iov[MT_WRITER_BATCH];   ///< Their bytes.
+	int            n;                      ///< Cells held, 0 if none.
+} t_writer_batch;
+
+/**
+ * @typedef t_writer
+ * @brief Output queue drained by a dedicated writer thread.
+ *
+ * @details
+ * Fields are grouped by who writes them, each group starting on its own
+ * cache line: settings fixed at startup, then the producers' index and
+ * counters, then the writer thread's index, counters and sink, then the
+ * spill state. Neither side ever writes a line the other side only
+ * reads, apart from the cells and the semaphore that hand chunks over.
+ * See writer.c for the queue algorithm and the overflow policies.
+ */
+typedef struct s_writer
+{
+	t_region        mem;      ///< Mapping holding the ring.
+	t_writer_cell*  cells;    ///< Ring of `mask + 1` slots.
+	size_t          mask;     ///< Ring size minus one.
+	t_writer_policy policy;   ///< Behaviour when the ring is full.
+	int             spill_fd; ///< Unlinked spill file, or -1.
+	pthread_t       thread;   ///< The writer thread.
+	atomic_bool     stop;     ///< Set to make the thread exit when idle.
+	sem_t           items;    ///< Posted once per pushed chunk.
+
+	_Alignas(MT_CACHE_LINE) atomic_size_t head; ///< Next position to fill.
+	t_writer_stats stats;                        ///< Producer counters.
+
+	_Alignas(MT_CACHE_LINE) atomic_size_t tail; ///< Next position to write.
+	atomic_size_t  retired;   ///< Positions written out or dropped.
+	unsigned long  written;   ///< Chunks written to the output.
+	size_t         max_depth; ///< Deepest backlog seen by the writer.
+	off_t          spill_rd;  ///< Spill offset of the next chunk to write.
+	t_sink         sink;      ///< Output the chunks are written to.
+	t_writer_batch batch[2];  ///< Batch being gathered, batch in flight.
+	int            next;      ///< Index of the batch being gathered.
+
+	_Alignas(MT_CACHE_LINE) atomic_flag spill_lock; ///< Guards what follows.
+	off_t       spill_wr; ///< Spill offset of the next chunk to add.
+	atomic_bool spilling; ///< Whether new chunks go to the spill file.
+
+	struct s_stats_output* report; ///< Stats page section, or NULL.
+} t_writer;
+
+/** Number of chunks the processing pool can hold at once. */
+#define MT_POOL_TASKS 256
+/** Maximum number of processing pool threads. */
+#define MT_MAX_POOL 16
+/** Largest output a task may produce from one chunk. */
+#define MT_TASK_OUTPUT (MT_SESSION_BUFFER * 4)
+
+/**
+ * @typedef t_task_fn
+ * @brief Processing step applied to each chunk of output.
+ *
+ * @param in Chunk as reassembled.
+ * @param len Length of the chunk, at most `MT_SESSION_BUFFER`.
+ * @param out Buffer of `MT_TASK_OUTPUT` bytes receiving the result.
+ * @return Length of the result.
+ */
+typedef size_t (*t_task_fn)(const char* in, size_t len, char* out);
+
+/**
+ * @enum e_task_kind
+ * @brief Work a pool task stands for.
+ */
+typedef enum e_task_kind
+{
+	MT_TASK_PLAIN,   ///< Output chunk, through the processing step if any.
+	MT_TASK_METRICS, ///< Complete lines, metrics folded and the rest output.
+	MT_TASK_JSON     ///< Complete message, indexed into the tape file.
+} t_task_kind;
+
+/**
+ * @typedef t_task
+ * @brief One chunk of a client's output going through the pool.
+ */
+typedef struct s_task
+{
+	struct s_task*   next;                ///< Next free task.
+	struct s_stream* stream;              ///< Output stream of the client.
+	uint32_t         seq;                 ///< Position in that stream.
+	t_task_kind      kind;                ///< Work to do on `in`.
+	size_t           len;                 ///< Bytes in `in`.
+	size_t           out_len;             ///< Bytes in `out`.
+	char             in[MT_SESSION_BUFFER]; ///< Chunk to process.
+	char             out[MT_TASK_OUTPUT];   ///< Processed chunk.
+} t_task;
+
+/**
+ * @typedef t_stream
+ * @brief Ordering state of one client's output in the pool.
+ *
+ * @details
+ * Tasks get consecutive sequence numbers when submitted and are written
+ * out in that order: one that completes early is parked in the slot of
+ * its number until every task before it has been written. The stream is
+ * free for another client once `next_out` caught up with `next_seq`.
+ */
+typedef struct s_stream
+{
+	atomic_flag lock;                 ///< Guards the fields below.
+	pid_t       pid;                  ///< Client, or 0 if never used.
+	uint32_t    next_seq;             ///< Number of the next submitted task.
+	uint32_t    next_out;             ///< Number of the next task to write.
+	bool        emitting;             ///< Whether a thread is writing.
+	t_task*     parked[MT_POOL_TASKS]; ///< Completed tasks, by number.
+} t_stream;
+
+/**
+ * @typedef t_deque
+ * @brief Tasks waiting in front of one pool thread.
+ *
+ * @details
+ * The owner takes the oldest task from `head`; idle threads steal the
+ * newest from `tail`.
+ */
+typedef struct s_deque
+{
+	_Alignas(MT_CACHE_LINE) atomic_flag lock; ///< Guards the fields below.
+	size_t         head;                ///< Index of the oldest task.
+	size_t         tail;                ///< Index past the newest task.
+	t_task*        items[MT_POOL_TASKS]; ///< Ring of waiting tasks.
+	struct s_pool* owner;               ///< Pool of the owning thread.
+} t_deque;
+
+/**
+ * @typedef t_pool
+ * @brief Work-stealing thread pool processing output before the writer.
+ */
+typedef struct s_pool
+{
+	t_region          mem;                    ///< Backing memory of the tasks.
+	t_task*           free;                   ///< Free tasks.
+	atomic_flag       lock;                   ///< Guards `free` and `streams`.
+	t_stream          streams[MT_POOL_TASKS]; ///< Output streams by client.
+	t_deque           deques[MT_MAX_POOL];    ///< One deque per thread.
+	pthread_t         threads[MT_MAX_POOL];   ///< Pool threads.
+	size_t            count;                  ///< Number of threads.
+	sem_t             items;                  ///< One post per submitted task.
+	atomic_bool       stop;                   ///< Asks the threads to exit.
+	atomic_size_t     pending;                ///< Tasks not yet written out.
+	t_writer*         writer;                 ///< Queue the results go to.
+	t_task_fn         fn;                     ///< Processing step, or NULL.
+	struct s_metrics* metrics;                ///< Aggregation fed, or NULL.
+	struct s_tapes*   tapes;                  ///< JSON indexing, or NULL.
+	atomic_ulong      tasks;                  ///< Tasks processed.
+	atomic_ulong      stolen;                 ///< Tasks run by a thief.
+	atomic_ulong      parked;                 ///< Tasks completed out of order.
+} t_pool;
+
+/** Longest metric name kept, terminating null byte included. */
+#define MT_METRIC_NAME 128
+/** Longest line parsed as a metric; longer ones pass through. */
+#define MT_METRIC_LINE 256
+/** Entries of each aggregation table, a power of two. */
+#define MT_METRICS_SLOTS 2048
+
+/**
+ * @enum e_metric_type
+ * @brief Kinds of statsd metrics the server aggregates.
+ */
+typedef enum e_metric_type
+{
+	MT_METRIC_COUNTER, ///< `c`: values are summed.
+	MT_METRIC_GAUGE,   ///< `g`: the last value wins.
+	MT_METRIC_TIMER    ///< `ms` or `h`: count, min, max and mean are kept.
+} t_metric_type;
+
+/**
+ * @typedef t_metric
+ * @brief Aggregate of one metric over the current interval.
+ */
+typedef struct s_metric
+{
+	char     name[MT_METRIC_NAME]; ///< Metric name, empty for a free entry.
+	uint8_t  type;                 ///< A `t_metric_type`.
+	uint64_t count;                ///< Lines folded in.
+	double   sum;                  ///< Sum of the values, sample rates applied.
+	double   min;                  ///< Smallest value.
+	double   max;                  ///< Largest value.
+	double   last;                 ///< Latest value.
+} t_metric;
+
+/**
+ * @typedef t_metrics
+ * @brief Aggregation of statsd lines, flushed at a fixed interval.
+ *
+ * @details
+ * Lines are folded into `tables[active]` by the pool threads, under
+ * `lock`. The flusher thread swaps the tables once per interval and
+ * writes out the one it took while the other fills up, so the lock is
+ * only ever held for one table update or one swap.
+ */
+typedef struct s_metrics
+{
+	_Alignas(MT_CACHE_LINE) atomic_flag lock; ///< Guards the fields below.
+	t_region      mem;         ///< Mapping holding both tables.
+	t_metric*     tables[2];   ///< Tables being filled and flushed.
+	size_t        used[2];     ///< Entries taken in each table.
+	int           active;      ///< Table new lines go to.
+	unsigned long dropped;     ///< Metric lines lost to a full table.
+
+	_Alignas(MT_CACHE_LINE) atomic_ulong lines; ///< Metric lines folded.
+	atomic_ulong  passed;      ///< Other lines, written as they are.
+	t_writer*     writer;      ///< Where aggregates are written.
+	long          interval_ms; ///< Time between flushes.
+	pthread_t     thread;      ///< The flusher thread.
+	sem_t         wake;        ///< Posted to stop the flusher early.
+	atomic_bool   stop;        ///< Set to make the flusher exit.
+	unsigned long flushes;     ///< Intervals written out.
+	unsigned long emitted;     ///< Aggregate lines written.
+} t_metrics;
+
+/** Deepest nesting of arrays and objects a JSON message may have. */
+#define MT_JSON_DEPTH 64
+/** Magic bytes opening a tape record. */
+#define MT_TAPE_MAGIC "MTJT"
+/** Builds a tape word from its type and payload. */
+#define MT_TAPE_WORD(type, payload) ((uint64_t) (type) << 56 | (payload))
+
+/**
+ * @enum e_tape_type
+ * @brief Types of the words of a JSON tape, held in their top byte.
+ *
+ * @details
+ * The low 56 bits of a word are its payload. An opening word holds the
+ * index of the word following its closing one, and a closing word the
+ * index of its opening one, so a consumer can skip a whole container. A
+ * string or number holds the offset of its first byte in the raw message
+ * in its low 32 bits and its length above them; strings are left
+ * escaped. Object members are a string key followed by the value.
+ */
+typedef enum e_tape_type
+{
+	MT_TAPE_OBJECT     = '{', ///< Start of an object.
+	MT_TAPE_OBJECT_END = '}', ///< End of an object.
+	MT_TAPE_ARRAY      = '[', ///< Start of an array.
+	MT_TAPE_ARRAY_END  = ']', ///< End of an array.
+	MT_TAPE_STRING     = '"', ///< String, quotes excluded.
+	MT_TAPE_NUMBER     = 'd', ///< Number, as written.
+	MT_TAPE_TRUE       = 't', ///< `true`.
+	MT_TAPE_FALSE      = 'f', ///< `false`.
+	MT_TAPE_NULL       = 'n'  ///< `null`.
+} t_tape_type;
+
+/**
+ * @typedef t_tape_header
+ * @brief Header of a tape record.
+ *
+ * @details
+ * It is followed by the raw message, padded with zero bytes to a multiple
+ * of 8, then by `words` 64-bit tape words, in host byte order.
+ */
+typedef struct s_tape_header
+{
+	char     magic[4]; ///< `MT_TAPE_MAGIC`.
+	uint32_t pid;      ///< Client that sent the message.
+	uint32_t raw_len;  ///< Length of the message, newline excluded.
+	uint32_t words;    ///< Number of tape words.
+} t_tape_header;
+
+/**
+ * @typedef t_tapes
+ * @brief Indexing of JSON messages into a tape file.
+ *
+ * @details
+ * Records go through their own writer, so indexing never holds up the
+ * output of the messages themselves. A record is pushed as several
+ * chunks, under `lock` so that the records of concurrent sessions do not
+ * interleave.
+ */
+typedef struct s_tapes
+{
+	_Alignas(MT_CACHE_LINE) atomic_flag lock; ///< Keeps records whole.
+	t_writer     writer;  ///< Writes the records.
+	int          fd;      ///< The tape file.
+	atomic_ulong indexed; ///< Messages indexed.
+	atomic_ulong invalid; ///< Messages that are not valid JSON.
+	atomic_ulong skipped; ///< Messages too long to be indexed.
+} t_tapes;
+
+/**
+ * @typedef t_ended
+ * @brief Last numbered message of a client without a session.
+ *
+ * @details
+ * Kept for `MT_LATE_COPY_NS`, so that a copy of its frame 0 arriving late
+ * is not taken for the start of a new message.
+ */
+typedef struct s_ended
+{
+	pid_t   pid;    ///< Client, 0 for an unused entry.
+	int16_t id;     ///< ID of its message.
+	long    end_ns; ///< When the message ended.
+} t_ended;
+
+/**
+ * @typedef t_sessions
+ * @brief Table of the sessions in progress.
+ *
+ * @details
+ * Fixed-size so it can be used from a signal handler without allocating.
+ * When `writer` is set, output goes through its queue instead of being
+ * written to `out_fd` directly; when `pool` is set, it is processed there
+ * first. New sessions are refused once `active`
+ * reaches `capacity`.
+ *
+ * With `stream` set, output is a sequence of records instead of plain
+ * messages: `<pid> + <len>` and a newline, followed by `len` bytes of the
+ * message, for every `stream` bytes received; then `<pid> .` once the
+ * message is complete or `<pid> !` if it was aborted, each on its own
+ * line.
+ */
+typedef struct s_sessions
+{
+	int            out_fd;                 ///< Descriptor for messages.
+	t_writer*      writer;                 ///< Output queue, or NULL.
+	struct s_pool* pool;                   ///< Processing pool, or NULL.
+	size_t         stream;                 ///< Stream record size, 0 if off.
+	size_t         active;                 ///< Number of used slots.
+	size_t         capacity;               ///< Sessions allowed at once.
+	t_server_stats stats;                  ///< Cumulative counters.
+	t_server_stats shown;                  ///< Part of them in `lane`.
+	struct s_stats_lane* lane;             ///< Stats page section, or NULL.
+	t_metrics*     metrics;                ///< Metric aggregation, or NULL.
+	t_tapes*       tapes;                  ///< JSON indexing, or NULL.
+	t_session      slots[MT_MAX_SESSIONS]; ///< Session slots.
+	t_ended        ended[MT_MAX_SESSIONS]; ///< Last message of past clients.
+	size_t         ended_next;             ///< Entry the next one takes.
+} t_sessions;
+
+/** Real-time signal carrying server-to-server control messages. */
+#define MT_SIG_CONTROL SIGRTMIN
+/** Control value: a new server asks to take over. */
+#define MT_HANDOFF_REQUEST 1
+/** Control value: the snapshot is ready to be read. */
+#define MT_HANDOFF_READY 2
+/** Control value: the new server has restored the snapshot. */
+#define MT_HANDOFF_DONE 3
+/** Control value: the new server cannot use the snapshot. */
+#define MT_HANDOFF_REFUSED 4
+/** Longest wait for the next bit of clients sending bare signals, in ns. */
+#define MT_HANDOFF_DRAIN_NS 100000000L
+/** Magic bytes opening a handoff snapshot. */
+#define MT_HANDOFF_MAGIC "MTHAND01"
+/**
+ * Layout version of a handoff snapshot, bumped with every change to
+ * `t_handoff` or to a type it holds, down to padding a new field fits in.
+ */
+#define MT_HANDOFF_VERSION 6
+
+/**
+ * @typedef t_handoff
+ * @brief Server state passed to a new server through shared memory.
+ *
+ * @details
+ * Holds every session slot, with its decoder state and buffered bytes,
+ * and the cumulative counters, so the new server resumes exactly where
+ * the old one stopped. The fields before `stats` describe the layout and
+ * never move, so that a server built with another layout can tell and
+ * refuse the snapshot.
+ */
+typedef struct s_handoff
+{
+	char           magic[8];               ///< `MT_HANDOFF_MAGIC`.
+	uint32_t       version;                ///< `MT_HANDOFF_VERSION`.
+	uint32_t       session_size;           ///< `sizeof(t_session)`.
+	uint32_t       max_sessions;           ///< `MT_MAX_SESSIONS`.
+	t_server_stats stats;                  ///< Counters of the old server.
+	t_session      slots[MT_MAX_SESSIONS]; ///< Session slots.
+} t_handoff;
+
+/**
+ * @typedef t_server_config
+ * @brief Options given to the server on the command line.
+ *
+ * @details
+ * Filled by validate_input_server(); unset options keep their defaults.
+ */
+typedef struct s_server_config
+{
+	const char*     trace_path;    ///< Trace file to record into, or NULL.
+	int             drain_timeout; ///< Seconds granted to sessions on shutdown.
+	pid_t           takeover_pid;  ///< Server to take over from, or 0.
+	size_t          writer_depth;  ///< Slots in the output queue.
+	t_writer_policy writer_policy; ///< Behaviour when the queue is full.
+	unsigned        output_flags;  ///< `MT_SINK_*` and `MT_WRITER_*` flags.
+	long            busy_idle_us;  ///< Busy-poll idle backoff, -1 if off.
+	int             busy_cpu;      ///< CPU to pin the polling thread, or -1.
+	size_t          workers;       ///< Session worker threads, 0 for none.
+	bool            escape;        ///< Escape control characters in output.
+	size_t          pool_threads;  ///< Threads of the processing pool.
+	size_t          stream_chunk;  ///< Stream record size, 0 if off.
+	bool            stats_page;    ///< Publish counters in shared memory.
+	long            metrics_ms;    ///< Metric flush interval, 0 if off.
+	const char*     tape_path;     ///< JSON tape file, or NULL.
+	const char*     pid_path;      ///< File publishing the PID, or NULL.
+} t_server_config;
+
+/**
+ * @typedef t_poll_stats
+ * @brief Counters of the server's busy-poll loop.
+ */
+typedef struct s_poll_stats
+{
+	unsigned long polls; ///< Checks for a pending signal.
+	unsigned long hits;  ///< Checks that returned a signal.
+	unsigned long naps;  ///< Blocking waits taken after an idle period.
+} t_poll_stats;
+
+/** Real-time signal forwarding a client bit to the worker owning it. */
+#define MT_SIG_SHARD (SIGRTMIN + 1)
+/** Maximum number of session worker threads. */
+#define MT_MAX_SHARDS 16
+/** Attempts at forwarding a bit while a worker's signal queue is full. */
+#define MT_SHARD_RETRIES 64
+
+/**
+ * @typedef t_shard
+ * @brief Session worker thread and the sessions it owns.
+ *
+ * @details
+ * Only the worker touches `table` while it runs; `opened` keeps counting
+ * across restarts for the summary. `lost` holds the clients a bit could
+ * not be forwarded for; the worker aborts their sessions before serving
+ * anything else.
+ */
+typedef struct s_shard
+{
+	pthread_t        thread; ///< Worker thread.
+	pid_t            tid;    ///< Kernel thread ID signals are addressed to.
+	struct s_shards* owner;  ///< Workers this one belongs to.
+	t_sessions       table;  ///< Sessions of the clients hashed to it.
+	unsigned long    opened; ///< Sessions opened by this worker in total.
+	atomic_int       nlost;  ///< Entries set in `lost`.
+	atomic_int       lost[MT_MAX_SESSIONS]; ///< Clients to abort, 0 if free.
+} t_shard;
+
+/**
+ * @typedef t_shards
+ * @brief Session workers of a sharded server.
+ *
+ * @details
+ * Fixed-size like the session table. With `count` 0 the server handles
+ * every signal itself; `used` remembers how many workers ever ran.
+ */
+typedef struct s_shards
+{
+	size_t        count;                ///< Running workers, 0 when stopped.
+	size_t        used;                 ///< Workers started at least once.
+	pid_t         tgid;                 ///< PID of the server.
+	sem_t         ready;                ///< Posted by each started worker.
+	cpu_set_t     cpus;                 ///< CPUs the server may run on.
+	unsigned long retries;              ///< Forwards retried, queue full.
+	unsigned long lost;                 ///< Forwards given up on.
+	t_shard       shard[MT_MAX_SHARDS]; ///< Workers.
+} t_shards;
+
+/** Magic bytes opening a stats page. */
+#define MT_STATS_MAGIC "MTSTATS1"
+/** Buckets of a latency histogram; bucket i counts values below 2^(i+1). */
+#define MT_STATS_BUCKETS 32
+/** Clients whose traffic each lane of the stats page keeps. */
+#define MT_STATS_CLIENTS 32
+/** Lanes of the stats page: the main thread and every session worker. */
+#define MT_STATS_LANES (MT_MAX_SHARDS + 1)
+/** Times a reader tries to copy a lane that keeps changing. */
+#define MT_STATS_RETRIES 1000
+
+/**
+ * @typedef t_stats_client
+ * @brief Traffic of one client as shown on the stats page.
+ */
+typedef struct s_stats_client
+{
+	int32_t  pid;      ///< Client PID, 0 for a free entry.
+	uint32_t messages; ///< Messages completed.
+	uint64_t bytes;    ///< Bytes written out.
+} t_stats_client;
+
+/**
+ * @typedef t_stats_lane
+ * @brief Counters published by one thread handling sessions.
+ *
+ * @details
+ * Written by a single thread under the `seq` seqlock: odd while an update
+ * is in progress, bumped again once it is done. Counters only grow; the
+ * server's totals are the sums over the lanes.
+ */
+typedef struct s_stats_lane
+{
+	_Alignas(MT_CACHE_LINE) atomic_uint seq; ///< Seqlock sequence number.
+	uint64_t signals;  ///< Data signals served.
+	uint64_t messages; ///< Messages received up to their terminator.
+	uint64_t bytes;    ///< Bytes written to the output.
+	uint64_t sessions; ///< Sessions opened.
+	uint64_t aborted;  ///< Sessions ended before their terminator.
+	uint64_t rejected; ///< Signals refused while closing or full.
+	uint64_t active;   ///< Sessions open right now.
+	uint64_t ack_ns[MT_STATS_BUCKETS]; ///< From taking a signal to its ack.
+	uint64_t msg_us[MT_STATS_BUCKETS]; ///< From a session's start to its end.
+	t_stats_client clients[MT_STATS_CLIENTS]; ///< Busiest recent clients.
+} t_stats_lane;
+
+/**
+ * @typedef t_stats_output
+ * @brief State of the output queue, published by the writer thread.
+ */
+typedef struct s_stats_output
+{
+	_Alignas(MT_CACHE_LINE) atomic_uint seq; ///< Seqlock sequence number.
+	uint64_t capacity;  ///< Chunks the queue holds.
+	uint64_t depth;     ///< Chunks queued when last sampled.
+	uint64_t max_depth; ///< Deepest backlog seen.
+	uint64_t written;   ///< Chunks written to the output.
+	uint64_t dropped;   ///< Chunks discarded by `MT_POLICY_DROP`.
+	uint64_t spilled;   ///< Chunks sent to the spill file.
+	uint64_t blocked;   ///< Pushes that had to wait for a free slot.
+} t_stats_output;
+
+/**
+ * @typedef t_stats_page
+ * @brief Shared-memory page through which a server publishes its counters.
+ *
+ * @details
+ * Created by a server started with `-m` as `/minitalk-stats.<pid>` and
+ * removed when it exits. Monitoring tools map it read-only and copy each
+ * section under its seqlock (see stats_read()), so reading never involves
+ * the server.
+ */
+typedef struct s_stats_page
+{
+	char           magic[8];              ///< `MT_STATS_MAGIC`.
+	int32_t        pid;                   ///< PID of the server.
+	uint32_t       lanes;                 ///< `MT_STATS_LANES`.
+	int64_t        started;               ///< Start, seconds since the Epoch.
+	t_stats_output output;                ///< Output queue.
+	t_stats_lane   lane[MT_STATS_LANES];  ///< Main thread, then workers.
+} t_stats_page;
+
+/**
+ * @typedef t_stats_view
+ * @brief Consistent copy of a stats page, summed over its lanes.
+ */
+typedef struct s_stats_view
+{
+	t_stats_lane   total;    ///< Sums of the lanes; `clients` unused.
+	t_stats_output output;   ///< Output queue.
+	size_t         nclients; ///< Entries used in `clients`.
+	t_stats_client clients[MT_STATS_LANES * MT_STATS_CLIENTS]; ///< All lanes.
+} t_stats_view;
+
+void  validate_input_server(int argc, char** argv, t_server_config* cfg);
 void  display_information_server(pid_t pid);
 void  validate_input_client(int argc);
 pid_t get_server_pid_from_input(char** argv);
+void  pid_file_write(const char* path, pid_t pid);
+pid_t pid_file_read(const char* path);
+
+void          setup_ack_signal(void);
+t_send_status send_message(pid_t* pid, const char* msg);
+t_send_status transport_select(pid_t* pid, bool probe);
+const char*   transport_name(t_transport t);
+const t_link* transport_link(void);
 
 void sys_error(char* error_message);
+void cpu_relax(void);
+
+void encoder_init(t_encoder* enc, const char* msg);
+void encoder_init_len(t_encoder* enc, const char* buf, size_t len);
+int  encoder_next_signal(t_encoder* enc);
+void decoder_init(t_decoder* dec);
+int  decoder_feed(t_decoder* dec, int sig);
+
+size_t  codec_compress(t_codec codec, const char* in, size_t len, char* out);
+size_t  codec_bound(size_t len);
+void    codec_header(char* out, t_codec codec, uint32_t len);
+t_codec codec_choose(const char* msg, size_t len, double link_bps);
+void    unpack_init(t_unpack* u);
+int     unpack_feed(t_unpack* u, int c, char* out);
+
+void trace_open(t_trace* trace, const char* path);
+void trace_record(t_trace* trace, int sig, const siginfo_t* info);
+void trace_flush(t_trace* trace);
+bool trace_check_header(int fd);
+
+void       sessions_init(t_sessions* table, int out_fd);
+t_session* session_get(t_sessions* table, pid_t pid, bool create);
+bool       session_feed(t_sessions* table, t_session* s, int sig);
+void       session_flush(t_sessions* table, t_session* s);
+void       session_abort(t_sessions* table, t_session* s, bool notify);
+size_t     sessions_reap(t_sessions* table);
+bool       session_copy(const t_sessions* table, pid_t pid, int frame);
+t_session* session_open(t_sessions* table, pid_t pid, int frame,
+						bool create);
+bool       session_frame(t_sessions* table, t_session* s, int sig, int frame);
+bool       session_serve(t_sessions* table, pid_t pid, int sig, int frame,
+						 bool create);
+
+void shards_start(t_shards* shards, size_t count, t_sessions* table);
+void shards_dispatch(t_shards* shards, pid_t pid, int sig, int frame,
+					 bool create);
+void shards_stop(t_shards* shards, t_sessions* table);
+void shards_report(const t_shards* shards);
+
+t_stats_page*       stats_open(void);
+void                stats_close(t_stats_page* page);
+void                stats_signal(t_sessions* table, long start_ns);
+void                stats_publish(t_sessions* table);
+void                stats_flush(t_sessions* table, pid_t pid, size_t len);
+void                stats_message(t_sessions* table, const t_session* s);
+void                stats_output(t_stats_output* out, t_writer* w);
+const t_stats_page* stats_attach(pid_t pid);
+bool                stats_read(const t_stats_page* page, t_stats_view* view);
+long                stats_now_ns(void);
+
+void handoff_drain(t_sessions* table);
+bool handoff_send(t_sessions* table, pid_t new_pid);
+void handoff_receive(t_sessions* table, pid_t old_pid);
+
+void        sink_open(t_sink* s, int fd, unsigned flags);
+void        sink_start(t_sink* s, struct iovec* iov, int cnt);
+bool        sink_poll(t_sink* s);
+void        sink_finish(t_sink* s);
+void        sink_writev(t_sink* s, struct iovec* iov, int cnt);
+const char* sink_backend(const t_sink* s);
+void        sink_close(t_sink* s);
+
+void        region_map(t_region* r, size_t size, bool huge);
+const char* region_pages(const t_region* r);
+void        region_unmap(t_region* r);
+
+void writer_start(t_writer* w, int out_fd, size_t depth,
+				  t_writer_policy policy, unsigned flags);
+void writer_push(t_writer* w, const char* buf, size_t len);
+bool writer_idle(t_writer* w);
+void writer_sync(t_writer* w);
+void writer_stop(t_writer* w);
+
+void   pool_start(t_pool* pool, size_t threads, t_writer* writer,
+				  t_task_fn fn);
+void   pool_submit(t_pool* pool, pid_t pid, t_task_kind kind, const char* buf,
+				   size_t len);
+void   pool_sync(t_pool* pool);
+void   pool_stop(t_pool* pool);
+size_t task_escape(const char* in, size_t len, char* out);
+
+void   metrics_start(t_metrics* m, long interval_ms, t_writer* writer);
+size_t metrics_ingest(t_metrics* m, char* buf, size_t len, size_t* out_len);
+void   metrics_stop(t_metrics* m);
+
+size_t      json_index(const char* buf, size_t len, uint32_t* idx,
+					   uint64_t* tape);
+const char* json_backend(void);
+void        tapes_start(t_tapes* t, const char* path);
+void        tapes_submit(t_tapes* t, t_pool* pool, const t_session* s);
+void        tapes_index(t_tapes* t, pid_t pid, const char* buf, size_t len);
+void        tapes_stop(t_tapes* t);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,812 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   aggregator.c                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 21:42:07 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 21:42:07 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file aggregator.c
+ * @brief Funnels messages from local producers into batched transfers.
+ *
+ * @details
+ * The aggregator is a long-running client. Producers connect to its UNIX
+ * stream socket, write one message and shut down their side of the
+ * connection; the aggregator then holds the message in the current batch.
+ * Messages of a batch are joined with newlines and sent to the server as a
+ * single message, so the per-message costs of the protocol (session setup,
+ * window growth, the terminating null byte) are paid once per batch
+ * instead of once per producer, and the server needs no change.
+ *
+ * A batch is sent when it reaches the byte limit or when its oldest
+ * message has waited for the linger time, whichever comes first. Each
+ * producer of the batch is then answered `OK` and disconnected. A server
+ * redirect during a transfer is kept for the following batches.
+ *
+ * With a spool file, batches the server refuses or cannot receive because
+ * it is gone are appended to the spool instead, and their producers are
+ * answered `SPOOLED` once the data is on disk. While the spool holds
+ * anything, new batches go behind it so that order is kept, and the spool
+ * is drained in batches of up to the byte limit as soon as the server
+ * accepts them again; the server is probed with a growing, jittered delay
+ * meanwhile. Without a spool, an undeliverable batch ends the aggregator.
+ *
+ * With `-P`, the PID of the server is read from the file a server started
+ * with `-i` publishes it in, and read again before each probe, so that
+ * the spool reaches a server restarted under a new PID.
+ *
+ * With `-T` the transport is chosen by a probe at startup, unless one was
+ * chosen on this host recently (see transport_select()).
+ *
+ * Usage: ./aggregator [-s socket] [-b bytes] [-l linger_ms] [-f spool]
+ *        [-T] <PID | -P pid_file>
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup client
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Producers connected at once; further ones wait in the listen backlog. */
+#define MT_MAX_PRODUCERS 64
+
+/** Default socket path of the aggregator. */
+#define MT_AGG_SOCKET "/tmp/minitalk.sock"
+
+/** First delay before probing a server that is unavailable, in ms. */
+#define MT_SPOOL_RETRY_MIN_MS 100
+/** Longest delay between two probes, in ms. */
+#define MT_SPOOL_RETRY_MAX_MS 5000
+
+/**
+ * @typedef t_producer
+ * @brief One connected producer and the message it is sending.
+ *
+ * @details
+ * A slot is free while `fd` is -1. Once the producer has shut down its
+ * side, `batched` is set and the slot waits for its batch to be sent
+ * before being answered and released.
+ */
+typedef struct s_producer
+{
+	int    fd;      ///< Connection, or -1 for a free slot.
+	char*  buf;     ///< Message received so far.
+	size_t len;     ///< Bytes received.
+	size_t cap;     ///< Allocated size of `buf`.
+	bool   batched; ///< Message complete and part of the current batch.
+} t_producer;
+
+/**
+ * @typedef t_aggregator
+ * @brief State of the aggregator.
+ */
+typedef struct s_aggregator
+{
+	pid_t         pid;                        ///< Server, updated on redirect.
+	const char*   pid_path;                   ///< Server's PID file, or NULL.
+	int           listen_fd;                  ///< Listening socket.
+	size_t        limit;                      ///< Batch size forcing a send.
+	long          linger_ms;                  ///< Longest a message waits.
+	char*         batch;                      ///< Messages joined by newlines.
+	size_t        len;                        ///< Bytes in `batch`.
+	size_t        cap;                        ///< Allocated size of `batch`.
+	long          first_ms;                   ///< When the oldest one arrived.
+	unsigned long messages;                   ///< Messages sent.
+	unsigned long batches;                    ///< Batches sent.
+	size_t        bytes;                      ///< Bytes sent, with separators.
+	const char*   spool_path;                 ///< Spool file, or NULL.
+	int           spool_fd;                   ///< Spool, or -1 without one.
+	off_t         spool_off;                  ///< First byte not delivered.
+	off_t         spool_end;                  ///< Size of the spool.
+	char*         drain;                      ///< Batch read from the spool.
+	size_t        drain_cap;                  ///< Allocated size of `drain`.
+	long          retry_ms;                   ///< Next attempt to drain.
+	long          backoff_ms;                 ///< Current delay between them.
+	unsigned long spooled;                    ///< Messages spooled.
+	bool          tune;                       ///< Probe the transports first.
+	t_producer    producers[MT_MAX_PRODUCERS]; ///< Producer slots.
+} t_aggregator;
+
+/** Set by SIGINT and SIGTERM to send what is pending and exit. */
+static volatile sig_atomic_t g_stop = 0;
+
+/** Path of the socket, removed at exit. */
+static const char* g_socket_path = MT_AGG_SOCKET;
+
+/**
+ * @brief Asks the main loop to stop.
+ *
+ * @param sig Unused.
+ *
+ * @ingroup client
+ */
+static void stop_handler(int sig)
+{
+	(void) sig;
+	g_stop = 1;
+}
+
+/**
+ * @brief Removes the socket file.
+ *
+ * @ingroup client
+ */
+static void remove_socket(void)
+{
+	unlink(g_socket_path);
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in milliseconds.
+ *
+ * @ingroup client
+ */
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
+
+/**
+ * @brief Returns the milliseconds left until a deadline, or 0 if it passed.
+ *
+ * @param deadline_ms The deadline, in `now_ms()` time.
+ *
+ * @ingroup client
+ */
+static long ms_until(long deadline_ms)
+{
+	long left;
+
+	left = deadline_ms - now_ms();
+	if (left < 0)
+		return (0);
+	return (left);
+}
+
+/**
+ * @brief Grows a buffer so that it can hold `need` bytes.
+ *
+ * @param buf The buffer; may be NULL.
+ * @param cap Its allocated size; updated.
+ * @param need Bytes needed.
+ * @return The buffer, possibly moved.
+ *
+ * @note Exits with an error message using `sys_error()` if allocating
+ * fails.
+ *
+ * @ingroup client
+ */
+static char* reserve(char* buf, size_t* cap, size_t need)
+{
+	if (need <= *cap && buf)
+		return (buf);
+	if (*cap == 0)
+		*cap = 4096;
+	while (*cap < need)
+		*cap *= 2;
+	buf = realloc(buf, *cap);
+	if (!buf)
+		sys_error("Aggregator: malloc failed");
+	return (buf);
+}
+
+/**
+ * @brief Creates and binds the listening socket.
+ *
+ * @details
+ * A stale socket file left by a previous run is replaced.
+ *
+ * @param path Path of the socket.
+ * @return The listening descriptor.
+ *
+ * @note Exits with an error message using `sys_error()` on failure.
+ *
+ * @ingroup client
+ */
+static int open_socket(const char* path)
+{
+	struct sockaddr_un addr;
+	int                fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Error: socket path too long.\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		sys_error("Aggregator: cannot create the socket");
+	unlink(path);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1
+		|| listen(fd, SOMAXCONN) == -1)
+		sys_error("Aggregator: cannot listen on the socket");
+	atexit(remove_socket);
+	return (fd);
+}
+
+/**
+ * @brief Opens the spool, keeping what a previous run left in it.
+ *
+ * @details
+ * Records in the spool are messages terminated by a null byte. A record
+ * cut short by a crash is removed: its producer was never answered, so it
+ * still has the message.
+ *
+ * @param ag The aggregator, whose `spool_path` is set.
+ *
+ * @note Exits with an error message using `sys_error()` on failure.
+ *
+ * @ingroup client
+ */
+static void spool_open(t_aggregator* ag)
+{
+	char    tail[4096];
+	off_t   end;
+	ssize_t n;
+
+	ag->spool_fd = open(ag->spool_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+						0600);
+	if (ag->spool_fd == -1)
+		sys_error("Aggregator: cannot open the spool");
+	end = lseek(ag->spool_fd, 0, SEEK_END);
+	while (end > 0)
+	{
+		n = sizeof(tail);
+		if (end < n)
+			n = end;
+		if (pread(ag->spool_fd, tail, n, end - n) != n)
+			sys_error("Aggregator: cannot read the spool");
+		if (memrchr(tail, '\0', n))
+		{
+			end -= n - ((char*) memrchr(tail, '\0', n) - tail + 1);
+			break;
+		}
+		end -= n;
+	}
+	if (ftruncate(ag->spool_fd, end) == -1)
+		sys_error("Aggregator: cannot trim the spool");
+	ag->spool_end = end;
+	if (end > 0)
+		fprintf(stderr, "Aggregator: %lld spooled byte(s) to deliver\n",
+				(long long) end);
+}
+
+/**
+ * @brief Tells whether the spool holds messages not yet delivered.
+ *
+ * @ingroup client
+ */
+static bool spool_pending(const t_aggregator* ag)
+{
+	return (ag->spool_fd != -1 && ag->spool_off < ag->spool_end);
+}
+
+/**
+ * @brief Appends a batch to the spool as one record and syncs it.
+ *
+ * @param ag The aggregator.
+ * @param buf The batch, without its null byte.
+ * @param len Length of the batch.
+ *
+ * @note Exits with an error message using `sys_error()` on failure.
+ *
+ * @ingroup client
+ */
+static void spool_append(t_aggregator* ag, const char* buf, size_t len)
+{
+	struct iovec iov[2];
+
+	iov[0] = (struct iovec){(void*) buf, len};
+	iov[1] = (struct iovec){"", 1};
+	if (writev(ag->spool_fd, iov, 2) != (ssize_t) len + 1
+		|| fdatasync(ag->spool_fd) == -1)
+		sys_error("Aggregator: cannot write the spool");
+	ag->spool_end += len + 1;
+}
+
+/**
+ * @brief Drops the delivered part of the spool before exiting.
+ *
+ * @details
+ * The rest is copied to a new file that then replaces the spool, so that
+ * a later run does not deliver those messages twice.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void spool_close(t_aggregator* ag)
+{
+	char    tmp[4096];
+	char    buf[65536];
+	off_t   off;
+	ssize_t n;
+	int     fd;
+
+	if (ag->spool_fd == -1)
+		return;
+	if (!spool_pending(ag) && ftruncate(ag->spool_fd, 0) == -1)
+		sys_error("Aggregator: cannot trim the spool");
+	if (spool_pending(ag) && ag->spool_off > 0)
+	{
+		snprintf(tmp, sizeof(tmp), "%s.tmp", ag->spool_path);
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd == -1)
+			sys_error("Aggregator: cannot rewrite the spool");
+		off = ag->spool_off;
+		while ((n = pread(ag->spool_fd, buf, sizeof(buf), off)) > 0)
+		{
+			if (write(fd, buf, n) != n)
+				sys_error("Aggregator: cannot rewrite the spool");
+			off += n;
+		}
+		if (n == -1 || fdatasync(fd) == -1 || rename(tmp, ag->spool_path) == -1)
+			sys_error("Aggregator: cannot rewrite the spool");
+		close(fd);
+	}
+	close(ag->spool_fd);
+}
+
+/**
+ * @brief Delays the next attempt to reach the server.
+ *
+ * @details
+ * The delay doubles on each failure, up to `MT_SPOOL_RETRY_MAX_MS`, and
+ * gets up to half of it again at random, so that aggregators that lost
+ * the same server do not all come back at the same instant.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void spool_backoff(t_aggregator* ag)
+{
+	if (ag->backoff_ms == 0)
+		fprintf(stderr, "Aggregator: server %d unavailable, spooling to %s\n",
+				(int) ag->pid, ag->spool_path);
+	ag->backoff_ms *= 2;
+	if (ag->backoff_ms < MT_SPOOL_RETRY_MIN_MS)
+		ag->backoff_ms = MT_SPOOL_RETRY_MIN_MS;
+	if (ag->backoff_ms > MT_SPOOL_RETRY_MAX_MS)
+		ag->backoff_ms = MT_SPOOL_RETRY_MAX_MS;
+	ag->retry_ms = now_ms() + ag->backoff_ms;
+	ag->retry_ms += rand() % (ag->backoff_ms / 2 + 1);
+}
+
+/**
+ * @brief Sends one batch to the server.
+ *
+ * @param ag The aggregator.
+ * @param buf The batch, null-terminated.
+ * @param len Length of the batch.
+ * @return true if the server acknowledged it, false if it must be spooled.
+ *
+ * @note Without a spool, an undeliverable batch ends the program with an
+ * error message.
+ *
+ * @ingroup client
+ */
+static bool deliver(t_aggregator* ag, const char* buf, size_t len)
+{
+	t_send_status status;
+
+	status = send_message(&ag->pid, buf);
+	if (status == MT_SEND_OK)
+	{
+		if (ag->backoff_ms != 0)
+			fprintf(stderr, "Aggregator: server %d back\n", (int) ag->pid);
+		ag->backoff_ms = 0;
+		ag->batches++;
+		ag->bytes += len;
+		return (true);
+	}
+	if (ag->spool_fd == -1)
+	{
+		fprintf(stderr, "Error: server unavailable, batch not delivered.\n");
+		exit(EXIT_FAILURE);
+	}
+	spool_backoff(ag);
+	return (false);
+}
+
+/**
+ * @brief Sends the oldest spooled messages as one batch.
+ *
+ * @details
+ * Reads whole records up to the byte limit (or the first record, if it is
+ * longer) and joins them with newlines by turning their null bytes into
+ * newlines, except the last one. With a PID file, the server it names
+ * replaces the current one first. The server is only tried if its process
+ * still exists.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void spool_drain(t_aggregator* ag)
+{
+	char*  last;
+	size_t size;
+	size_t i;
+	pid_t  pid;
+
+	pid = 0;
+	if (ag->pid_path)
+		pid = pid_file_read(ag->pid_path);
+	if (pid > 0 && pid != ag->pid)
+	{
+		fprintf(stderr, "Aggregator: server is now PID %d\n", (int) pid);
+		ag->pid = pid;
+	}
+	if (kill(ag->pid, 0) == -1 && errno == ESRCH)
+	{
+		spool_backoff(ag);
+		return;
+	}
+	size = ag->spool_end - ag->spool_off;
+	if (size > ag->limit + 1)
+		size = ag->limit + 1;
+	last = NULL;
+	while (!last)
+	{
+		ag->drain = reserve(ag->drain, &ag->drain_cap, size);
+		if (pread(ag->spool_fd, ag->drain, size, ag->spool_off)
+			!= (ssize_t) size)
+			sys_error("Aggregator: cannot read the spool");
+		last = memrchr(ag->drain, '\0', size);
+		size = ag->spool_end - ag->spool_off;
+	}
+	i = 0;
+	while (ag->drain + i < last)
+	{
+		if (ag->drain[i] == '\0')
+			ag->drain[i] = '\n';
+		i++;
+	}
+	if (deliver(ag, ag->drain, i))
+		ag->spool_off += i + 1;
+	if (ag->spool_off == ag->spool_end)
+	{
+		if (ftruncate(ag->spool_fd, 0) == -1)
+			sys_error("Aggregator: cannot trim the spool");
+		ag->spool_off = 0;
+		ag->spool_end = 0;
+	}
+}
+
+/**
+ * @brief Sends the current batch and answers its producers.
+ *
+ * @details
+ * Producers are answered only once the server acknowledged the whole
+ * batch, so an `OK` means the message was delivered; with a spool, it may
+ * be `SPOOLED` instead, once the batch is safely on disk. A batch goes to
+ * the spool directly while older messages wait there. A producer that
+ * went away in the meantime is simply released.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void flush_batch(t_aggregator* ag)
+{
+	t_producer* p;
+	const char* reply;
+	size_t      i;
+
+	if (ag->len == 0)
+		return;
+	ag->batch[ag->len] = '\0';
+	reply              = "OK\n";
+	if (spool_pending(ag) || !deliver(ag, ag->batch, ag->len))
+	{
+		spool_append(ag, ag->batch, ag->len);
+		reply = "SPOOLED\n";
+	}
+	ag->len = 0;
+	i       = 0;
+	while (i < MT_MAX_PRODUCERS)
+	{
+		p = &ag->producers[i++];
+		if (p->fd == -1 || !p->batched)
+			continue;
+		send(p->fd, reply, strlen(reply), MSG_NOSIGNAL);
+		close(p->fd);
+		p->fd      = -1;
+		p->len     = 0;
+		p->batched = false;
+		if (reply[0] == 'O')
+			ag->messages++;
+		else
+			ag->spooled++;
+	}
+}
+
+/**
+ * @brief Moves the message of a producer that finished into the batch.
+ *
+ * @details
+ * The message ends at its first null byte, if any, as the protocol cannot
+ * carry one. When it would push the batch past the limit, the batch is
+ * sent first; a message larger than the limit goes alone.
+ *
+ * @param ag The aggregator.
+ * @param p The producer.
+ *
+ * @ingroup client
+ */
+static void batch_add(t_aggregator* ag, t_producer* p)
+{
+	size_t len;
+
+	len = strnlen(p->buf, p->len);
+	if (ag->len > 0 && ag->len + 1 + len > ag->limit)
+		flush_batch(ag);
+	ag->batch = reserve(ag->batch, &ag->cap, ag->len + len + 2);
+	if (ag->len == 0)
+		ag->first_ms = now_ms();
+	else
+		ag->batch[ag->len++] = '\n';
+	memcpy(ag->batch + ag->len, p->buf, len);
+	ag->len += len;
+	p->batched = true;
+	if (ag->len >= ag->limit)
+		flush_batch(ag);
+}
+
+/**
+ * @brief Reads what a producer sent.
+ *
+ * @details
+ * End of file completes the message; a read error drops the producer and
+ * whatever it had sent.
+ *
+ * @param ag The aggregator.
+ * @param p The producer, whose descriptor is readable.
+ *
+ * @ingroup client
+ */
+static void producer_read(t_aggregator* ag, t_producer* p)
+{
+	ssize_t n;
+
+	p->buf = reserve(p->buf, &p->cap, p->len + 4096);
+	n      = read(p->fd, p->buf + p->len, p->cap - p->len);
+	if (n == -1 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n > 0)
+	{
+		p->len += n;
+		return;
+	}
+	if (n == 0)
+	{
+		batch_add(ag, p);
+		return;
+	}
+	close(p->fd);
+	p->fd  = -1;
+	p->len = 0;
+}
+
+/**
+ * @brief Accepts a new producer into a free slot.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void producer_accept(t_aggregator* ag)
+{
+	size_t i;
+	int    fd;
+
+	fd = accept4(ag->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd == -1)
+		return;
+	i = 0;
+	while (i < MT_MAX_PRODUCERS && ag->producers[i].fd != -1)
+		i++;
+	if (i == MT_MAX_PRODUCERS)
+	{
+		close(fd);
+		return;
+	}
+	ag->producers[i].fd      = fd;
+	ag->producers[i].len     = 0;
+	ag->producers[i].batched = false;
+}
+
+/**
+ * @brief Waits for producers and sends batches until asked to stop.
+ *
+ * @details
+ * The listening socket is only watched while a slot is free, so extra
+ * producers wait in the kernel backlog. The poll timeout is the time left
+ * before the current batch must go or the spool may be drained, whichever
+ * comes first.
+ *
+ * @param ag The aggregator.
+ *
+ * @ingroup client
+ */
+static void aggregate(t_aggregator* ag)
+{
+	struct pollfd fds[MT_MAX_PRODUCERS + 1];
+	t_producer*   slot[MT_MAX_PRODUCERS + 1];
+	nfds_t        n;
+	size_t        i;
+	bool          full;
+	long          timeout;
+
+	while (!g_stop)
+	{
+		n    = 0;
+		i    = 0;
+		full = true;
+		while (i < MT_MAX_PRODUCERS)
+		{
+			if (ag->producers[i].fd == -1)
+				full = false;
+			else if (!ag->producers[i].batched)
+			{
+				slot[n]  = &ag->producers[i];
+				fds[n++] = (struct pollfd){ag->producers[i].fd, POLLIN, 0};
+			}
+			i++;
+		}
+		if (!full)
+			fds[n++] = (struct pollfd){ag->listen_fd, POLLIN, 0};
+		timeout = -1;
+		if (ag->len > 0)
+			timeout = ms_until(ag->first_ms + ag->linger_ms);
+		if (spool_pending(ag)
+			&& (timeout == -1 || ms_until(ag->retry_ms) < timeout))
+			timeout = ms_until(ag->retry_ms);
+		if (poll(fds, n, timeout) == -1 && errno != EINTR)
+			sys_error("Aggregator: poll failed");
+		i = 0;
+		while (i < n)
+		{
+			if (fds[i].fd == ag->listen_fd && (fds[i].revents & POLLIN))
+				producer_accept(ag);
+			else if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				producer_read(ag, slot[i]);
+			i++;
+		}
+		if (ag->len > 0 && now_ms() - ag->first_ms >= ag->linger_ms)
+			flush_batch(ag);
+		if (spool_pending(ag) && now_ms() >= ag->retry_ms)
+			spool_drain(ag);
+	}
+	flush_batch(ag);
+}
+
+/**
+ * @brief Parses the command line into the aggregator state.
+ *
+ * @param ag The aggregator to fill in.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ *
+ * @note Exits with a usage message on invalid arguments.
+ *
+ * @ingroup client
+ */
+static void parse_options(t_aggregator* ag, int argc, char** argv)
+{
+	int opt;
+
+	ag->limit     = 64 * 1024;
+	ag->linger_ms = 5;
+	while ((opt = getopt(argc, argv, "s:b:l:f:TP:")) != -1)
+	{
+		if (opt == 's')
+			g_socket_path = optarg;
+		else if (opt == 'b')
+			ag->limit = strtoul(optarg, NULL, 10);
+		else if (opt == 'l')
+			ag->linger_ms = atol(optarg);
+		else if (opt == 'f')
+			ag->spool_path = optarg;
+		else if (opt == 'T')
+			ag->tune = true;
+		else if (opt == 'P')
+			ag->pid_path = optarg;
+		else
+			break;
+	}
+	if (opt != -1 || optind != argc - !ag->pid_path || ag->limit == 0
+		|| ag->linger_ms < 0)
+	{
+		fprintf(stderr, "Usage: ./aggregator [-s socket] [-b bytes] "
+						"[-l linger_ms] [-f spool] [-T] "
+						"<PID | -P pid_file>\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!ag->pid_path)
+		ag->pid = get_server_pid_from_input(argv + optind - 1);
+	else
+		ag->pid = pid_file_read(ag->pid_path);
+	if (ag->pid == 0)
+	{
+		fprintf(stderr, "Error: no server PID in %s.\n", ag->pid_path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * @brief Entry point of the aggregator.
+ *
+ * Listens for producers, sends their messages to the server in batches
+ * and, on SIGINT or SIGTERM, sends or spools the last batch, keeps what is
+ * left in the spool for the next run and prints its counters.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS once stopped.
+ *
+ * @ingroup client
+ */
+int main(int argc, char** argv)
+{
+	static t_aggregator ag;
+	struct sigaction    sa;
+	const t_link*       link;
+	size_t              i;
+
+	parse_options(&ag, argc, argv);
+	i = 0;
+	while (i < MT_MAX_PRODUCERS)
+		ag.producers[i++].fd = -1;
+	sa.sa_handler = stop_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if (sigaction(SIGINT, &sa, NULL) == -1
+		|| sigaction(SIGTERM, &sa, NULL) == -1)
+		sys_error("Aggregator: sigaction failed");
+	setup_ack_signal();
+	srand(getpid());
+	ag.spool_fd = -1;
+	if (ag.spool_path)
+		spool_open(&ag);
+	transport_select(&ag.pid, ag.tune);
+	link         = transport_link();
+	ag.listen_fd = open_socket(g_socket_path);
+	fprintf(stderr, "Aggregator: listening on %s for PID %d, %s transport\n",
+			g_socket_path, (int) ag.pid, transport_name(link->transport));
+	aggregate(&ag);
+	spool_close(&ag);
+	fprintf(stderr, "messages:          %lu\n", ag.messages);
+	fprintf(stderr, "batches:           %lu\n", ag.batches);
+	fprintf(stderr, "bytes:             %zu\n", ag.bytes);
+	fprintf(stderr, "wire_bytes:        %zu\n", link->wire);
+	fprintf(stderr, "codecs:            none %lu, fast %lu, strong %lu\n",
+			link->codec[MT_CODEC_NONE], link->codec[MT_CODEC_FAST],
+			link->codec[MT_CODEC_STRONG]);
+	fprintf(stderr, "link_Bps:          %.0f\n", link->bytes_per_s);
+	fprintf(stderr, "spooled:           %lu\n", ag.spooled);
+	fprintf(stderr, "spool_left_bytes:  %lld\n",
+			(long long) (ag.spool_end - ag.spool_off));
+	if (ag.batches > 0)
+		fprintf(stderr, "messages_per_batch: %.2f\n",
+				(double) ag.messages / ag.batches);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,435 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   codec.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 22:31:52 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 22:31:52 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file codec.c
+ * @brief Optional compression of messages, chosen per message by cost.
+ *
+ * @details
+ * A packed message starts with `MT_CODEC_MARK`, a byte that never occurs
+ * in UTF-8 text, followed by the codec, the length of the payload on four
+ * bytes (little endian) and the payload itself; the usual terminator
+ * follows. Any other first byte means a plain message, so servers and
+ * clients that do not pack keep working unchanged.
+ *
+ * Both compressing codecs produce the same LZSS format, so a single
+ * decoder serves them: groups of eight items, each group led by a byte
+ * whose bits (lowest first) tell a literal byte (0) from a two-byte match
+ * (1) of 3 to 18 bytes, up to `MT_LZ_WINDOW` bytes back. `MT_CODEC_FAST`
+ * looks at one earlier position per byte, `MT_CODEC_STRONG` at up to
+ * `MT_LZ_CHAIN` of them.
+ *
+ * The decoder is fed one byte at a time and keeps its state and window in
+ * a `t_unpack`, so the server runs it from its signal handler.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup protocol
+ */
+#include "minitalk.h"
+
+/** Bits of the hash of three bytes used to find matches. */
+#define MT_LZ_HASH_BITS 12
+/** Shortest match worth encoding. */
+#define MT_LZ_MIN_MATCH 3
+/** Longest match a two-byte item can encode. */
+#define MT_LZ_MAX_MATCH 18
+
+/**
+ * @internal
+ * @brief Match finder state of the compressor.
+ */
+typedef struct s_lz_index
+{
+	int32_t head[1 << MT_LZ_HASH_BITS]; ///< Last position of each hash.
+	int32_t prev[MT_LZ_WINDOW];         ///< Previous position, same hash.
+} t_lz_index;
+
+/**
+ * @brief Hashes the three bytes at a position.
+ *
+ * @ingroup protocol
+ */
+static unsigned lz_hash(const unsigned char* p)
+{
+	return (((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u)
+			>> (32 - MT_LZ_HASH_BITS));
+}
+
+/**
+ * @brief Finds the longest earlier match for the bytes at `pos`.
+ *
+ * @param ix The match finder, which `pos` is then added to.
+ * @param in The input.
+ * @param pos Position to match.
+ * @param len Length of the input.
+ * @param chain Most earlier positions to try.
+ * @param off Receives the distance of the match.
+ * @return Length of the match, 0 if none is long enough.
+ *
+ * @ingroup protocol
+ */
+static size_t lz_match(t_lz_index* ix, const unsigned char* in, size_t pos,
+					   size_t len, int chain, size_t* off)
+{
+	size_t   best;
+	size_t   max;
+	size_t   n;
+	int32_t  cand;
+	unsigned h;
+
+	best = 0;
+	*off = 0;
+	if (len - pos < MT_LZ_MIN_MATCH)
+		return (0);
+	max = len - pos;
+	if (max > MT_LZ_MAX_MATCH)
+		max = MT_LZ_MAX_MATCH;
+	h    = lz_hash(in + pos);
+	cand = ix->head[h];
+	while (chain-- > 0 && cand >= 0 && pos - cand <= MT_LZ_WINDOW)
+	{
+		n = 0;
+		while (n < max && in[cand + n] == in[pos + n])
+			n++;
+		if (n > best)
+		{
+			best = n;
+			*off = pos - cand;
+		}
+		if (best == max)
+			break;
+		cand = ix->prev[cand % MT_LZ_WINDOW];
+	}
+	ix->prev[pos % MT_LZ_WINDOW] = ix->head[h];
+	ix->head[h]                  = pos;
+	if (best < MT_LZ_MIN_MATCH)
+		return (0);
+	return (best);
+}
+
+/**
+ * @brief Adds the positions covered by a match to the match finder.
+ *
+ * @ingroup protocol
+ */
+static void lz_skip(t_lz_index* ix, const unsigned char* in, size_t pos,
+					size_t n, size_t len)
+{
+	unsigned h;
+
+	while (n-- > 0 && len - pos >= MT_LZ_MIN_MATCH)
+	{
+		h                            = lz_hash(in + pos);
+		ix->prev[pos % MT_LZ_WINDOW] = ix->head[h];
+		ix->head[h]                  = pos++;
+	}
+}
+
+/**
+ * @brief Compresses a buffer with the given codec.
+ *
+ * @param codec `MT_CODEC_NONE` (a copy), `MT_CODEC_FAST` or
+ * `MT_CODEC_STRONG`.
+ * @param in The input.
+ * @param len Its length.
+ * @param out Buffer of at least `codec_bound(len)` bytes.
+ * @return Length of the output.
+ *
+ * @ingroup protocol
+ */
+size_t codec_compress(t_codec codec, const char* in, size_t len, char* out)
+{
+	static t_lz_index    ix;
+	const unsigned char* src;
+	unsigned char*       dst;
+	size_t               ctrl;
+	size_t               pos;
+	size_t               o;
+	size_t               n;
+	size_t               off;
+	int                  chain;
+	int                  item;
+
+	if (codec == MT_CODEC_NONE)
+	{
+		memcpy(out, in, len);
+		return (len);
+	}
+	memset(ix.head, 0xff, sizeof(ix.head));
+	chain = 1;
+	if (codec == MT_CODEC_STRONG)
+		chain = MT_LZ_CHAIN;
+	src  = (const unsigned char*) in;
+	dst  = (unsigned char*) out;
+	o    = 0;
+	pos  = 0;
+	item = 8;
+	ctrl = 0;
+	while (pos < len)
+	{
+		if (item == 8)
+		{
+			ctrl      = o++;
+			dst[ctrl] = 0;
+			item      = 0;
+		}
+		n = lz_match(&ix, src, pos, len, chain, &off);
+		if (n == 0)
+			dst[o++] = src[pos++];
+		else
+		{
+			dst[ctrl] |= 1u << item;
+			dst[o++] = (off - 1) & 0xff;
+			dst[o++] = ((off - 1) >> 8) << 4 | (n - MT_LZ_MIN_MATCH);
+			lz_skip(&ix, src, pos + 1, n - 1, len);
+			pos += n;
+		}
+		item++;
+	}
+	return (o);
+}
+
+/**
+ * @brief Largest output codec_compress() may produce for `len` bytes.
+ *
+ * @ingroup protocol
+ */
+size_t codec_bound(size_t len)
+{
+	return (len + len / 8 + 1);
+}
+
+/**
+ * @brief Writes the header of a packed message.
+ *
+ * @param out Buffer of at least `MT_CODEC_HEADER` bytes.
+ * @param codec The codec of the payload.
+ * @param len Length of the payload.
+ *
+ * @ingroup protocol
+ */
+void codec_header(char* out, t_codec codec, uint32_t len)
+{
+	out[0] = (char) MT_CODEC_MARK;
+	out[1] = (char) codec;
+	out[2] = (char) (len & 0xff);
+	out[3] = (char) (len >> 8 & 0xff);
+	out[4] = (char) (len >> 16 & 0xff);
+	out[5] = (char) (len >> 24 & 0xff);
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in nanoseconds.
+ *
+ * @ingroup protocol
+ */
+static double codec_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/**
+ * @brief Chooses the codec that gets a message across the soonest.
+ *
+ * @details
+ * Each compressing codec is timed on the first `MT_CODEC_SAMPLE` bytes of
+ * the message, which gives its speed and ratio. The time to compress the
+ * whole message, then send its packed form at `link_bps`, is compared
+ * with the time to send it as it is; the shortest wins. A fast link thus
+ * gets plain messages and a slow one gets the codec whose extra CPU time
+ * pays for itself in bytes saved.
+ *
+ * @param msg The message.
+ * @param len Its length.
+ * @param link_bps Measured rate of the transport, in bytes per second.
+ * @return The codec to use.
+ *
+ * @ingroup protocol
+ */
+t_codec codec_choose(const char* msg, size_t len, double link_bps)
+{
+	static char out[MT_CODEC_SAMPLE + MT_CODEC_SAMPLE / 8 + 1];
+	t_codec     best;
+	t_codec     codec;
+	double      best_s;
+	double      est_s;
+	double      start;
+	double      cpu_ns;
+	size_t      sample;
+	size_t      packed;
+
+	best   = MT_CODEC_NONE;
+	best_s = len / link_bps;
+	if (len < MT_CODEC_MIN)
+		return (best);
+	sample = len;
+	if (sample > MT_CODEC_SAMPLE)
+		sample = MT_CODEC_SAMPLE;
+	codec = MT_CODEC_FAST;
+	while (codec <= MT_CODEC_STRONG)
+	{
+		start  = codec_now_ns();
+		packed = codec_compress(codec, msg, sample, out);
+		cpu_ns = codec_now_ns() - start;
+		est_s  = cpu_ns * 1e-9 * len / sample
+				+ ((double) packed * len / sample + MT_CODEC_HEADER) / link_bps;
+		if (est_s < best_s)
+		{
+			best   = codec;
+			best_s = est_s;
+		}
+		codec++;
+	}
+	return (best);
+}
+
+/**
+ * @brief Prepares a decoder for the start of a message.
+ *
+ * @param u The decoder.
+ *
+ * @ingroup protocol
+ */
+void unpack_init(t_unpack* u)
+{
+	u->state  = MT_UNPACK_START;
+	u->codec  = MT_CODEC_NONE;
+	u->hdr    = 0;
+	u->nflags = 0;
+	u->hi     = -1;
+	u->pos    = 0;
+	u->filled = 0;
+	u->remain = 0;
+}
+
+/**
+ * @brief Appends a decoded byte to the output and to the window.
+ *
+ * @ingroup protocol
+ */
+static int unpack_put(t_unpack* u, char c, char* out, int n)
+{
+	u->hist[u->pos] = c;
+	u->pos          = (u->pos + 1) % MT_LZ_WINDOW;
+	if (u->filled < MT_LZ_WINDOW)
+		u->filled++;
+	out[n] = c;
+	return (n + 1);
+}
+
+/**
+ * @brief Decodes one byte of an LZSS payload.
+ *
+ * @return Number of bytes decoded, or `MT_UNPACK_CORRUPT` for a match
+ * reaching back further than the bytes decoded so far.
+ *
+ * @ingroup protocol
+ */
+static int unpack_lz(t_unpack* u, unsigned char c, char* out)
+{
+	unsigned off;
+	int      len;
+	int      n;
+
+	if (u->nflags == 0)
+	{
+		u->ctrl   = c;
+		u->nflags = 8;
+		return (0);
+	}
+	if (!(u->ctrl & 1))
+	{
+		u->ctrl >>= 1;
+		u->nflags--;
+		return (unpack_put(u, (char) c, out, 0));
+	}
+	if (u->hi < 0)
+	{
+		u->hi = c;
+		return (0);
+	}
+	off = (u->hi | (c >> 4) << 8) + 1;
+	len = (c & 0x0f) + MT_LZ_MIN_MATCH;
+	if (off > u->filled)
+		return (MT_UNPACK_CORRUPT);
+	n = 0;
+	while (n < len)
+		n = unpack_put(u, u->hist[(u->pos + MT_LZ_WINDOW - off) % MT_LZ_WINDOW],
+					   out, n);
+	u->hi = -1;
+	u->ctrl >>= 1;
+	u->nflags--;
+	return (n);
+}
+
+/**
+ * @brief Feeds one received character into the decoder.
+ *
+ * @details
+ * Plain messages pass through unchanged. For a packed message the header
+ * is read first, then each payload byte yields zero or more decoded bytes;
+ * only the terminator that follows the payload ends the message, since
+ * the payload may contain null bytes. The payload of a transport probe
+ * yields nothing.
+ *
+ * @param u The decoder.
+ * @param c The received character, as returned by decoder_feed().
+ * @param out Buffer of at least `MT_LZ_MAX_OUTPUT` bytes receiving the
+ * decoded bytes.
+ * @return Number of bytes written to `out`, -1 once the message ended, or
+ * `MT_UNPACK_CORRUPT` if the payload refers to bytes it never carried.
+ *
+ * @ingroup protocol
+ */
+int unpack_feed(t_unpack* u, int c, char* out)
+{
+	if (u->state == MT_UNPACK_START && c == MT_CODEC_MARK)
+	{
+		u->state = MT_UNPACK_HEADER;
+		return (0);
+	}
+	if (u->state == MT_UNPACK_START)
+		u->state = MT_UNPACK_PLAIN;
+	if (u->state == MT_UNPACK_PLAIN || u->state == MT_UNPACK_TAIL)
+	{
+		if (c == 0 || u->state == MT_UNPACK_TAIL)
+			return (-1);
+		out[0] = (char) c;
+		return (1);
+	}
+	if (u->state == MT_UNPACK_HEADER)
+	{
+		if (u->hdr == 0)
+			u->codec = c;
+		else
+			u->remain |= (uint32_t) c << (8 * (u->hdr - 1));
+		if (++u->hdr == MT_CODEC_HEADER - 1)
+			u->state = MT_UNPACK_BODY;
+		if (u->state == MT_UNPACK_BODY && u->remain == 0)
+			u->state = MT_UNPACK_TAIL;
+		return (0);
+	}
+	if (--u->remain == 0)
+		u->state = MT_UNPACK_TAIL;
+	if (u->codec == MT_CODEC_PROBE)
+		return (0);
+	if (u->codec == MT_CODEC_NONE)
+	{
+		out[0] = (char) c;
+		return (1);
+	}
+	return (unpack_lz(u, (unsigned char) c, out));
+}
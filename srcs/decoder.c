@@ -0,0 +1,88 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   decoder.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 10:04:37 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 10:04:37 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file decoder.c
+ * @brief Rebuilds characters from the signals received by the server.
+ *
+ * @details
+ * The decoder is the inverse of the encoder: it is fed one signal at a
+ * time and assembles the bits into a character, most significant bit
+ * first. When eight bits have been collected the character is returned
+ * to the caller and the decoder resets itself for the next one.
+ *
+ * It performs no I/O, so it can be driven by the server's signal
+ * handler, by the simulator or by a benchmark loop alike.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup protocol
+ */
+#include "minitalk.h"
+
+/**
+ * @brief Resets a decoder to the start of a character.
+ *
+ * @param dec The decoder to initialise.
+ *
+ * @ingroup protocol
+ */
+void decoder_init(t_decoder* dec)
+{
+	dec->bit = 7;
+	dec->c   = 0;
+}
+
+/**
+ * @brief Processes a single received signal and updates the current character.
+ *
+ * This function modifies the character `c` by setting or clearing a specific
+ * bit depending on the received signal (`SIGUSR1` or `SIGUSR2`). The `bit`
+ * index is decremented after each update to prepare for the next incoming bit.
+ *
+ * @param sig The received signal. `SIGUSR1` represents bit 1, `SIGUSR2` bit 0.
+ * @param bit A pointer to the current bit index (starting from 7 to 0).
+ * @param c A pointer to the character being constructed bit by bit.
+ *
+ * @ingroup protocol
+ */
+static void handle_received_bit(int sig, int* bit, char* c)
+{
+	if (sig == SIGUSR1)
+		*c |= (1 << *bit); // Set bit to 1
+	else
+		*c &= ~(1 << *bit); // Set bit to 0
+	(*bit)--;
+}
+
+/**
+ * @brief Feeds one received signal into the decoder.
+ *
+ * @param dec The decoder accumulating the current character.
+ * @param sig The received signal (`SIGUSR1` for 1, `SIGUSR2` for 0).
+ * @return The completed character as an `unsigned char` value once all
+ * eight bits have arrived (0 marks the end of a message), or -1 while the
+ * character is still incomplete.
+ *
+ * @ingroup protocol
+ */
+int decoder_feed(t_decoder* dec, int sig)
+{
+	unsigned char done;
+
+	handle_received_bit(sig, &dec->bit, &dec->c);
+	if (dec->bit >= 0)
+		return (-1);
+	done = (unsigned char) dec->c;
+	decoder_init(dec);
+	return (done);
+}
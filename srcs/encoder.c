@@ -0,0 +1,99 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   encoder.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 10:02:11 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 10:02:11 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file encoder.c
+ * @brief Turns a message into the sequence of signals sent by the client.
+ *
+ * @details
+ * The encoder walks a null-terminated message one bit at a time, most
+ * significant bit first, and yields the signal that carries each bit
+ * (`SIGUSR1` for 1, `SIGUSR2` for 0). The terminating `'\0'` is encoded
+ * as well, so the server knows where the message ends.
+ *
+ * It holds no transport state, which lets the client, the simulator and
+ * the benchmarks share exactly the same bit stream.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup protocol
+ */
+#include "minitalk.h"
+
+/**
+ * @brief Prepares an encoder to walk a null-terminated message.
+ *
+ * @param enc The encoder to initialise.
+ * @param msg The message to encode; it must outlive the encoder.
+ *
+ * @ingroup protocol
+ */
+void encoder_init(t_encoder* enc, const char* msg)
+{
+	encoder_init_len(enc, msg, strlen(msg));
+}
+
+/**
+ * @brief Prepares an encoder to walk a buffer that may hold null bytes.
+ *
+ * @param enc The encoder to initialise.
+ * @param buf The bytes to encode; they must outlive the encoder.
+ * @param len Their number; the terminator is sent after them.
+ *
+ * @ingroup protocol
+ */
+void encoder_init_len(t_encoder* enc, const char* buf, size_t len)
+{
+	enc->msg  = buf;
+	enc->end  = buf + len;
+	enc->bit  = 7;
+	enc->done = false;
+}
+
+/**
+ * @brief Returns the signal carrying the next bit of the message.
+ *
+ * @details
+ * Bits are produced most significant first. Once the eight bits of the
+ * terminating `'\0'` have been returned, the encoder reports completion
+ * by returning 0 on every subsequent call.
+ *
+ * @param enc The encoder to advance.
+ * @return `SIGUSR1` for a 1 bit, `SIGUSR2` for a 0 bit, or 0 when the
+ * whole message, terminator included, has been produced.
+ *
+ * @ingroup protocol
+ */
+int encoder_next_signal(t_encoder* enc)
+{
+	char c;
+	int  sig;
+
+	if (enc->done)
+		return (0);
+	c = '\0';
+	if (enc->msg < enc->end)
+		c = *enc->msg;
+	if ((c >> enc->bit) & 1)
+		sig = SIGUSR1;
+	else
+		sig = SIGUSR2;
+	if (--enc->bit < 0)
+	{
+		if (enc->msg == enc->end)
+			enc->done = true;
+		else
+			enc->msg++;
+		enc->bit = 7;
+	}
+	return (sig);
+}
@@ -0,0 +1,459 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   handoff.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 15:20:03 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 15:20:03 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file handoff.c
+ * @brief Transfers the session table of a running server to a new one.
+ *
+ * @details
+ * A zero-downtime upgrade runs as follows, all control messages being
+ * `MT_SIG_CONTROL` signals sent with `sigqueue()`:
+ * 1. The new server (`./server -t <old_pid>`) sends `MT_HANDOFF_REQUEST`.
+ * 2. The old server blocks `SIGUSR1`/`SIGUSR2`, feeds the bits still
+ *    pending into its sessions, copies them and its counters into the
+ *    shared-memory object `/minitalk-handoff.<old_pid>` and answers
+ *    `MT_HANDOFF_READY`.
+ * 3. The new server restores the snapshot, removes the object and answers
+ *    `MT_HANDOFF_DONE`.
+ * 4. The old server sends every client with a session a `SIGUSR2` whose
+ *    payload is the new PID, acknowledges the bare signals it fed in step
+ *    2, then exits. Each client resends the numbered frames it has not
+ *    seen acknowledged to the new PID and carries on from there.
+ *
+ * If the new server does not answer in time, the old one removes the
+ * snapshot and resumes serving as if nothing happened.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Clients whose bare signal was fed in by handoff_drain() and is
+ * not acknowledged yet.
+ *
+ * @ingroup server
+ */
+static pid_t g_owed[MT_MAX_SESSIONS];
+
+/**
+ * @brief Number of entries of `g_owed` in use.
+ *
+ * @ingroup server
+ */
+static size_t g_owed_count;
+
+/**
+ * @brief Builds the name of the shared-memory object used by a server.
+ *
+ * @param name Buffer receiving the name.
+ * @param size Size of the buffer.
+ * @param old_pid PID of the server handing over.
+ *
+ * @ingroup server
+ */
+static void handoff_name(char* name, size_t size, pid_t old_pid)
+{
+	snprintf(name, size, "/minitalk-handoff.%d", (int) old_pid);
+}
+
+/**
+ * @brief Waits for a given control message from a given process.
+ *
+ * @param from PID the message must come from.
+ * @param expected Control value awaited.
+ * @param timeout_s Maximum wait, in seconds.
+ * @return true if the message arrived in time, false if it did not or
+ * `MT_HANDOFF_REFUSED` came instead.
+ *
+ * @note `MT_SIG_CONTROL` must be blocked by the caller.
+ *
+ * @ingroup server
+ */
+static bool wait_control(pid_t from, int expected, int timeout_s)
+{
+	struct timespec timeout;
+	siginfo_t       info;
+	sigset_t        set;
+
+	sigemptyset(&set);
+	sigaddset(&set, MT_SIG_CONTROL);
+	timeout = (struct timespec){timeout_s, 0};
+	while (true)
+	{
+		if (sigtimedwait(&set, &info, &timeout) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return (false);
+		}
+		if (info.si_pid != from || info.si_code != SI_QUEUE)
+			continue;
+		if (info.si_value.sival_int == expected)
+			return (true);
+		if (info.si_value.sival_int == MT_HANDOFF_REFUSED)
+			return (false);
+	}
+}
+
+/**
+ * @brief Sends a control message to another server process.
+ *
+ * @param to Destination PID.
+ * @param value Control value.
+ * @return true on success, false if the signal could not be queued.
+ *
+ * @ingroup server
+ */
+static bool send_control(pid_t to, int value)
+{
+	union sigval val;
+
+	val.sival_int = value;
+	return (sigqueue(to, MT_SIG_CONTROL, val) == 0);
+}
+
+/**
+ * @brief Copies the session table into a new shared-memory object.
+ *
+ * @param table The session table to copy.
+ * @param name Name of the shared-memory object to create.
+ * @return true on success, false if the object could not be created.
+ *
+ * @ingroup server
+ */
+static bool write_snapshot(const t_sessions* table, const char* name)
+{
+	t_handoff* snap;
+	int        fd;
+
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd == -1)
+		return (false);
+	snap = MAP_FAILED;
+	if (ftruncate(fd, sizeof(t_handoff)) == 0)
+		snap = mmap(NULL, sizeof(t_handoff), PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+	close(fd);
+	if (snap == MAP_FAILED)
+		return (false);
+	memcpy(snap->magic, MT_HANDOFF_MAGIC, 8);
+	snap->version      = MT_HANDOFF_VERSION;
+	snap->session_size = sizeof(t_session);
+	snap->max_sessions = MT_MAX_SESSIONS;
+	snap->stats        = table->stats;
+	memcpy(snap->slots, table->slots, sizeof(table->slots));
+	munmap(snap, sizeof(t_handoff));
+	return (true);
+}
+
+/**
+ * @brief Maps the snapshot of the old server, if this build can read it.
+ *
+ * The object must have the size of a `t_handoff` and a header matching
+ * this build: magic bytes, `MT_HANDOFF_VERSION`, session size and number
+ * of slots. A snapshot with another layout is refused, not misread.
+ *
+ * @param name Name of the shared-memory object.
+ * @return The mapped snapshot, or NULL if it is missing or does not match.
+ *
+ * @ingroup server
+ */
+static t_handoff* map_snapshot(const char* name)
+{
+	struct stat st;
+	t_handoff*  snap;
+	int         fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1)
+		return (NULL);
+	snap = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size == (off_t) sizeof(t_handoff))
+		snap = mmap(NULL, sizeof(t_handoff), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (snap == MAP_FAILED)
+		return (NULL);
+	if (memcmp(snap->magic, MT_HANDOFF_MAGIC, 8) != 0
+		|| snap->version != MT_HANDOFF_VERSION
+		|| snap->session_size != sizeof(t_session)
+		|| snap->max_sessions != MT_MAX_SESSIONS)
+	{
+		munmap(snap, sizeof(t_handoff));
+		return (NULL);
+	}
+	return (snap);
+}
+
+/**
+ * @brief Tells whether a session of bare signals still owes its next bit.
+ *
+ * @details
+ * Its client answers every acknowledgment with its next bit, and this
+ * server acknowledged every bit it served, so one more is on its way
+ * unless it was already fed in.
+ *
+ * @param table The session table.
+ * @return true if such a session is left.
+ *
+ * @ingroup server
+ */
+static bool drain_waiting(const t_sessions* table)
+{
+	size_t i;
+	size_t j;
+
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table->slots[i].pid != 0 && table->slots[i].id < 0)
+		{
+			j = 0;
+			while (j < g_owed_count && g_owed[j] != table->slots[i].pid)
+				j++;
+			if (j == g_owed_count)
+				return (true);
+		}
+		i++;
+	}
+	return (false);
+}
+
+/**
+ * @brief Feeds one pending data signal into the session table.
+ *
+ * @details
+ * Numbered frames are fed in without an answer: their clients send the
+ * frames they miss again to the new server, which acknowledges them. A
+ * bare signal is acknowledged later by handoff_send(), or refused at once
+ * if it gets no session or aborts its session.
+ *
+ * @param table The session table.
+ * @param info The pending signal.
+ *
+ * @ingroup server
+ */
+static void drain_one(t_sessions* table, const siginfo_t* info)
+{
+	t_session*    s;
+	unsigned long aborted;
+	int           frame;
+
+	if (info->si_pid <= 0)
+		return;
+	frame = -1;
+	if (info->si_code == SI_QUEUE)
+		frame = info->si_value.sival_int & MT_FRAME_VALUE;
+	s = session_open(table, info->si_pid, frame, true);
+	if (!s)
+	{
+		if (frame < 0)
+			kill(info->si_pid, SIGUSR2);
+		return;
+	}
+	aborted = table->stats.aborted;
+	session_frame(table, s, info->si_signo, frame);
+	if (table->stats.aborted != aborted)
+		kill(info->si_pid, SIGUSR2);
+	else if (frame < 0 && g_owed_count < MT_MAX_SESSIONS)
+		g_owed[g_owed_count++] = info->si_pid;
+}
+
+/**
+ * @brief Feeds the data signals still pending into the session table, so
+ * that the snapshot holds them.
+ *
+ * @details
+ * A bare signal cannot be sent again by its client, which has no way to
+ * tell whether it was served, so the bit that answers the last
+ * acknowledgment of each session of bare signals is awaited for up to
+ * `MT_HANDOFF_DRAIN_NS`. The bits fed in are not acknowledged until the
+ * clients are redirected: no client then has a bit on its way to this
+ * server, since it waits for that acknowledgment.
+ *
+ * @param table The session table.
+ *
+ * @note `SIGUSR1` and `SIGUSR2` must be blocked by the caller, and any
+ * session workers stopped.
+ *
+ * @ingroup server
+ */
+void handoff_drain(t_sessions* table)
+{
+	struct timespec wait;
+	siginfo_t       info;
+	sigset_t        usr;
+	long            deadline;
+	long            left;
+
+	sigemptyset(&usr);
+	sigaddset(&usr, SIGUSR1);
+	sigaddset(&usr, SIGUSR2);
+	g_owed_count = 0;
+	deadline     = stats_now_ns() + MT_HANDOFF_DRAIN_NS;
+	while (true)
+	{
+		left = 0;
+		if (drain_waiting(table))
+			left = deadline - stats_now_ns();
+		if (left < 0)
+			left = 0;
+		wait = (struct timespec){left / 1000000000L, left % 1000000000L};
+		if (sigtimedwait(&usr, &info, &wait) <= 0)
+			return;
+		drain_one(table, &info);
+	}
+}
+
+/**
+ * @brief Acknowledges the bare signals fed in by handoff_drain().
+ *
+ * @ingroup server
+ */
+static void drain_ack(void)
+{
+	size_t i;
+
+	i = 0;
+	while (i < g_owed_count)
+		kill(g_owed[i++], SIGUSR1);
+	g_owed_count = 0;
+}
+
+/**
+ * @brief Hands the session table over to a new server process.
+ *
+ * @details
+ * Called from the main loop of the old server once a handoff request
+ * arrived, after handoff_drain(). `SIGUSR1` and `SIGUSR2` stay blocked
+ * from the snapshot on, so no bit is processed that the new server would
+ * not know about; numbered frames sent in the meantime are lost with this
+ * process and resent by the clients after the redirect. The bare signals
+ * handoff_drain() fed in are acknowledged once their clients know where
+ * to send the next one, or right away if the handoff fails, in which case
+ * the caller's signal mask is also restored as it was.
+ *
+ * @param table The session table to transfer.
+ * @param new_pid PID of the new server.
+ * @return true if the new server took over and clients were redirected,
+ * false if the handoff failed and this server must keep serving.
+ *
+ * @ingroup server
+ */
+bool handoff_send(t_sessions* table, pid_t new_pid)
+{
+	sigset_t block;
+	sigset_t old;
+	char     name[64];
+	bool     done;
+	size_t   i;
+
+	sigemptyset(&block);
+	sigaddset(&block, SIGUSR1);
+	sigaddset(&block, SIGUSR2);
+	sigaddset(&block, MT_SIG_CONTROL);
+	sigprocmask(SIG_BLOCK, &block, &old);
+	handoff_name(name, sizeof(name), getpid());
+	done = write_snapshot(table, name)
+		   && send_control(new_pid, MT_HANDOFF_READY)
+		   && wait_control(new_pid, MT_HANDOFF_DONE, 5);
+	shm_unlink(name);
+	if (!done)
+	{
+		fprintf(stderr, "Server: handoff to PID %d failed, resuming\n",
+				(int) new_pid);
+		drain_ack();
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return (false);
+	}
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table->slots[i].pid != 0)
+			sigqueue(table->slots[i].pid, SIGUSR2,
+					 (union sigval){.sival_int = new_pid});
+		i++;
+	}
+	drain_ack();
+	fprintf(stderr, "Server: handed %zu session(s) over to PID %d\n",
+			table->active, (int) new_pid);
+	return (true);
+}
+
+/**
+ * @brief Takes over the session table of a running server.
+ *
+ * @details
+ * Called by the new server once its handlers are installed; `SIGUSR1`,
+ * `SIGUSR2` and `MT_SIG_CONTROL` are blocked until the snapshot has been
+ * restored, then the caller's signal mask is restored. Sessions and
+ * cumulative counters are restored as they were in the old server; the
+ * caller's output descriptor is kept.
+ *
+ * A snapshot this build cannot read is refused: the old server is told to
+ * keep serving its clients, and this one starts with an empty table.
+ *
+ * @param table The session table to fill.
+ * @param old_pid PID of the server to take over from.
+ *
+ * @note Exits with an error message if the old server does not answer.
+ *
+ * @ingroup server
+ */
+void handoff_receive(t_sessions* table, pid_t old_pid)
+{
+	t_handoff* snap;
+	sigset_t   block;
+	sigset_t   old;
+	char       name[64];
+	size_t     i;
+
+	sigemptyset(&block);
+	sigaddset(&block, SIGUSR1);
+	sigaddset(&block, SIGUSR2);
+	sigaddset(&block, MT_SIG_CONTROL);
+	sigprocmask(SIG_BLOCK, &block, &old);
+	if (!send_control(old_pid, MT_HANDOFF_REQUEST))
+		sys_error("Server: cannot reach the server to take over");
+	if (!wait_control(old_pid, MT_HANDOFF_READY, 5))
+		sys_error("Server: no handoff answer from the old server");
+	handoff_name(name, sizeof(name), old_pid);
+	snap = map_snapshot(name);
+	if (!snap)
+	{
+		send_control(old_pid, MT_HANDOFF_REFUSED);
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		fprintf(stderr, "Server: snapshot of PID %d does not match this "
+						"build, starting without its sessions\n",
+				(int) old_pid);
+		return;
+	}
+	table->stats = snap->stats;
+	memcpy(table->slots, snap->slots, sizeof(table->slots));
+	munmap(snap, sizeof(t_handoff));
+	shm_unlink(name);
+	table->active = 0;
+	i             = 0;
+	while (i < MT_MAX_SESSIONS)
+		if (table->slots[i++].pid != 0)
+			table->active++;
+	if (!send_control(old_pid, MT_HANDOFF_DONE))
+		sys_error("Server: cannot confirm the handoff");
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	fprintf(stderr, "Server: took over %zu session(s) from PID %d\n",
+			table->active, (int) old_pid);
+}
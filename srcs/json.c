@@ -0,0 +1,896 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   json.c                                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 23:58:42 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 23:58:42 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file json.c
+ * @brief Validation and indexing of JSON messages into a binary tape.
+ *
+ * @details
+ * With `-J <file>`, every complete message is checked as a JSON document
+ * and, when valid, written to the tape file as a record holding the raw
+ * message and its tape (see `t_tape_type`), so that consumers walk the
+ * tape instead of parsing the text again.
+ *
+ * Indexing is done in two stages, after simdjson:
+ *
+ * 1. The message is read 64 bytes at a time. Each block is classified
+ *    with vector compares (SSE2 or NEON, plain loops elsewhere) into bit
+ *    masks of quotes, backslashes, operators and whitespace. Bit tricks
+ *    then find the escaped characters and the bytes inside strings, and
+ *    keep the positions where an operator, a string or a scalar starts.
+ * 2. Those positions are walked with a stack of open containers, checking
+ *    the grammar and each token and writing the tape.
+ *
+ * The signal path only queues a complete message on the pool, whose
+ * threads index it with fixed-size arrays on their stack and never
+ * allocate. Build with `-DMT_JSON_SCALAR` to use the plain classifier on
+ * any machine.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <fcntl.h>
+
+#if defined(__SSE2__) && !defined(MT_JSON_SCALAR)
+# include <emmintrin.h>
+# define MT_JSON_SSE2
+#elif defined(__aarch64__) && !defined(MT_JSON_SCALAR)
+# include <arm_neon.h>
+# define MT_JSON_NEON
+#endif
+
+/**
+ * @internal
+ * @brief Classes of the 64 bytes of a block, one bit per byte.
+ */
+typedef struct s_json_block
+{
+	uint64_t quote;     ///< `"`.
+	uint64_t backslash; ///< `\`.
+	uint64_t op;        ///< `{`, `}`, `[`, `]`, `:` and `,`.
+	uint64_t space;     ///< Space, tab, newline and carriage return.
+	uint64_t high;      ///< Bytes above 0x7f.
+} t_json_block;
+
+/**
+ * @internal
+ * @brief State of the second stage.
+ */
+typedef struct s_json_parser
+{
+	const char*     buf;                 ///< The message.
+	size_t          len;                 ///< Its length.
+	const uint32_t* idx;                 ///< Positions found by stage 1.
+	size_t          count;               ///< Number of positions.
+	size_t          next;                ///< Next position to take.
+	size_t          pos;                 ///< Position taken last.
+	uint64_t*       tape;                ///< Tape being written.
+	size_t          words;               ///< Words written.
+	uint32_t        open[MT_JSON_DEPTH]; ///< Words of the open containers.
+	size_t          depth;               ///< Containers open.
+} t_json_parser;
+
+#if defined(MT_JSON_SSE2)
+
+/**
+ * @brief Places the top bits of a compare result in the mask of a block.
+ *
+ * @param r The compare result for 16 bytes.
+ * @param lane Which 16 bytes of the block they are.
+ * @return Their bits, shifted to their place.
+ *
+ * @ingroup server
+ */
+static uint64_t lane_bits(__m128i r, int lane)
+{
+	return ((uint64_t) (uint16_t) _mm_movemask_epi8(r) << 16 * lane);
+}
+
+/**
+ * @brief Classifies a block of 64 bytes with SSE2, 16 bytes at a time.
+ *
+ * `{` and `[` differ from `}` and `]` only by bit 5, so two compares on
+ * the bytes with that bit set, by an OR with a space, find all four
+ * brackets. The constants are set up once per block.
+ *
+ * @param p The block.
+ * @param b Receives its masks.
+ *
+ * @ingroup server
+ */
+static void classify(const unsigned char* p, t_json_block* b)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i open  = _mm_set1_epi8('{');
+	const __m128i close = _mm_set1_epi8('}');
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab   = _mm_set1_epi8('\t');
+	const __m128i nl    = _mm_set1_epi8('\n');
+	const __m128i cr    = _mm_set1_epi8('\r');
+	__m128i       v;
+	__m128i       low;
+	int           i;
+
+	memset(b, 0, sizeof(*b));
+	i = 0;
+	while (i < 4)
+	{
+		v   = _mm_loadu_si128((const __m128i*) (p + 16 * i));
+		low = _mm_or_si128(v, space);
+		b->high |= lane_bits(v, i);
+		b->quote |= lane_bits(_mm_cmpeq_epi8(v, quote), i);
+		b->backslash |= lane_bits(_mm_cmpeq_epi8(v, slash), i);
+		b->op |= lane_bits(
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(low, open),
+									  _mm_cmpeq_epi8(low, close)),
+						 _mm_or_si128(_mm_cmpeq_epi8(v, colon),
+									  _mm_cmpeq_epi8(v, comma))),
+			i);
+		b->space |= lane_bits(
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+									  _mm_cmpeq_epi8(v, tab)),
+						 _mm_or_si128(_mm_cmpeq_epi8(v, nl),
+									  _mm_cmpeq_epi8(v, cr))),
+			i);
+		i++;
+	}
+}
+
+#elif defined(MT_JSON_NEON)
+
+/**
+ * @brief Gathers four compare results into one mask, one bit per byte.
+ *
+ * Each byte keeps the bit of its place in its half, and three pairwise
+ * additions pack the bytes of the four vectors into 64 bits.
+ *
+ * @ingroup server
+ */
+static uint64_t block_bits(const uint8x16_t* r)
+{
+	const uint8x16_t weight = {1, 2, 4, 8, 16, 32, 64, 128,
+							   1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t       a;
+	uint8x16_t       b;
+
+	a = vpaddq_u8(vandq_u8(r[0], weight), vandq_u8(r[1], weight));
+	b = vpaddq_u8(vandq_u8(r[2], weight), vandq_u8(r[3], weight));
+	a = vpaddq_u8(a, b);
+	a = vpaddq_u8(a, a);
+	return (vgetq_lane_u64(vreinterpretq_u64_u8(a), 0));
+}
+
+/**
+ * @brief Classifies a block of 64 bytes with NEON.
+ *
+ * `{` and `[` differ from `}` and `]` only by bit 5, so two compares on
+ * the bytes with that bit set, by an OR with a space, find all four
+ * brackets.
+ *
+ * @param p The block.
+ * @param b Receives its masks.
+ *
+ * @ingroup server
+ */
+static void classify(const unsigned char* p, t_json_block* b)
+{
+	const uint8x16_t quote = vdupq_n_u8('"');
+	const uint8x16_t slash = vdupq_n_u8('\\');
+	const uint8x16_t open  = vdupq_n_u8('{');
+	const uint8x16_t close = vdupq_n_u8('}');
+	const uint8x16_t colon = vdupq_n_u8(':');
+	const uint8x16_t comma = vdupq_n_u8(',');
+	const uint8x16_t space = vdupq_n_u8(' ');
+	const uint8x16_t tab   = vdupq_n_u8('\t');
+	const uint8x16_t nl    = vdupq_n_u8('\n');
+	const uint8x16_t cr    = vdupq_n_u8('\r');
+	uint8x16_t       v[4];
+	uint8x16_t       r[4];
+	uint8x16_t       low;
+	int              i;
+
+	i = 0;
+	while (i < 4)
+	{
+		v[i] = vld1q_u8(p + 16 * i);
+		r[i] = vcgeq_u8(v[i], vdupq_n_u8(0x80));
+		i++;
+	}
+	b->high = block_bits(r);
+	i       = 0;
+	while (i < 4)
+	{
+		r[i] = vceqq_u8(v[i], quote);
+		i++;
+	}
+	b->quote = block_bits(r);
+	i        = 0;
+	while (i < 4)
+	{
+		r[i] = vceqq_u8(v[i], slash);
+		i++;
+	}
+	b->backslash = block_bits(r);
+	i            = 0;
+	while (i < 4)
+	{
+		low  = vorrq_u8(v[i], space);
+		r[i] = vorrq_u8(
+			vorrq_u8(vceqq_u8(low, open), vceqq_u8(low, close)),
+			vorrq_u8(vceqq_u8(v[i], colon), vceqq_u8(v[i], comma)));
+		i++;
+	}
+	b->op = block_bits(r);
+	i     = 0;
+	while (i < 4)
+	{
+		r[i] = vorrq_u8(vorrq_u8(vceqq_u8(v[i], space), vceqq_u8(v[i], tab)),
+						vorrq_u8(vceqq_u8(v[i], nl), vceqq_u8(v[i], cr)));
+		i++;
+	}
+	b->space = block_bits(r);
+}
+
+#else
+
+/**
+ * @brief Classifies a block of 64 bytes one byte at a time.
+ *
+ * @param p The block.
+ * @param b Receives its masks.
+ *
+ * @ingroup server
+ */
+static void classify(const unsigned char* p, t_json_block* b)
+{
+	uint64_t bit;
+	int      i;
+
+	memset(b, 0, sizeof(*b));
+	i = 0;
+	while (i < 64)
+	{
+		bit = (uint64_t) 1 << i;
+		if (p[i] == '"')
+			b->quote |= bit;
+		else if (p[i] == '\\')
+			b->backslash |= bit;
+		else if (p[i] && strchr("{}[]:,", p[i]))
+			b->op |= bit;
+		else if (p[i] == ' ' || p[i] == '\t' || p[i] == '\n' || p[i] == '\r')
+			b->space |= bit;
+		if (p[i] & 0x80)
+			b->high |= bit;
+		i++;
+	}
+}
+
+#endif
+
+/**
+ * @brief Names the classifier in use.
+ *
+ * @return "SSE2", "NEON" or "scalar".
+ *
+ * @ingroup server
+ */
+const char* json_backend(void)
+{
+#if defined(MT_JSON_SSE2)
+	return ("SSE2");
+#elif defined(MT_JSON_NEON)
+	return ("NEON");
+#else
+	return ("scalar");
+#endif
+}
+
+/**
+ * @brief Finds the characters escaped by a backslash.
+ *
+ * @details
+ * A backslash escapes the next character unless it is escaped itself, so
+ * in a run of backslashes every second one escapes. Adding the runs that
+ * start on an odd bit to the backslash mask carries each run one bit past
+ * its end, which flips the parity of the alternating pattern for those
+ * runs. A run reaching the last bit escapes the first one of the next
+ * block, through `carry`.
+ *
+ * @param backslash The backslashes of the block.
+ * @param carry 1 if the first byte of the block is escaped; updated for
+ * the next block.
+ * @return The escaped characters.
+ *
+ * @ingroup server
+ */
+static uint64_t find_escaped(uint64_t backslash, uint64_t* carry)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+	uint64_t       follows;
+	uint64_t       odd_starts;
+	uint64_t       runs;
+
+	backslash &= ~*carry;
+	follows    = backslash << 1 | *carry;
+	odd_starts = backslash & ~even & ~follows;
+	runs       = odd_starts + backslash;
+	*carry     = runs < backslash;
+	return ((even ^ (runs << 1)) & follows);
+}
+
+/**
+ * @brief Computes the running XOR of the bits of a mask, from the lowest.
+ *
+ * Applied to the unescaped quotes, it sets the bits from each opening
+ * quote up to, but excluding, its closing quote.
+ *
+ * @ingroup server
+ */
+static uint64_t prefix_xor(uint64_t m)
+{
+	m ^= m << 1;
+	m ^= m << 2;
+	m ^= m << 4;
+	m ^= m << 8;
+	m ^= m << 16;
+	m ^= m << 32;
+	return (m);
+}
+
+/**
+ * @brief Stage 1: lists where each token of a message starts.
+ *
+ * @details
+ * A token starts at every operator, and at every other non-space byte
+ * that does not follow a byte of the same kind, quotes excepted, so that
+ * `"a"` and `12` are one token each. Bytes inside strings are left out.
+ *
+ * @param buf The message.
+ * @param len Its length.
+ * @param idx Receives the positions, at least `len` entries.
+ * @param high Set if the message holds bytes above 0x7f.
+ * @return Number of positions, or -1 if a string is left open.
+ *
+ * @ingroup server
+ */
+static long json_scan(const char* buf, size_t len, uint32_t* idx, bool* high)
+{
+	unsigned char tail[64];
+	t_json_block  b;
+	uint64_t      escaped;
+	uint64_t      in_string;
+	uint64_t      string_carry;
+	uint64_t      scalar_carry;
+	uint64_t      escape_carry;
+	uint64_t      nonquote;
+	uint64_t      scalar;
+	uint64_t      quote;
+	uint64_t      starts;
+	size_t        base;
+	long          n;
+
+	n            = 0;
+	string_carry = 0;
+	scalar_carry = 0;
+	escape_carry = 0;
+	*high        = false;
+	base         = 0;
+	while (base < len)
+	{
+		if (len - base >= 64)
+			classify((const unsigned char*) buf + base, &b);
+		else
+		{
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, buf + base, len - base);
+			classify(tail, &b);
+		}
+		escaped      = find_escaped(b.backslash, &escape_carry);
+		quote        = b.quote & ~escaped;
+		in_string    = prefix_xor(quote) ^ string_carry;
+		string_carry = (uint64_t) ((int64_t) in_string >> 63);
+		scalar       = ~(b.op | b.space);
+		nonquote     = scalar & ~quote;
+		scalar       = scalar & ~(nonquote << 1 | scalar_carry);
+		scalar_carry = nonquote >> 63;
+		starts       = (b.op | scalar) & ~(in_string ^ quote);
+		*high        = *high || b.high;
+		while (starts)
+		{
+			idx[n++] = base + __builtin_ctzll(starts);
+			starts &= starts - 1;
+		}
+		base += 64;
+	}
+	if (string_carry)
+		return (-1);
+	return (n);
+}
+
+/**
+ * @brief Checks that a message is well-formed UTF-8, without overlong
+ * forms, surrogates or code points above U+10FFFF.
+ *
+ * @ingroup server
+ */
+static bool utf8_valid(const unsigned char* s, size_t len)
+{
+	unsigned char lo;
+	unsigned char hi;
+	size_t        follow;
+	size_t        i;
+
+	i = 0;
+	while (i < len)
+	{
+		lo = 0x80;
+		hi = 0xbf;
+		if (s[i] < 0x80)
+			follow = 0;
+		else if (s[i] >= 0xc2 && s[i] <= 0xdf)
+			follow = 1;
+		else if (s[i] >= 0xe0 && s[i] <= 0xef)
+			follow = 2;
+		else if (s[i] >= 0xf0 && s[i] <= 0xf4)
+			follow = 3;
+		else
+			return (false);
+		if (s[i] == 0xe0)
+			lo = 0xa0;
+		else if (s[i] == 0xed)
+			hi = 0x9f;
+		else if (s[i] == 0xf0)
+			lo = 0x90;
+		else if (s[i] == 0xf4)
+			hi = 0x8f;
+		i++;
+		if (follow > 0 && (i >= len || s[i] < lo || s[i] > hi))
+			return (false);
+		while (follow-- > 0)
+		{
+			if (i >= len || s[i] < 0x80 || s[i] > 0xbf)
+				return (false);
+			i++;
+		}
+	}
+	return (true);
+}
+
+/**
+ * @brief Tells whether a scalar token may end before a position.
+ *
+ * @ingroup server
+ */
+static bool token_end(const t_json_parser* p, size_t i)
+{
+	return (i == p->len
+			|| (p->buf[i] && strchr(" \t\n\r{}[]:,", p->buf[i])));
+}
+
+/**
+ * @brief Takes the next token, stage 1 having found where it starts.
+ *
+ * @return Its first character, or `'\0'` when there are no more.
+ *
+ * @ingroup server
+ */
+static char take(t_json_parser* p)
+{
+	if (p->next == p->count)
+		return ('\0');
+	p->pos = p->idx[p->next++];
+	return (p->buf[p->pos]);
+}
+
+/**
+ * @brief Appends a word to the tape.
+ *
+ * @ingroup server
+ */
+static void emit(t_json_parser* p, int type, uint64_t payload)
+{
+	p->tape[p->words++] = MT_TAPE_WORD(type, payload);
+}
+
+/**
+ * @brief Checks the string starting at the current position and appends
+ * it to the tape.
+ *
+ * @return true if it is a valid string, false otherwise.
+ *
+ * @ingroup server
+ */
+static bool parse_string(t_json_parser* p)
+{
+	size_t i;
+	size_t k;
+
+	i = p->pos + 1;
+	while (i < p->len && p->buf[i] != '"')
+	{
+		if ((unsigned char) p->buf[i] < 0x20)
+			return (false);
+		if (p->buf[i++] != '\\')
+			continue;
+		if (i < p->len && p->buf[i] == 'u')
+		{
+			k = 0;
+			while (++k <= 4)
+				if (i + k >= p->len || !p->buf[i + k]
+					|| !strchr("0123456789abcdefABCDEF", p->buf[i + k]))
+					return (false);
+			i += 4;
+		}
+		else if (i >= p->len || !p->buf[i] || !strchr("\"\\/bfnrt", p->buf[i]))
+			return (false);
+		i++;
+	}
+	if (i >= p->len)
+		return (false);
+	emit(p, MT_TAPE_STRING, (p->pos + 1) | (uint64_t) (i - p->pos - 1) << 32);
+	return (true);
+}
+
+/**
+ * @brief Skips a run of decimal digits.
+ *
+ * @return The position after them.
+ *
+ * @ingroup server
+ */
+static size_t skip_digits(const t_json_parser* p, size_t i)
+{
+	while (i < p->len && p->buf[i] >= '0' && p->buf[i] <= '9')
+		i++;
+	return (i);
+}
+
+/**
+ * @brief Checks the number starting at the current position and appends
+ * it to the tape, as written.
+ *
+ * @return true if it is a valid number, false otherwise.
+ *
+ * @ingroup server
+ */
+static bool parse_number(t_json_parser* p)
+{
+	size_t i;
+	size_t j;
+
+	i = p->pos;
+	if (p->buf[i] == '-')
+		i++;
+	if (i < p->len && p->buf[i] == '0')
+		i++;
+	else if (skip_digits(p, i) == i)
+		return (false);
+	else
+		i = skip_digits(p, i);
+	if (i < p->len && p->buf[i] == '.')
+	{
+		j = skip_digits(p, i + 1);
+		if (j == i + 1)
+			return (false);
+		i = j;
+	}
+	if (i < p->len && (p->buf[i] == 'e' || p->buf[i] == 'E'))
+	{
+		i++;
+		if (i < p->len && (p->buf[i] == '+' || p->buf[i] == '-'))
+			i++;
+		j = skip_digits(p, i);
+		if (j == i)
+			return (false);
+		i = j;
+	}
+	if (!token_end(p, i))
+		return (false);
+	emit(p, MT_TAPE_NUMBER, p->pos | (uint64_t) (i - p->pos) << 32);
+	return (true);
+}
+
+/**
+ * @brief Checks a `true`, `false` or `null` at the current position and
+ * appends it to the tape.
+ *
+ * @return true if the word is spelled out and ends there, false
+ * otherwise.
+ *
+ * @ingroup server
+ */
+static bool parse_literal(t_json_parser* p, const char* word, int type)
+{
+	size_t n;
+
+	n = strlen(word);
+	if (p->len - p->pos < n || memcmp(p->buf + p->pos, word, n) != 0
+		|| !token_end(p, p->pos + n))
+		return (false);
+	emit(p, type, 0);
+	return (true);
+}
+
+/**
+ * @brief Parses a string, number or literal starting with `c`.
+ *
+ * @ingroup server
+ */
+static bool parse_atom(t_json_parser* p, char c)
+{
+	if (c == '"')
+		return (parse_string(p));
+	if (c == 't')
+		return (parse_literal(p, "true", MT_TAPE_TRUE));
+	if (c == 'f')
+		return (parse_literal(p, "false", MT_TAPE_FALSE));
+	if (c == 'n')
+		return (parse_literal(p, "null", MT_TAPE_NULL));
+	if (c == '-' || (c >= '0' && c <= '9'))
+		return (parse_number(p));
+	return (false);
+}
+
+/**
+ * @brief Parses an object key and the colon after it.
+ *
+ * @ingroup server
+ */
+static bool parse_key(t_json_parser* p)
+{
+	return (take(p) == '"' && parse_string(p) && take(p) == ':');
+}
+
+/**
+ * @brief Closes the innermost container; its opening word is patched to
+ * point past the closing one.
+ *
+ * @ingroup server
+ */
+static void container_close(t_json_parser* p, char c)
+{
+	uint32_t open;
+
+	open = p->open[--p->depth];
+	p->tape[open] |= p->words + 1;
+	emit(p, c, open);
+}
+
+/**
+ * @brief Stage 2: checks the grammar of the document and writes its tape.
+ *
+ * @details
+ * `value` tells whether a value is expected next; otherwise a comma or
+ * the end of the innermost container is, or the end of the input once
+ * the top-level value is complete.
+ *
+ * @return true if the tokens form exactly one JSON value, false
+ * otherwise.
+ *
+ * @ingroup server
+ */
+static bool json_parse(t_json_parser* p)
+{
+	bool value;
+	char top;
+	char c;
+
+	value = true;
+	while (true)
+	{
+		if (!value && p->depth == 0)
+			return (p->next == p->count);
+		c = take(p);
+		if (value && (c == '{' || c == '['))
+		{
+			if (p->depth == MT_JSON_DEPTH)
+				return (false);
+			p->open[p->depth++] = p->words;
+			emit(p, c, 0);
+			if (p->next < p->count && p->buf[p->idx[p->next]] == c + 2)
+			{
+				container_close(p, take(p));
+				value = false;
+			}
+			else if (c == '{' && !parse_key(p))
+				return (false);
+			continue;
+		}
+		if (value && !parse_atom(p, c))
+			return (false);
+		if (value)
+		{
+			value = false;
+			continue;
+		}
+		top = p->tape[p->open[p->depth - 1]] >> 56;
+		if (c == ',' && (top == '[' || parse_key(p)))
+			value = true;
+		else if (c == top + 2)
+			container_close(p, c);
+		else
+			return (false);
+	}
+}
+
+/**
+ * @brief Validates a JSON document and builds its tape.
+ *
+ * @param buf The document.
+ * @param len Its length.
+ * @param idx Scratch space for `len` positions.
+ * @param tape Receives the tape, at least `len` words.
+ * @return Number of tape words, or 0 if the document is not valid JSON.
+ *
+ * @ingroup server
+ */
+size_t json_index(const char* buf, size_t len, uint32_t* idx, uint64_t* tape)
+{
+	t_json_parser p;
+	long          count;
+	bool          high;
+
+	count = json_scan(buf, len, idx, &high);
+	if (count <= 0 || (high && !utf8_valid((const unsigned char*) buf, len)))
+		return (0);
+	p.buf   = buf;
+	p.len   = len;
+	p.idx   = idx;
+	p.count = count;
+	p.next  = 0;
+	p.tape  = tape;
+	p.words = 0;
+	p.depth = 0;
+	if (!json_parse(&p))
+		return (0);
+	return (p.words);
+}
+
+/**
+ * @brief Opens the tape file and starts the writer of its records.
+ *
+ * @param t The indexing state.
+ * @param path The tape file, created or truncated.
+ *
+ * @note Exits with an error message if the file cannot be opened.
+ *
+ * @ingroup server
+ */
+void tapes_start(t_tapes* t, const char* path)
+{
+	memset(t, 0, sizeof(*t));
+	atomic_flag_clear(&t->lock);
+	t->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (t->fd == -1)
+		sys_error("Server: cannot open tape file");
+	writer_start(&t->writer, t->fd, MT_WRITER_DEPTH, MT_POLICY_BLOCK, 0);
+}
+
+/**
+ * @brief Appends bytes to the record being pushed, pushing every chunk
+ * that fills up.
+ *
+ * @param t The indexing state.
+ * @param chunk The chunk, `MT_SESSION_BUFFER` bytes.
+ * @param used Bytes already in it.
+ * @param data The bytes.
+ * @param len Their number.
+ *
+ * @ingroup server
+ */
+static void tape_put(t_tapes* t, char* chunk, size_t* used, const void* data,
+					 size_t len)
+{
+	size_t n;
+
+	while (len > 0)
+	{
+		n = MT_SESSION_BUFFER - *used;
+		if (n > len)
+			n = len;
+		memcpy(chunk + *used, data, n);
+		*used += n;
+		data = (const char*) data + n;
+		len -= n;
+		if (*used == MT_SESSION_BUFFER)
+		{
+			writer_push(&t->writer, chunk, *used);
+			*used = 0;
+		}
+	}
+}
+
+/**
+ * @brief Queues a complete message for indexing.
+ *
+ * @details
+ * Only messages held whole in the session buffer are indexed; a longer
+ * one has been partly written already and is counted as skipped.
+ *
+ * @param t The indexing state.
+ * @param pool The pool running tasks of kind `MT_TASK_JSON`.
+ * @param s The session, its terminator just received.
+ *
+ * @ingroup server
+ */
+void tapes_submit(t_tapes* t, t_pool* pool, const t_session* s)
+{
+	if (s->flushed)
+	{
+		atomic_fetch_add_explicit(&t->skipped, 1, memory_order_relaxed);
+		return;
+	}
+	pool_submit(pool, s->pid, MT_TASK_JSON, s->buf, s->len);
+}
+
+/**
+ * @brief Indexes a complete message and writes its record.
+ *
+ * @details
+ * Called by the pool threads, which hold the arrays below on their stack.
+ *
+ * @param t The indexing state.
+ * @param pid The client that sent the message.
+ * @param buf The message.
+ * @param len Its length, at most `MT_SESSION_BUFFER`.
+ *
+ * @ingroup server
+ */
+void tapes_index(t_tapes* t, pid_t pid, const char* buf, size_t len)
+{
+	static const char zero[8];
+	uint32_t          idx[MT_SESSION_BUFFER];
+	uint64_t          tape[MT_SESSION_BUFFER];
+	char              chunk[MT_SESSION_BUFFER];
+	t_tape_header     h;
+	size_t            words;
+	size_t            used;
+
+	words = json_index(buf, len, idx, tape);
+	if (words == 0)
+	{
+		atomic_fetch_add_explicit(&t->invalid, 1, memory_order_relaxed);
+		return;
+	}
+	memcpy(h.magic, MT_TAPE_MAGIC, 4);
+	h.pid     = pid;
+	h.raw_len = len;
+	h.words   = words;
+	used      = 0;
+	while (atomic_flag_test_and_set_explicit(&t->lock, memory_order_acquire))
+		cpu_relax();
+	tape_put(t, chunk, &used, &h, sizeof(h));
+	tape_put(t, chunk, &used, buf, len);
+	tape_put(t, chunk, &used, zero, -len & 7);
+	tape_put(t, chunk, &used, tape, words * sizeof(*tape));
+	writer_push(&t->writer, chunk, used);
+	atomic_flag_clear_explicit(&t->lock, memory_order_release);
+	atomic_fetch_add_explicit(&t->indexed, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Writes out the pending records and closes the tape file.
+ *
+ * @param t The indexing state.
+ *
+ * @ingroup server
+ */
+void tapes_stop(t_tapes* t)
+{
+	writer_stop(&t->writer);
+	close(t->fd);
+}
@@ -0,0 +1,487 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metrics.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 23:51:07 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 23:51:07 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file metrics.c
+ * @brief Aggregation of statsd metric lines received by the server.
+ *
+ * @details
+ * With `-A`, every line of the reassembled output of the form
+ * `name:value|type[|@rate]` is folded into an in-memory table instead of
+ * being written, and a flusher thread writes one aggregate per metric at
+ * each interval:
+ *
+ * - counters (`c`) as `name:SUM|c`, each value divided by its sample rate;
+ * - gauges (`g`) as `name:LAST|g`, the last value received;
+ * - timers (`ms`, `h`) as `name.count`, `name.min`, `name.max` and
+ *   `name.mean`.
+ *
+ * Metrics not updated during an interval are not written. Any other line
+ * is written unchanged, as without `-A`.
+ *
+ * Lines are parsed on the pool threads, away from the signal handler that
+ * reassembles them, and by hand rather than with `strtod()`, which would
+ * follow the locale. The table is guarded by a spin lock that the flusher
+ * only holds to swap the two tables.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+
+/**
+ * @brief Acquires the lock of the aggregation tables.
+ *
+ * @param m The aggregation.
+ *
+ * @ingroup server
+ */
+static void metrics_lock(t_metrics* m)
+{
+	while (atomic_flag_test_and_set_explicit(&m->lock, memory_order_acquire))
+		cpu_relax();
+}
+
+/**
+ * @brief Releases the lock of the aggregation tables.
+ *
+ * @param m The aggregation.
+ *
+ * @ingroup server
+ */
+static void metrics_unlock(t_metrics* m)
+{
+	atomic_flag_clear_explicit(&m->lock, memory_order_release);
+}
+
+/**
+ * @brief Parses a decimal number, with an optional sign and fraction.
+ *
+ * @param s First character.
+ * @param len Number of characters, all of which must be part of the number.
+ * @param out Receives the value.
+ * @return true if the characters form a number, false otherwise.
+ *
+ * @ingroup server
+ */
+static bool parse_number(const char* s, size_t len, double* out)
+{
+	double scale;
+	double v;
+	bool   digits;
+	bool   neg;
+	size_t i;
+
+	i   = 0;
+	neg = false;
+	if (i < len && (s[i] == '-' || s[i] == '+'))
+		neg = s[i++] == '-';
+	v      = 0;
+	digits = false;
+	while (i < len && s[i] >= '0' && s[i] <= '9')
+	{
+		v      = v * 10 + (s[i++] - '0');
+		digits = true;
+	}
+	scale = 1;
+	if (i < len && s[i] == '.')
+		i++;
+	while (i < len && s[i] >= '0' && s[i] <= '9')
+	{
+		scale /= 10;
+		v += (s[i++] - '0') * scale;
+		digits = true;
+	}
+	if (!digits || i != len)
+		return (false);
+	if (neg)
+		v = -v;
+	*out = v;
+	return (true);
+}
+
+/**
+ * @brief Parses the type, and the sample rate if any, of a metric line.
+ *
+ * @param s The part of the line after the value and its `'|'`.
+ * @param len Its length.
+ * @param type Receives the `t_metric_type`.
+ * @param rate Receives the sample rate, 1 if none is given.
+ * @return true if the part is well formed, false otherwise.
+ *
+ * @ingroup server
+ */
+static bool parse_type(const char* s, size_t len, int* type, double* rate)
+{
+	size_t n;
+
+	n = 0;
+	while (n < len && s[n] != '|')
+		n++;
+	if (n == 1 && s[0] == 'c')
+		*type = MT_METRIC_COUNTER;
+	else if (n == 1 && s[0] == 'g')
+		*type = MT_METRIC_GAUGE;
+	else if ((n == 2 && s[0] == 'm' && s[1] == 's') || (n == 1 && s[0] == 'h'))
+		*type = MT_METRIC_TIMER;
+	else
+		return (false);
+	*rate = 1;
+	if (n == len)
+		return (true);
+	if (len - n < 3 || s[n + 1] != '@'
+		|| !parse_number(s + n + 2, len - n - 2, rate))
+		return (false);
+	return (*rate > 0 && *rate <= 1);
+}
+
+/**
+ * @brief Hashes a metric name and type with FNV-1a.
+ *
+ * @ingroup server
+ */
+static size_t metric_hash(const char* name, size_t len, int type)
+{
+	uint32_t h;
+	size_t   i;
+
+	h = 2166136261u;
+	i = 0;
+	while (i < len)
+	{
+		h ^= (unsigned char) name[i++];
+		h *= 16777619u;
+	}
+	h ^= (uint32_t) type;
+	h *= 16777619u;
+	return (h);
+}
+
+/**
+ * @brief Folds one value into the active table.
+ *
+ * @details
+ * The metric is looked up by name and type with linear probing. A new
+ * metric is refused once three quarters of the table are taken, which
+ * keeps the probes short until the next flush empties it.
+ *
+ * @param m The aggregation, locked by the caller.
+ * @param name The metric name.
+ * @param len Its length, below `MT_METRIC_NAME`.
+ * @param type Its `t_metric_type`.
+ * @param v The value, sample rate already applied to counters.
+ * @return true if the value was folded, false if the table is full.
+ *
+ * @ingroup server
+ */
+static bool metric_fold(t_metrics* m, const char* name, size_t len, int type,
+						double v)
+{
+	t_metric* table;
+	t_metric* e;
+	size_t    i;
+
+	table = m->tables[m->active];
+	i     = metric_hash(name, len, type) & (MT_METRICS_SLOTS - 1);
+	while (table[i].name[0] && (table[i].type != type
+								|| strncmp(table[i].name, name, len) != 0
+								|| table[i].name[len] != '\0'))
+		i = (i + 1) & (MT_METRICS_SLOTS - 1);
+	e = &table[i];
+	if (!e->name[0])
+	{
+		if (m->used[m->active] >= MT_METRICS_SLOTS / 4 * 3)
+			return (false);
+		m->used[m->active]++;
+		memcpy(e->name, name, len);
+		e->name[len] = '\0';
+		e->type      = type;
+		e->count     = 0;
+		e->sum       = 0;
+		e->min       = v;
+		e->max       = v;
+	}
+	e->count++;
+	e->sum += v;
+	e->last = v;
+	if (v < e->min)
+		e->min = v;
+	if (v > e->max)
+		e->max = v;
+	return (true);
+}
+
+/**
+ * @brief Parses one line and folds it if it is a metric.
+ *
+ * @param m The aggregation.
+ * @param line First character of the line.
+ * @param len Its length, newline excluded.
+ * @return true if the line was a metric, whether or not it found room,
+ * false if it must be written as it is.
+ *
+ * @ingroup server
+ */
+static bool metric_line(t_metrics* m, const char* line, size_t len)
+{
+	size_t colon;
+	size_t bar;
+	double rate;
+	double v;
+	int    type;
+	bool   folded;
+
+	if (len > MT_METRIC_LINE)
+		return (false);
+	colon = 0;
+	while (colon < len && line[colon] > ' ' && line[colon] <= '~'
+		   && line[colon] != ':' && line[colon] != '|' && line[colon] != '@')
+		colon++;
+	if (colon == 0 || colon >= MT_METRIC_NAME || colon == len
+		|| line[colon] != ':')
+		return (false);
+	bar = colon + 1;
+	while (bar < len && line[bar] != '|')
+		bar++;
+	if (bar == len || !parse_number(line + colon + 1, bar - colon - 1, &v)
+		|| !parse_type(line + bar + 1, len - bar - 1, &type, &rate))
+		return (false);
+	if (type == MT_METRIC_COUNTER)
+		v /= rate;
+	metrics_lock(m);
+	folded = metric_fold(m, line, colon, type, v);
+	if (!folded)
+		m->dropped++;
+	metrics_unlock(m);
+	if (folded)
+		atomic_fetch_add_explicit(&m->lines, 1, memory_order_relaxed);
+	return (true);
+}
+
+/**
+ * @brief Takes the metric lines out of a buffer of reassembled output.
+ *
+ * @details
+ * Only complete lines are looked at. Metric lines are folded into the
+ * aggregation; the others are moved, in order, to the start of the
+ * buffer, to be written as they are.
+ *
+ * Called by the pool threads, for tasks of kind `MT_TASK_METRICS`.
+ *
+ * @param m The aggregation.
+ * @param buf The buffer.
+ * @param len Number of bytes in it.
+ * @param out_len Receives the number of bytes to write, at the start of
+ * `buf`.
+ * @return Number of bytes consumed: everything up to the last newline. The
+ * bytes after it are left where they were.
+ *
+ * @ingroup server
+ */
+size_t metrics_ingest(t_metrics* m, char* buf, size_t len, size_t* out_len)
+{
+	size_t start;
+	size_t end;
+	size_t out;
+
+	out   = 0;
+	start = 0;
+	end   = 0;
+	while (end < len)
+	{
+		if (buf[end++] != '\n')
+			continue;
+		if (!metric_line(m, buf + start, end - 1 - start))
+		{
+			memmove(buf + out, buf + start, end - start);
+			out += end - start;
+			atomic_fetch_add_explicit(&m->passed, 1, memory_order_relaxed);
+		}
+		start = end;
+	}
+	*out_len = out;
+	return (start);
+}
+
+/**
+ * @brief Appends one aggregate line to the chunk being built, pushing
+ * the chunk to the writer first if the line does not fit.
+ *
+ * @param m The aggregation.
+ * @param chunk The chunk, `MT_SESSION_BUFFER` bytes.
+ * @param used Bytes already in it.
+ * @param e The metric.
+ * @param suffix Appended to the name, e.g. `".max"`.
+ * @param v The value.
+ * @param type The statsd type written.
+ *
+ * @ingroup server
+ */
+static void emit_line(t_metrics* m, char* chunk, size_t* used,
+					  const t_metric* e, const char* suffix, double v,
+					  const char* type)
+{
+	char line[MT_METRIC_NAME + 64];
+	int  n;
+
+	n = snprintf(line, sizeof(line), "%s%s:%.15g|%s\n", e->name, suffix, v,
+				 type);
+	if (*used + n > MT_SESSION_BUFFER)
+	{
+		writer_push(m->writer, chunk, *used);
+		*used = 0;
+	}
+	memcpy(chunk + *used, line, n);
+	*used += n;
+	m->emitted++;
+}
+
+/**
+ * @brief Writes out the table of the interval that just ended and empties
+ * it.
+ *
+ * @param m The aggregation.
+ *
+ * @ingroup server
+ */
+static void metrics_flush(t_metrics* m)
+{
+	char      chunk[MT_SESSION_BUFFER];
+	t_metric* table;
+	t_metric* e;
+	size_t    used;
+	size_t    i;
+	int       idx;
+
+	metrics_lock(m);
+	idx       = m->active;
+	m->active = !idx;
+	metrics_unlock(m);
+	if (m->used[idx] == 0)
+		return;
+	table = m->tables[idx];
+	used  = 0;
+	i     = 0;
+	while (i < MT_METRICS_SLOTS)
+	{
+		e = &table[i++];
+		if (!e->name[0])
+			continue;
+		if (e->type == MT_METRIC_COUNTER)
+			emit_line(m, chunk, &used, e, "", e->sum, "c");
+		else if (e->type == MT_METRIC_GAUGE)
+			emit_line(m, chunk, &used, e, "", e->last, "g");
+		else
+		{
+			emit_line(m, chunk, &used, e, ".count", e->count, "c");
+			emit_line(m, chunk, &used, e, ".min", e->min, "g");
+			emit_line(m, chunk, &used, e, ".max", e->max, "g");
+			emit_line(m, chunk, &used, e, ".mean", e->sum / e->count, "g");
+		}
+		e->name[0] = '\0';
+	}
+	writer_push(m->writer, chunk, used);
+	m->used[idx] = 0;
+	m->flushes++;
+}
+
+/**
+ * @brief Main loop of the flusher thread.
+ *
+ * @details
+ * Deadlines are spaced by the interval from the start, so that flushes
+ * do not drift with the time they take. Once stopped, the table being
+ * filled is flushed one last time.
+ *
+ * @param arg The aggregation.
+ * @return NULL.
+ *
+ * @ingroup server
+ */
+static void* metrics_main(void* arg)
+{
+	t_metrics*      m;
+	struct timespec deadline;
+
+	m = arg;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	while (!atomic_load(&m->stop))
+	{
+		deadline.tv_sec += m->interval_ms / 1000;
+		deadline.tv_nsec += m->interval_ms % 1000 * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (sem_timedwait(&m->wake, &deadline) == -1 && errno == EINTR)
+			;
+		metrics_flush(m);
+	}
+	metrics_flush(m);
+	return (NULL);
+}
+
+/**
+ * @brief Sets up the aggregation tables and starts the flusher thread.
+ *
+ * @param m The aggregation.
+ * @param interval_ms Time between flushes.
+ * @param writer Where aggregates are written.
+ *
+ * @note Exits with an error message if a resource cannot be obtained.
+ *
+ * @ingroup server
+ */
+void metrics_start(t_metrics* m, long interval_ms, t_writer* writer)
+{
+	sigset_t all;
+	sigset_t old;
+
+	memset(m, 0, sizeof(*m));
+	m->interval_ms = interval_ms;
+	m->writer      = writer;
+	atomic_flag_clear(&m->lock);
+	region_map(&m->mem, 2 * MT_METRICS_SLOTS * sizeof(t_metric), false);
+	m->tables[0] = m->mem.addr;
+	m->tables[1] = m->tables[0] + MT_METRICS_SLOTS;
+	if (sem_init(&m->wake, 0, 0) == -1)
+		sys_error("Server: metrics setup failed");
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	if (pthread_create(&m->thread, NULL, metrics_main, m) != 0)
+		sys_error("Server: cannot start metrics thread");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief Flushes what was aggregated since the last interval and stops
+ * the flusher thread.
+ *
+ * Must be called before the writer is stopped, with the sessions quiet.
+ *
+ * @param m The aggregation.
+ *
+ * @ingroup server
+ */
+void metrics_stop(t_metrics* m)
+{
+	atomic_store(&m->stop, true);
+	sem_post(&m->wake);
+	pthread_join(m->thread, NULL);
+	sem_destroy(&m->wake);
+	region_unmap(&m->mem);
+	m->tables[0] = NULL;
+	m->tables[1] = NULL;
+}
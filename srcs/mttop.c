@@ -0,0 +1,381 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mttop.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 23:24:51 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 23:24:51 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file mttop.c
+ * @brief Live dashboard of a running server.
+ *
+ * @details
+ * Maps the stats page of a server started with `-m` and redraws, at each
+ * interval, the rates of signals, bytes and messages over the last
+ * interval, the sessions, the percentiles of the acknowledgment time and
+ * of the message duration over the last interval, the output queue and
+ * the clients with the most traffic. Only the stats page is read, so the
+ * server is not disturbed however often it refreshes.
+ *
+ * On a terminal the screen is redrawn in place; otherwise each refresh is
+ * printed after the previous one, for logs. Stops on Ctrl-C, after `-n`
+ * refreshes, or when the server exits.
+ *
+ * Usage: ./mttop [-i interval_ms] [-n refreshes] <PID>
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup stats
+ */
+#include "minitalk.h"
+#include <getopt.h>
+
+/** Clients listed on the dashboard. */
+#define MT_TOP_CLIENTS 10
+
+/** Set by SIGINT and SIGTERM to leave the refresh loop. */
+static volatile sig_atomic_t g_stop = 0;
+
+/**
+ * @brief Asks the refresh loop to stop.
+ *
+ * @param sig Unused.
+ *
+ * @ingroup stats
+ */
+static void stop_handler(int sig)
+{
+	(void) sig;
+	g_stop = 1;
+}
+
+/**
+ * @brief Estimates a percentile from a log2 histogram.
+ *
+ * The value is interpolated linearly inside the bucket it falls in.
+ *
+ * @param h The histogram, bucket i holding values below 2^(i+1).
+ * @param q The percentile, between 0 and 1.
+ * @return The estimate, or -1 if the histogram is empty.
+ *
+ * @ingroup stats
+ */
+static double percentile(const uint64_t* h, double q)
+{
+	uint64_t total;
+	double   rank;
+	double   low;
+	double   width;
+	double   seen;
+	size_t   i;
+
+	total = 0;
+	i     = 0;
+	while (i < MT_STATS_BUCKETS)
+		total += h[i++];
+	if (total == 0)
+		return (-1);
+	rank = q * total;
+	seen = 0;
+	i    = 0;
+	while (i < MT_STATS_BUCKETS - 1 && seen + h[i] < rank)
+		seen += h[i++];
+	low   = 0;
+	width = 2;
+	if (i > 0)
+	{
+		low   = (double) (1UL << i);
+		width = low;
+	}
+	if (h[i] == 0)
+		return (low);
+	return (low + width * (rank - seen) / h[i]);
+}
+
+/**
+ * @brief Formats a duration given in nanoseconds with a readable unit.
+ *
+ * @param buf Buffer of at least 16 bytes.
+ * @param ns The duration, or a negative value for none.
+ * @return `buf`.
+ *
+ * @ingroup stats
+ */
+static const char* fmt_time(char* buf, double ns)
+{
+	if (ns < 0)
+		snprintf(buf, 16, "-");
+	else if (ns < 1e3)
+		snprintf(buf, 16, "%.0f ns", ns);
+	else if (ns < 1e6)
+		snprintf(buf, 16, "%.1f us", ns / 1e3);
+	else if (ns < 1e9)
+		snprintf(buf, 16, "%.1f ms", ns / 1e6);
+	else
+		snprintf(buf, 16, "%.2f s", ns / 1e9);
+	return (buf);
+}
+
+/**
+ * @brief Formats a percentile of a histogram as a duration.
+ *
+ * @param buf Buffer of at least 16 bytes.
+ * @param h The histogram.
+ * @param q The percentile, between 0 and 1.
+ * @param scale Nanoseconds per unit of the histogram.
+ * @return `buf`.
+ *
+ * @ingroup stats
+ */
+static const char* fmt_percentile(char* buf, const uint64_t* h, double q,
+								  double scale)
+{
+	double v;
+
+	v = percentile(h, q);
+	if (v >= 0)
+		v *= scale;
+	return (fmt_time(buf, v));
+}
+
+/**
+ * @brief Prints the percentiles of a histogram.
+ *
+ * @param label Name of the measure.
+ * @param h The histogram.
+ * @param scale Nanoseconds per unit of the histogram.
+ *
+ * @ingroup stats
+ */
+static void print_percentiles(const char* label, const uint64_t* h,
+							  double scale)
+{
+	char p50[16];
+	char p90[16];
+	char p99[16];
+
+	printf("%-16s p50 %-10s p90 %-10s p99 %s\n", label,
+		   fmt_percentile(p50, h, 0.50, scale),
+		   fmt_percentile(p90, h, 0.90, scale),
+		   fmt_percentile(p99, h, 0.99, scale));
+}
+
+/**
+ * @brief Finds a client in the previous view.
+ *
+ * @return Its entry, or NULL if it was not there.
+ *
+ * @ingroup stats
+ */
+static const t_stats_client* find_client(const t_stats_view* v, int32_t pid)
+{
+	size_t i;
+
+	i = 0;
+	while (i < v->nclients)
+	{
+		if (v->clients[i].pid == pid)
+			return (&v->clients[i]);
+		i++;
+	}
+	return (NULL);
+}
+
+/**
+ * @brief Prints the clients that sent the most bytes over the interval.
+ *
+ * A client that appeared or was reset since the previous view counts
+ * from zero.
+ *
+ * @param cur The current view.
+ * @param prev The previous view.
+ * @param secs Length of the interval, in seconds.
+ *
+ * @ingroup stats
+ */
+static void print_clients(const t_stats_view* cur, const t_stats_view* prev,
+						  double secs)
+{
+	const t_stats_client* old;
+	uint64_t              delta[MT_STATS_LANES * MT_STATS_CLIENTS];
+	bool                  shown[MT_STATS_LANES * MT_STATS_CLIENTS];
+	size_t                best;
+	size_t                n;
+	size_t                i;
+
+	i = 0;
+	while (i < cur->nclients)
+	{
+		old      = find_client(prev, cur->clients[i].pid);
+		delta[i] = cur->clients[i].bytes;
+		if (old && old->bytes <= cur->clients[i].bytes)
+			delta[i] -= old->bytes;
+		shown[i++] = false;
+	}
+	printf("\n%-10s %12s %14s %10s\n", "CLIENT", "BYTES/S", "BYTES",
+		   "MESSAGES");
+	n = 0;
+	while (n < MT_TOP_CLIENTS && n < cur->nclients)
+	{
+		best = cur->nclients;
+		i    = 0;
+		while (i < cur->nclients)
+		{
+			if (!shown[i] && (best == cur->nclients || delta[i] > delta[best]
+							  || (delta[i] == delta[best]
+								  && cur->clients[i].bytes
+										 > cur->clients[best].bytes)))
+				best = i;
+			i++;
+		}
+		shown[best] = true;
+		printf("%-10d %12.0f %14lu %10u\n", (int) cur->clients[best].pid,
+			   delta[best] / secs, (unsigned long) cur->clients[best].bytes,
+			   cur->clients[best].messages);
+		n++;
+	}
+}
+
+/**
+ * @brief Draws one refresh of the dashboard.
+ *
+ * @param pid PID of the server.
+ * @param page Its stats page.
+ * @param cur The current view.
+ * @param prev The view of the previous refresh.
+ * @param secs Time since the previous refresh, in seconds.
+ *
+ * @ingroup stats
+ */
+static void draw(pid_t pid, const t_stats_page* page, const t_stats_view* cur,
+				 const t_stats_view* prev, double secs)
+{
+	const t_stats_lane*   c;
+	const t_stats_lane*   p;
+	const t_stats_output* o;
+	uint64_t              ack[MT_STATS_BUCKETS];
+	uint64_t              msg[MT_STATS_BUCKETS];
+	size_t                i;
+
+	c = &cur->total;
+	p = &prev->total;
+	o = &cur->output;
+	i = 0;
+	while (i < MT_STATS_BUCKETS)
+	{
+		ack[i] = c->ack_ns[i] - p->ack_ns[i];
+		msg[i] = c->msg_us[i] - p->msg_us[i];
+		i++;
+	}
+	printf("mttop - server %d, up %lds, refreshed every %.1fs\n\n", (int) pid,
+		   (long) (time(NULL) - page->started), secs);
+	printf("%-16s %12.0f/s %14lu total\n", "signals", (c->signals - p->signals)
+		   / secs, (unsigned long) c->signals);
+	printf("%-16s %12.0f/s %14lu total\n", "bytes", (c->bytes - p->bytes)
+		   / secs, (unsigned long) c->bytes);
+	printf("%-16s %12.1f/s %14lu total\n", "messages",
+		   (c->messages - p->messages) / secs, (unsigned long) c->messages);
+	printf("%-16s %12lu now   %12lu opened, %lu aborted, %lu rejected\n",
+		   "sessions", (unsigned long) c->active, (unsigned long) c->sessions,
+		   (unsigned long) c->aborted, (unsigned long) c->rejected);
+	printf("\n");
+	print_percentiles("ack time", ack, 1);
+	print_percentiles("message time", msg, 1e3);
+	printf("\n%-16s %12lu/%lu   peak %lu, %lu written, %lu dropped, "
+		   "%lu spilled, %lu waited\n",
+		   "output queue", (unsigned long) o->depth,
+		   (unsigned long) o->capacity, (unsigned long) o->max_depth,
+		   (unsigned long) o->written, (unsigned long) o->dropped,
+		   (unsigned long) o->spilled, (unsigned long) o->blocked);
+	print_clients(cur, prev, secs);
+}
+
+/**
+ * @brief Entry point of the dashboard.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS once stopped, EXIT_FAILURE if the server has no
+ * stats page or it cannot be read.
+ *
+ * @ingroup stats
+ */
+int main(int argc, char** argv)
+{
+	static t_stats_view view[2];
+	const t_stats_page* page;
+	struct sigaction    sa;
+	struct timespec     tick;
+	long                interval_ms;
+	long                count;
+	long                last;
+	long                now;
+	pid_t               pid;
+	bool                tty;
+	int                 cur;
+	int                 opt;
+
+	interval_ms = 1000;
+	count       = -1;
+	while ((opt = getopt(argc, argv, "i:n:")) != -1)
+	{
+		if (opt == 'i')
+			interval_ms = atol(optarg);
+		else if (opt == 'n')
+			count = atol(optarg);
+		else
+			break;
+	}
+	if (opt != -1 || optind != argc - 1 || interval_ms <= 0 || count == 0)
+	{
+		fprintf(stderr, "Usage: ./mttop [-i interval_ms] [-n refreshes] "
+						"<PID>\n");
+		return (EXIT_FAILURE);
+	}
+	pid  = get_server_pid_from_input(argv + optind - 1);
+	page = stats_attach(pid);
+	if (!page)
+	{
+		fprintf(stderr, "Error: no stats page for PID %d (start the server "
+						"with -m).\n", (int) pid);
+		return (EXIT_FAILURE);
+	}
+	sa.sa_handler = stop_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	tty  = isatty(STDOUT_FILENO);
+	tick = (struct timespec){interval_ms / 1000, interval_ms % 1000 * 1000000};
+	cur  = 0;
+	last = stats_now_ns();
+	if (!stats_read(page, &view[cur]))
+		sys_error("mttop: cannot read the stats page");
+	while (!g_stop && count != 0)
+	{
+		nanosleep(&tick, NULL);
+		if (g_stop || kill(pid, 0) == -1)
+			break;
+		now = stats_now_ns();
+		cur = !cur;
+		if (!stats_read(page, &view[cur]))
+			sys_error("mttop: cannot read the stats page");
+		if (tty)
+			printf("\033[H\033[J");
+		draw(pid, page, &view[cur], &view[!cur], (now - last) / 1e9);
+		if (!tty)
+			printf("\n");
+		fflush(stdout);
+		last = now;
+		if (count > 0)
+			count--;
+	}
+	if (!g_stop && count != 0)
+		fprintf(stderr, "mttop: server %d exited.\n", (int) pid);
+	return (EXIT_SUCCESS);
+}
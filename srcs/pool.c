@@ -0,0 +1,495 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pool.c                                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 20:34:52 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 20:34:52 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file pool.c
+ * @brief Work-stealing pool processing reassembled output.
+ *
+ * @details
+ * When the pool runs, every chunk a session flushes becomes a task, going
+ * through the processing step if one is enabled, and so does per-message
+ * work too slow for the signal handler. The task goes to the deque of one
+ * pool thread, chosen by client, and any idle thread steals from the
+ * others, so one expensive chunk only holds up the thread running it.
+ * Results are handed to the writer in the order each client sent them:
+ * tasks are numbered per client and a result that is ready early is
+ * parked until its predecessors have been written.
+ *
+ * Submission only uses spin locks and `sem_post()`, so sessions can submit
+ * from a signal handler; it waits for a free task when all are in use.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+
+/**
+ * @brief Acquires a spin lock.
+ *
+ * @param lock The lock.
+ *
+ * @ingroup server
+ */
+static void spin_lock(atomic_flag* lock)
+{
+	while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+		cpu_relax();
+}
+
+/**
+ * @brief Releases a spin lock.
+ *
+ * @param lock The lock.
+ *
+ * @ingroup server
+ */
+static void spin_unlock(atomic_flag* lock)
+{
+	atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+/**
+ * @brief Rewrites control characters as `\xHH` escapes.
+ *
+ * Newlines and tabs are kept, as are bytes of 0x80 and above so that
+ * UTF-8 text goes through unchanged.
+ *
+ * @param in Chunk to process.
+ * @param len Length of the chunk.
+ * @param out Buffer of `MT_TASK_OUTPUT` bytes.
+ * @return Length of the result.
+ *
+ * @ingroup server
+ */
+size_t task_escape(const char* in, size_t len, char* out)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char     c;
+	size_t            n;
+	size_t            i;
+
+	n = 0;
+	i = 0;
+	while (i < len)
+	{
+		c = (unsigned char) in[i++];
+		if ((c >= 0x20 && c != 0x7f) || c == '\n' || c == '\t')
+			out[n++] = c;
+		else
+		{
+			out[n++] = '\\';
+			out[n++] = 'x';
+			out[n++] = hex[c >> 4];
+			out[n++] = hex[c & 0xf];
+		}
+	}
+	return (n);
+}
+
+/**
+ * @brief Takes a free task, waiting for one if all are in use.
+ *
+ * @param pool The pool.
+ * @return The task.
+ *
+ * @ingroup server
+ */
+static t_task* task_alloc(t_pool* pool)
+{
+	t_task* t;
+
+	while (true)
+	{
+		spin_lock(&pool->lock);
+		t = pool->free;
+		if (t)
+			pool->free = t->next;
+		spin_unlock(&pool->lock);
+		if (t)
+			return (t);
+		cpu_relax();
+	}
+}
+
+/**
+ * @brief Returns a task to the free list.
+ *
+ * @param pool The pool.
+ * @param t The task.
+ *
+ * @ingroup server
+ */
+static void task_free(t_pool* pool, t_task* t)
+{
+	spin_lock(&pool->lock);
+	t->next    = pool->free;
+	pool->free = t;
+	spin_unlock(&pool->lock);
+	atomic_fetch_sub(&pool->pending, 1);
+}
+
+/**
+ * @brief Finds the stream of a client, or claims an idle one for it.
+ *
+ * @param pool The pool, with its lock held.
+ * @param pid The client PID.
+ * @return The stream, or NULL if every stream is busy.
+ *
+ * @ingroup server
+ */
+static t_stream* stream_get(t_pool* pool, pid_t pid)
+{
+	t_stream* idle;
+	t_stream* st;
+	size_t    i;
+
+	idle = NULL;
+	i    = 0;
+	while (i < MT_POOL_TASKS)
+	{
+		st = &pool->streams[i++];
+		if (st->pid == pid)
+			return (st);
+		if (idle)
+			continue;
+		spin_lock(&st->lock);
+		if (!st->emitting && st->next_out == st->next_seq)
+			idle = st;
+		spin_unlock(&st->lock);
+	}
+	if (idle)
+		idle->pid = pid;
+	return (idle);
+}
+
+/**
+ * @brief Writes out the completed tasks of a stream, in order.
+ *
+ * @details
+ * Parks `t` under its sequence number. Unless another thread is already
+ * writing for this stream, then writes every task from `next_out` on that
+ * is ready, releasing the stream lock around each write.
+ *
+ * @param pool The pool.
+ * @param t A task just processed.
+ *
+ * @ingroup server
+ */
+static void stream_emit(t_pool* pool, t_task* t)
+{
+	t_stream* st;
+	t_task*   next;
+	size_t    done;
+	size_t    n;
+
+	st = t->stream;
+	spin_lock(&st->lock);
+	st->parked[t->seq % MT_POOL_TASKS] = t;
+	if (t->seq != st->next_out)
+		atomic_fetch_add(&pool->parked, 1);
+	if (st->emitting)
+	{
+		spin_unlock(&st->lock);
+		return;
+	}
+	st->emitting = true;
+	while ((next = st->parked[st->next_out % MT_POOL_TASKS])
+		   && next->seq == st->next_out)
+	{
+		st->parked[st->next_out % MT_POOL_TASKS] = NULL;
+		spin_unlock(&st->lock);
+		done = 0;
+		while (done < next->out_len)
+		{
+			n = next->out_len - done;
+			if (n > MT_SESSION_BUFFER)
+				n = MT_SESSION_BUFFER;
+			writer_push(pool->writer, next->out + done, n);
+			done += n;
+		}
+		task_free(pool, next);
+		spin_lock(&st->lock);
+		st->next_out++;
+	}
+	st->emitting = false;
+	spin_unlock(&st->lock);
+}
+
+/**
+ * @brief Takes the oldest task of a thread's own deque.
+ *
+ * @param d The deque.
+ * @return The task, or NULL if the deque is empty.
+ *
+ * @ingroup server
+ */
+static t_task* deque_pop(t_deque* d)
+{
+	t_task* t;
+
+	t = NULL;
+	spin_lock(&d->lock);
+	if (d->head != d->tail)
+		t = d->items[d->head++ % MT_POOL_TASKS];
+	spin_unlock(&d->lock);
+	return (t);
+}
+
+/**
+ * @brief Steals the newest task of another thread's deque.
+ *
+ * @param d The deque.
+ * @return The task, or NULL if the deque is empty.
+ *
+ * @ingroup server
+ */
+static t_task* deque_steal(t_deque* d)
+{
+	t_task* t;
+
+	t = NULL;
+	spin_lock(&d->lock);
+	if (d->head != d->tail)
+		t = d->items[--d->tail % MT_POOL_TASKS];
+	spin_unlock(&d->lock);
+	return (t);
+}
+
+/**
+ * @brief Finds a task for a pool thread: its own first, then a stolen one.
+ *
+ * @param pool The pool.
+ * @param self Index of the thread.
+ * @return The task, or NULL if every deque is empty.
+ *
+ * @ingroup server
+ */
+static t_task* pool_take(t_pool* pool, size_t self)
+{
+	t_task* t;
+	size_t  i;
+
+	t = deque_pop(&pool->deques[self]);
+	i = 1;
+	while (!t && i < pool->count)
+	{
+		t = deque_steal(&pool->deques[(self + i) % pool->count]);
+		if (t)
+			atomic_fetch_add(&pool->stolen, 1);
+		i++;
+	}
+	return (t);
+}
+
+/**
+ * @brief Does the work of a task.
+ *
+ * @param pool The pool.
+ * @param t The task.
+ * @return Length of the output it leaves in `t->out`.
+ *
+ * @ingroup server
+ */
+static size_t task_run(t_pool* pool, t_task* t)
+{
+	size_t len;
+
+	if (t->kind == MT_TASK_JSON)
+	{
+		tapes_index(pool->tapes, t->stream->pid, t->in, t->len);
+		return (0);
+	}
+	len = t->len;
+	if (t->kind == MT_TASK_METRICS)
+		metrics_ingest(pool->metrics, t->in, t->len, &len);
+	if (pool->fn)
+		return (pool->fn(t->in, len, t->out));
+	memcpy(t->out, t->in, len);
+	return (len);
+}
+
+/**
+ * @brief Body of a pool thread.
+ *
+ * @details
+ * Each post of `items` stands for one submitted task, which may be found
+ * in any deque. Once stopping, the thread exits when no task is left.
+ *
+ * @param arg The thread's own deque.
+ * @return Always NULL.
+ *
+ * @ingroup server
+ */
+static void* pool_main(void* arg)
+{
+	t_pool* pool;
+	t_task* t;
+	size_t  self;
+
+	pool = ((t_deque*) arg)->owner;
+	self = (t_deque*) arg - pool->deques;
+	while (true)
+	{
+		while (sem_wait(&pool->items) == -1)
+			if (errno != EINTR)
+				sys_error("Server: pool wait failed");
+		while (!(t = pool_take(pool, self)))
+		{
+			if (atomic_load(&pool->stop))
+				return (NULL);
+			cpu_relax();
+		}
+		t->out_len = task_run(pool, t);
+		atomic_fetch_add(&pool->tasks, 1);
+		stream_emit(pool, t);
+	}
+}
+
+/**
+ * @brief Allocates the tasks and starts the pool threads.
+ *
+ * @param pool The pool to initialise.
+ * @param threads Number of threads, at most `MT_MAX_POOL`.
+ * @param writer Queue receiving the processed chunks.
+ * @param fn Processing step for output chunks, or NULL to pass them on
+ * unchanged.
+ *
+ * @note Exits with an error message if a thread cannot be started.
+ *
+ * @ingroup server
+ */
+void pool_start(t_pool* pool, size_t threads, t_writer* writer, t_task_fn fn)
+{
+	t_task*  tasks;
+	sigset_t all;
+	sigset_t old;
+	size_t   i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->count  = threads;
+	pool->writer = writer;
+	pool->fn     = fn;
+	atomic_flag_clear(&pool->lock);
+	region_map(&pool->mem, MT_POOL_TASKS * sizeof(t_task), false);
+	tasks = pool->mem.addr;
+	i     = MT_POOL_TASKS;
+	while (i-- > 0)
+	{
+		tasks[i].next = pool->free;
+		pool->free    = &tasks[i];
+		atomic_flag_clear(&pool->streams[i].lock);
+	}
+	if (sem_init(&pool->items, 0, 0) == -1)
+		sys_error("Server: pool setup failed");
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	i = 0;
+	while (i < threads)
+	{
+		atomic_flag_clear(&pool->deques[i].lock);
+		pool->deques[i].owner = pool;
+		if (pthread_create(&pool->threads[i], NULL, pool_main,
+						   &pool->deques[i])
+			!= 0)
+			sys_error("Server: cannot start pool thread");
+		i++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief Queues work on a chunk of a client's data.
+ *
+ * @details
+ * The task is numbered in the client's stream and queued on the deque of
+ * the thread that stream maps to, so whatever output it produces is
+ * written in the order the client sent its data.
+ *
+ * @param pool The pool.
+ * @param pid The client PID.
+ * @param kind Work to do on the chunk.
+ * @param buf Chunk to process.
+ * @param len Length of the chunk, at most `MT_SESSION_BUFFER`.
+ *
+ * @ingroup server
+ */
+void pool_submit(t_pool* pool, pid_t pid, t_task_kind kind, const char* buf,
+				 size_t len)
+{
+	t_stream* st;
+	t_deque*  d;
+	t_task*   t;
+
+	if (len == 0)
+		return;
+	t = task_alloc(pool);
+	memcpy(t->in, buf, len);
+	t->len  = len;
+	t->kind = kind;
+	atomic_fetch_add(&pool->pending, 1);
+	while (true)
+	{
+		spin_lock(&pool->lock);
+		st = stream_get(pool, pid);
+		if (st)
+			t->seq = st->next_seq++;
+		spin_unlock(&pool->lock);
+		if (st)
+			break;
+		cpu_relax();
+	}
+	t->stream = st;
+	d         = &pool->deques[(st - pool->streams) % pool->count];
+	spin_lock(&d->lock);
+	d->items[d->tail++ % MT_POOL_TASKS] = t;
+	spin_unlock(&d->lock);
+	sem_post(&pool->items);
+}
+
+/**
+ * @brief Waits until every submitted chunk has reached the writer.
+ *
+ * @param pool The pool.
+ *
+ * @ingroup server
+ */
+void pool_sync(t_pool* pool)
+{
+	const struct timespec tick = {0, 1000000};
+
+	while (atomic_load(&pool->pending) > 0)
+		nanosleep(&tick, NULL);
+}
+
+/**
+ * @brief Processes what is left, then stops the threads.
+ *
+ * @param pool The pool.
+ *
+ * @ingroup server
+ */
+void pool_stop(t_pool* pool)
+{
+	size_t i;
+
+	atomic_store(&pool->stop, true);
+	i = 0;
+	while (i++ < pool->count)
+		sem_post(&pool->items);
+	i = 0;
+	while (i < pool->count)
+		pthread_join(pool->threads[i++], NULL);
+	sem_destroy(&pool->items);
+	region_unmap(&pool->mem);
+}
@@ -0,0 +1,135 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   region.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 18:02:11 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 18:02:11 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file region.c
+ * @brief Pre-faulted memory regions, backed by huge pages when asked.
+ *
+ * @details
+ * Large buffers on the data path are mapped here rather than taken from
+ * `malloc()`, so that every page is faulted in at startup instead of on
+ * first use under load. With huge pages requested, explicit `MAP_HUGETLB`
+ * pages are tried first; if none are reserved, the region is aligned on a
+ * huge page boundary and advised for transparent huge pages; if that is
+ * not available either, normal pages are used.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <sys/mman.h>
+
+/**
+ * @brief Maps an anonymous region of transparent huge pages.
+ *
+ * @details
+ * Over-allocates by one huge page so that the start can be aligned, then
+ * trims both ends.
+ *
+ * @param r The region; `len` must be a multiple of `MT_HUGE_PAGE_SIZE`.
+ * @return true on success, false if the mapping or the advice failed.
+ *
+ * @ingroup server
+ */
+static bool region_map_thp(t_region* r)
+{
+	char*     raw;
+	uintptr_t start;
+	size_t    head;
+
+	raw = mmap(NULL, r->len + MT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		return (false);
+	start = ((uintptr_t) raw + MT_HUGE_PAGE_SIZE - 1)
+			& ~(MT_HUGE_PAGE_SIZE - 1);
+	head  = start - (uintptr_t) raw;
+	if (head > 0)
+		munmap(raw, head);
+	munmap((char*) start + r->len, MT_HUGE_PAGE_SIZE - head);
+	r->addr = (void*) start;
+	if (madvise(r->addr, r->len, MADV_HUGEPAGE) == -1)
+	{
+		munmap(r->addr, r->len);
+		return (false);
+	}
+	memset(r->addr, 0, r->len);
+	return (true);
+}
+
+/**
+ * @brief Maps a zeroed, pre-faulted region of at least `size` bytes.
+ *
+ * @param r The region to fill in.
+ * @param size Number of bytes needed.
+ * @param huge Whether to try huge pages first.
+ *
+ * @note Exits with an error message if no memory can be mapped at all.
+ *
+ * @ingroup server
+ */
+void region_map(t_region* r, size_t size, bool huge)
+{
+	r->len  = size;
+	r->kind = MT_PAGES_SMALL;
+	if (huge)
+	{
+		r->len  = (size + MT_HUGE_PAGE_SIZE - 1) & ~(MT_HUGE_PAGE_SIZE - 1);
+		r->addr = mmap(NULL, r->len, PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+					   -1, 0);
+		r->kind = MT_PAGES_HUGETLB;
+		if (r->addr != MAP_FAILED)
+			return;
+		r->kind = MT_PAGES_THP;
+		if (region_map_thp(r))
+			return;
+		r->len  = size;
+		r->kind = MT_PAGES_SMALL;
+	}
+	r->addr = mmap(NULL, r->len, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (r->addr == MAP_FAILED)
+		sys_error("Server: cannot map memory");
+}
+
+/**
+ * @brief Names the kind of pages backing a region.
+ *
+ * @param r The region.
+ * @return `"hugetlb"`, `"thp"` or `"4k"`.
+ *
+ * @ingroup server
+ */
+const char* region_pages(const t_region* r)
+{
+	if (r->kind == MT_PAGES_HUGETLB)
+		return ("hugetlb");
+	if (r->kind == MT_PAGES_THP)
+		return ("thp");
+	return ("4k");
+}
+
+/**
+ * @brief Unmaps a region.
+ *
+ * @param r The region; its address is cleared.
+ *
+ * @ingroup server
+ */
+void region_unmap(t_region* r)
+{
+	if (r->addr)
+		munmap(r->addr, r->len);
+	r->addr = NULL;
+}
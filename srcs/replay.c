@@ -0,0 +1,181 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   replay.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 11:32:08 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 11:32:08 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file replay.c
+ * @brief Feeds a recorded signal trace through the decoder at full speed.
+ *
+ * @details
+ * The replay tool loads a trace written by `./server -r`, then pushes
+ * every recorded signal through the same decoder and output path as the
+ * server, without any signal delivery in between. This isolates decoder
+ * and output throughput from the kernel and reproduces recorded traffic
+ * patterns locally.
+ *
+ * Records are demultiplexed by sender PID into a session table, exactly
+ * like the server does. Decoded output goes to standard output, or to
+ * `/dev/null` when `-n` is given. Timing figures are printed on standard
+ * error.
+ *
+ * Usage: ./replay [-n] [-i iterations] <trace_file>
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup trace
+ */
+#include "minitalk.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Loads every record of a trace file into memory.
+ *
+ * @param path Path of the trace file.
+ * @param count Set to the number of records loaded.
+ * @return The records, allocated with malloc.
+ *
+ * @note Exits with an error message if the file cannot be read or is not
+ * a trace.
+ *
+ * @ingroup trace
+ */
+static t_trace_record* load_trace(const char* path, size_t* count)
+{
+	t_trace_record* recs;
+	struct stat     st;
+	size_t          size;
+	int             fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) == -1)
+		sys_error("Replay: cannot open trace file");
+	if (!trace_check_header(fd))
+	{
+		fprintf(stderr, "Error: %s is not a minitalk trace.\n", path);
+		exit(EXIT_FAILURE);
+	}
+	*count = ((size_t) st.st_size - 8) / sizeof(t_trace_record);
+	size   = *count * sizeof(t_trace_record);
+	recs   = malloc(size + 1);
+	if (!recs || read(fd, recs, size) != (ssize_t) size)
+		sys_error("Replay: cannot read trace file");
+	close(fd);
+	return (recs);
+}
+
+/**
+ * @brief Decodes every record of a trace once.
+ *
+ * @param recs The recorded signals.
+ * @param count Number of records.
+ * @param out_fd Descriptor receiving the decoded messages.
+ * @return Number of bytes written, message separators included.
+ *
+ * @note Sessions left unfinished at the end of the trace are aborted and
+ * their partial content written.
+ *
+ * @ingroup trace
+ */
+static size_t replay_once(const t_trace_record* recs, size_t count,
+						  int out_fd)
+{
+	static t_sessions table;
+	t_session*        s;
+	size_t            i;
+	int               frame;
+
+	sessions_init(&table, out_fd);
+	i = 0;
+	while (i < count)
+	{
+		frame = -1;
+		if (recs[i].code == SI_QUEUE)
+			frame = recs[i].value & MT_FRAME_VALUE;
+		s = session_open(&table, recs[i].pid, frame, true);
+		if (s)
+			session_frame(&table, s, recs[i].sig, frame);
+		i++;
+	}
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table.slots[i].pid != 0)
+			session_abort(&table, &table.slots[i], false);
+		i++;
+	}
+	return (table.stats.bytes);
+}
+
+/**
+ * @brief Entry point of the replay tool.
+ *
+ * Replays the trace the requested number of times and reports the
+ * recorded duration next to the replay duration, along with the decode
+ * throughput.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS on success, or exits with error otherwise.
+ *
+ * @ingroup trace
+ */
+int main(int argc, char** argv)
+{
+	t_trace_record* recs;
+	struct timespec start;
+	struct timespec end;
+	size_t          count;
+	size_t          bytes;
+	long            iterations;
+	long            i;
+	int             out_fd;
+	int             opt;
+	double          ns;
+
+	out_fd     = STDOUT_FILENO;
+	iterations = 1;
+	while ((opt = getopt(argc, argv, "ni:")) != -1)
+	{
+		if (opt == 'n')
+			out_fd = open("/dev/null", O_WRONLY);
+		else if (opt == 'i')
+			iterations = atol(optarg);
+		else
+			break;
+	}
+	if (opt != -1 || optind != argc - 1 || iterations < 1 || out_fd == -1)
+	{
+		fprintf(stderr, "Usage: ./replay [-n] [-i iterations] <trace_file>\n");
+		return (EXIT_FAILURE);
+	}
+	recs  = load_trace(argv[optind], &count);
+	bytes = 0;
+	i     = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (i++ < iterations)
+		bytes += replay_once(recs, count, out_fd);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	fprintf(stderr, "signals:           %zu\n", count * iterations);
+	fprintf(stderr, "bytes:             %zu\n", bytes);
+	if (count > 0)
+		fprintf(stderr, "recorded_s:        %.6f\n",
+				(recs[count - 1].ns - recs[0].ns) / 1e9);
+	fprintf(stderr, "replay_s:          %.6f\n", ns / 1e9);
+	if (bytes > 0)
+		fprintf(stderr, "ns_per_byte:       %.2f\n", ns / bytes);
+	if (count > 0)
+		fprintf(stderr, "ns_per_signal:     %.2f\n", ns / (count * iterations));
+	free(recs);
+	return (EXIT_SUCCESS);
+}
@@ -16,17 +16,24 @@
  *
  * The server listens for `SIGUSR1` and `SIGUSR2` signals representing
  * binary 1 and 0. It reconstructs each character from the received bits and
- * prints the message to standard output. An acknowledgment signal is sent
+ * prints each message to standard output. An acknowledgment signal is sent
  * back to the client after each bit.
  *
- * This server resets its internal state once it receives a null terminator.
- * It supports communication from one client at a time.
+ * Each client gets its own session, so several clients can send at the
+ * same time; a session ends when its null terminator arrives. On `SIGTERM`
+ * or `SIGINT` the server stops accepting new sessions, gives the active
+ * ones a grace period to finish, flushes everything and prints a summary.
+ *
+ * Completed output is queued for a writer thread (see writer.c) rather
+ * than written from the signal handler.
  *
  * @author nlouis
  * @date 2024/12/14
  * @ingroup server
  */
 #include "minitalk.h"
+#include <errno.h>
+#include <sched.h>
 
 /**
  * @brief Stores the PID of the client currently communicating with the server.
@@ -44,107 +51,194 @@
 volatile sig_atomic_t g_client_pid = 0;
 
 /**
- * @brief Processes a single received signal and updates the current character.
+ * @brief Shutdown request set by `SIGTERM` or `SIGINT`.
+ *
+ * 0 while running, 1 once a shutdown was requested (new sessions are
+ * refused and active ones drain), 2 if a second request asks to skip the
+ * remaining grace period.
  *
- * This function modifies the character `c` by setting or clearing a specific
- * bit depending on the received signal (`SIGUSR1` or `SIGUSR2`). The `bit`
- * index is decremented after each update to prepare for the next incoming bit.
+ * @ingroup server
+ */
+volatile sig_atomic_t g_shutdown = 0;
+
+/**
+ * @brief PID of a new server that asked to take over, or 0.
  *
- * @param sig The received signal. `SIGUSR1` represents bit 1, `SIGUSR2` bit 0.
- * @param bit A pointer to the current bit index (starting from 7 to 0).
- * @param c A pointer to the character being constructed bit by bit.
+ * Set by `control_handler` and acted upon by the main loop.
  *
  * @ingroup server
  */
-static void handle_received_bit(int sig, int* bit, char* c)
-{
-	if (sig == SIGUSR1)
-		*c |= (1 << *bit); // Set bit to 1
-	else
-		*c &= ~(1 << *bit); // Set bit to 0
-	(*bit)--;
-}
+volatile sig_atomic_t g_handoff_pid = 0;
+
+/**
+ * @brief Trace recorder for received signals, disabled unless `-r` is given.
+ *
+ * Only touched from the signal handler once the handlers are installed,
+ * which never nests since both signals are masked while it runs.
+ *
+ * @ingroup server
+ */
+t_trace g_trace = {.fd = -1};
+
+/**
+ * @brief Sessions of the clients currently sending a message.
+ *
+ * Updated by the signal handler; the main loop only touches it with
+ * `SIGUSR1` and `SIGUSR2` blocked.
+ *
+ * @ingroup server
+ */
+t_sessions g_sessions;
+
+/**
+ * @brief Output queue and writer thread fed by the session table.
+ *
+ * @ingroup server
+ */
+t_writer g_writer;
+
+/**
+ * @brief Session worker threads, when started with `-j`.
+ *
+ * @ingroup server
+ */
+t_shards g_shards;
+
+/**
+ * @brief Processing pool the output goes through, when enabled with `-e`.
+ *
+ * @ingroup server
+ */
+t_pool g_pool;
+
+/**
+ * @brief Aggregation of metric lines, when enabled with `-A`.
+ *
+ * @ingroup server
+ */
+t_metrics g_metrics;
+
+/**
+ * @brief Indexing of JSON messages, when enabled with `-J`.
+ *
+ * @ingroup server
+ */
+t_tapes g_tapes;
 
 /**
- * @brief Processes a fully received character and resets bit tracking.
+ * @brief Processes one data signal received from a client.
  *
- * This function is called when all 8 bits of a character have been received.
- * If the character is a null terminator (`'\0'`), it indicates the end of the
- * message and prints a newline. Otherwise, it prints the character to the
- * standard output. After processing, it resets the bit index and character
- * for the next incoming byte.
+ * It records the signal when tracing and serves it from the session table
+ * of the server, as a numbered frame if it was sent with `sigqueue()`, or
+ * forwards it to the worker owning the client when session workers run.
+ * While the server is shutting down, clients without a session are
+ * refused; see session_serve().
  *
- * @param c Pointer to the character that has been constructed from bits.
- * @param bit Pointer to the current bit index; reset to 7 after processing.
+ * The client's PID is extracted from the `siginfo_t` structure and stored
+ * in the global variable `g_client_pid` for acknowledgment purposes. A
+ * signal without a sender, as the kernel delivers when it had no room
+ * left to queue its details, cannot be acknowledged and is ignored; the
+ * client sends the bit again.
  *
- * @note If `write`, the program exits with an error message using
- * `sys_error()`.
+ * @param sig The received signal (either `SIGUSR1` or `SIGUSR2`).
+ * @param info Information about the signal, including the sender's PID.
  *
  * @ingroup server
  */
-static void process_character(char* c, int* bit)
+static void process_signal(int sig, const siginfo_t* info)
 {
-	if (*bit < 0)
-	{
-		if (*c == '\0')
-		{
-			if (write(1, "\n", 1) == -1)
-				sys_error("Server: write failed");
-		}
-		else
-		{
-			if (write(1, c, 1) == -1)
-				sys_error("Server: write failed");
-		}
-		*bit = 7;
-		*c   = 0;
-	}
+	int frame;
+
+	g_client_pid = info->si_pid;
+	trace_record(&g_trace, sig, info);
+	if (g_client_pid <= 0)
+		return;
+	frame = -1;
+	if (info->si_code == SI_QUEUE)
+		frame = info->si_value.sival_int & MT_FRAME_VALUE;
+	if (g_shards.count > 0)
+		shards_dispatch(&g_shards, g_client_pid, sig, frame, !g_shutdown);
+	else if (session_serve(&g_sessions, g_client_pid, sig, frame,
+						   !g_shutdown))
+		trace_flush(&g_trace);
 }
 
 /**
  * @brief Signal handler for the server process.
  *
- * This function is called asynchronously when the server receives a signal.
- * It processes the incoming signal, updates the current character being
- * constructed from bits, and sends an acknowledgment signal back to the client.
- *
- * The client's PID is extracted from the `siginfo_t` structure and stored
- * in the global variable `g_client_pid` for acknowledgment purposes.
+ * This function is called asynchronously when the server receives a
+ * `SIGUSR1` or `SIGUSR2` and hands it to process_signal(), preserving
+ * `errno` for the interrupted code.
  *
  * @param sig The received signal (either `SIGUSR1` or `SIGUSR2`).
  * @param info Information about the signal, including the sender's PID.
  * @param context Additional context information (unused).
  *
- * @note If `kill` fails to send the signal, the program exits with an
- * error message using `sys_error()`.
- *
  * @ingroup server
  */
 void signal_handler(int sig, siginfo_t* info, void* context)
 {
-	static int  bit = 7;
-	static char c   = 0;
+	int saved_errno;
 
 	(void) context;
-	g_client_pid = info->si_pid;
+	saved_errno = errno;
+	process_signal(sig, info);
+	errno = saved_errno;
+}
 
-	handle_received_bit(sig, &bit, &c);
-	process_character(&c, &bit);
+/**
+ * @brief Signal handler for `SIGTERM` and `SIGINT`.
+ *
+ * The first request starts a graceful shutdown; a second one cuts the
+ * grace period short.
+ *
+ * @param sig The received signal (unused).
+ *
+ * @ingroup server
+ */
+void shutdown_handler(int sig)
+{
+	(void) sig;
+	if (g_shutdown)
+		g_shutdown = 2;
+	else
+		g_shutdown = 1;
+}
 
-	if (kill(g_client_pid, SIGUSR1) == -1)
-		sys_error("Server: ACK failed");
+/**
+ * @brief Signal handler for `MT_SIG_CONTROL` messages from other servers.
+ *
+ * Records handoff requests so the main loop can hand the sessions over.
+ * Control signals that are not queued with a known value are ignored.
+ *
+ * @param sig The received signal (unused).
+ * @param info Information about the signal, including its value.
+ * @param context Additional context information (unused).
+ *
+ * @ingroup server
+ */
+void control_handler(int sig, siginfo_t* info, void* context)
+{
+	(void) sig;
+	(void) context;
+	if (info->si_code == SI_QUEUE
+		&& info->si_value.sival_int == MT_HANDOFF_REQUEST)
+		g_handoff_pid = info->si_pid;
 }
 
 /**
- * @brief Configures signal handling for SIGUSR1 and SIGUSR2.
+ * @brief Configures signal handling for SIGUSR1, SIGUSR2, SIGTERM and SIGINT.
  *
  * This function sets up the server to handle incoming signals used for
  * interprocess communication. It assigns the signal handler function
- * `signal_handler` for both SIGUSR1 and SIGUSR2 using `sigaction`.
+ * `signal_handler` for both SIGUSR1 and SIGUSR2 using `sigaction`,
+ * `shutdown_handler` for SIGTERM and SIGINT, and `control_handler` for
+ * `MT_SIG_CONTROL`.
  *
  * The `SA_SIGINFO` flag allows access to extra information about the
  * signal, including the sender's PID. `SA_RESTART` ensures that certain
- * system calls interrupted by signals are automatically restarted.
+ * system calls interrupted by signals are automatically restarted. Both
+ * signals are masked while the handler runs so that it never nests.
  *
  * If the signal registration fails, an error message is printed and
  * the program exits using `sys_error`.
@@ -158,40 +252,392 @@ void setup_signals(void)
 	sa.sa_sigaction = signal_handler;
 	sa.sa_flags     = SA_SIGINFO | SA_RESTART;
 	sigemptyset(&sa.sa_mask);
+	sigaddset(&sa.sa_mask, SIGUSR1);
+	sigaddset(&sa.sa_mask, SIGUSR2);
 
 	if (sigaction(SIGUSR1, &sa, NULL) == -1)
 		sys_error("Server: SIGUSR1 setup failed");
 	if (sigaction(SIGUSR2, &sa, NULL) == -1)
 		sys_error("Server: SIGUSR2 setup failed");
+
+	sa.sa_handler = shutdown_handler;
+	sa.sa_flags   = 0;
+	if (sigaction(SIGTERM, &sa, NULL) == -1)
+		sys_error("Server: SIGTERM setup failed");
+	if (sigaction(SIGINT, &sa, NULL) == -1)
+		sys_error("Server: SIGINT setup failed");
+
+	sa.sa_sigaction = control_handler;
+	sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+	if (sigaction(MT_SIG_CONTROL, &sa, NULL) == -1)
+		sys_error("Server: control signal setup failed");
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in milliseconds.
+ *
+ * @ingroup server
+ */
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in microseconds.
+ *
+ * @ingroup server
+ */
+static long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000L + ts.tv_nsec / 1000);
+}
+
+/**
+ * @brief Takes data signals by polling instead of sleeping until one comes.
+ *
+ * @details
+ * `SIGUSR1` and `SIGUSR2` stay blocked, so they only pile up as pending,
+ * and are fetched with a zero-timeout `sigtimedwait()` in a tight loop:
+ * no handler dispatch and no wake-up from sleep on the ingestion path.
+ * After `idle_us` microseconds without a signal (never if 0) the loop
+ * backs off to 10 ms blocking waits until traffic resumes. Returns when a
+ * shutdown or a handoff is requested; their handlers still run normally.
+ *
+ * @param idle_us Idle time before backing off, in microseconds.
+ * @param st Counters to update.
+ *
+ * @ingroup server
+ */
+static void busy_poll(long idle_us, t_poll_stats* st)
+{
+	const struct timespec zero = {0, 0};
+	const struct timespec nap  = {0, 10000000};
+	siginfo_t             info;
+	sigset_t              usr;
+	long                  last;
+	bool                  idle;
+	int                   sig;
+
+	sigemptyset(&usr);
+	sigaddset(&usr, SIGUSR1);
+	sigaddset(&usr, SIGUSR2);
+	last = now_us();
+	idle = false;
+	while (!g_shutdown && !g_handoff_pid)
+	{
+		sig = sigtimedwait(&usr, &info, idle ? &nap : &zero);
+		st->polls++;
+		if (sig > 0)
+		{
+			process_signal(sig, &info);
+			st->hits++;
+			idle = false;
+			last = now_us();
+		}
+		else if (idle)
+			st->naps++;
+		else if (idle_us > 0 && now_us() - last >= idle_us)
+			idle = true;
+		else
+			cpu_relax();
+	}
+}
+
+/**
+ * @brief Pins the calling thread to one CPU.
+ *
+ * @param cpu The CPU number.
+ *
+ * @note Exits with an error message if the CPU cannot be used.
+ *
+ * @ingroup server
+ */
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) == -1)
+		sys_error("Server: cannot pin to the requested CPU");
+}
+
+/**
+ * @brief Lets active sessions finish, then aborts the stragglers.
+ *
+ * Polls the session table every 10 ms until it is empty, the grace period
+ * has elapsed or a second shutdown request arrives. Sessions of clients
+ * that died are aborted on the way. Remaining sessions are then flushed
+ * and their clients told, with `SIGUSR2`, that the server is closing.
+ *
+ * @param timeout Grace period in seconds.
+ *
+ * @ingroup server
+ */
+static void drain_sessions(int timeout)
+{
+	const struct timespec tick = {0, 10000000};
+	sigset_t              usr;
+	long                  deadline;
+	size_t                active;
+	size_t                i;
+
+	sigemptyset(&usr);
+	sigaddset(&usr, SIGUSR1);
+	sigaddset(&usr, SIGUSR2);
+	deadline = now_ms() + timeout * 1000L;
+	while (true)
+	{
+		sigprocmask(SIG_BLOCK, &usr, NULL);
+		sessions_reap(&g_sessions);
+		stats_publish(&g_sessions);
+		active = g_sessions.active;
+		sigprocmask(SIG_UNBLOCK, &usr, NULL);
+		if (active == 0 || g_shutdown > 1 || now_ms() >= deadline)
+			break;
+		nanosleep(&tick, NULL);
+	}
+	sigprocmask(SIG_BLOCK, &usr, NULL);
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (g_sessions.slots[i].pid != 0)
+			session_abort(&g_sessions, &g_sessions.slots[i], true);
+		i++;
+	}
+	stats_publish(&g_sessions);
+	trace_flush(&g_trace);
+}
+
+/**
+ * @brief Prints the shutdown summary on standard error.
+ *
+ * @param stats The counters accumulated by the session table.
+ * @param w The output writer, already stopped.
+ * @param depth The capacity of the output queue.
+ *
+ * @ingroup server
+ */
+static void print_summary(const t_server_stats* stats, const t_writer* w,
+						  size_t depth)
+{
+	const t_writer_stats* wstats;
+
+	wstats = &w->stats;
+	fprintf(stderr,
+			"Server: shut down after %lu message(s), %lu byte(s) written; "
+			"%lu session(s), %lu aborted, %lu signal(s) rejected.\n",
+			stats->messages, stats->bytes, stats->sessions, stats->aborted,
+			stats->rejected);
+	fprintf(stderr,
+			"Server: output queue peaked at %zu/%zu chunk(s); %lu written, "
+			"%lu dropped, %lu spilled, %lu push(es) waited.\n",
+			w->max_depth, depth, w->written,
+			(unsigned long) wstats->dropped, (unsigned long) wstats->spilled,
+			(unsigned long) wstats->blocked);
+	fprintf(stderr,
+			"Server: output written with %s in %lu submission(s), "
+			"queue on %zu KiB of %s pages.\n",
+			sink_backend(&w->sink), w->sink.submits, w->mem.len / 1024,
+			region_pages(&w->mem));
 }
 
 /**
  * @brief Entry point for the server application.
  *
- * This function sets up the server to receive messages from a client via
- * Unix signals. It performs input validation, retrieves and displays the
- * server's PID, and configures signal handlers for SIGUSR1 and SIGUSR2.
+ * This function sets up the server to receive messages from clients via
+ * Unix signals. It parses the options (opening the trace file when `-r` is
+ * given), configures the signal handlers, then displays the server's PID
+ * so that no client can signal it before the handlers are in place.
  *
- * The server then enters an infinite loop, waiting for incoming signals
- * using `pause()`, which suspends execution until a signal is received.
+ * With `-t <pid>` the server first takes over the sessions of a running
+ * server. It then waits for incoming signals with `sigsuspend()` until a
+ * shutdown is requested, drains the active sessions and prints a summary.
+ * Shutdown and control signals stay blocked outside `sigsuspend()`, which
+ * unblocks them atomically, so one arriving just after the flags were
+ * checked still ends the wait.
+ * Output goes through a writer thread, so acknowledgments never wait for
+ * whoever reads the server's standard output. With `-B` the main thread
+ * busy-polls for signals instead, optionally pinned to a CPU with `-C`.
+ * With `-j` sessions are spread over worker threads and the main thread,
+ * which `-C` pins too, only forwards each signal to the worker owning its
+ * client. Without either, `-C` has no effect. With `-e`
+ * output is processed on a work-stealing pool before being written.
+ * With `-m` counters are published in a shared-memory page as they change.
+ * With `-A` statsd metric lines are aggregated and written at an interval,
+ * parsed on the pool so that the signal path only buffers them.
+ * With `-J` JSON messages are indexed into a tape file, on the pool too.
+ * With `-i` the PID is published in a file, removed again on shutdown.
+ * If a newer server asks to take over, the sessions are handed to it and
+ * the server exits without draining, leaving the file to the new server.
  *
- * @param argc Argument count (should be 1 for server).
- * @param argv Argument vector (not used).
- * @return int returns EXIT_SUCCESS (not actually reached).
+ * @param argc Argument count.
+ * @param argv Argument vector holding the server options.
+ * @return int EXIT_SUCCESS after a graceful shutdown.
  *
  * @ingroup server
  */
 int main(int argc, char** argv)
 {
-	pid_t pid;
+	pid_t           pid;
+	t_server_config cfg;
+	t_stats_page*   page;
+	sigset_t        stop;
+	sigset_t        usr;
+	sigset_t        wait_mask;
+	t_poll_stats    poll;
+	t_task_fn       fn;
+
+	validate_input_server(argc, argv, &cfg);
+	if (cfg.trace_path)
+		trace_open(&g_trace, cfg.trace_path);
+	sessions_init(&g_sessions, STDOUT_FILENO);
+	writer_start(&g_writer, STDOUT_FILENO, cfg.writer_depth, cfg.writer_policy,
+				 cfg.output_flags);
+	g_sessions.writer = &g_writer;
+	g_sessions.stream = cfg.stream_chunk;
+	page              = NULL;
+	if (cfg.stats_page)
+	{
+		page            = stats_open();
+		g_sessions.lane = &page->lane[0];
+		g_writer.report = &page->output;
+	}
+	if (cfg.metrics_ms)
+	{
+		metrics_start(&g_metrics, cfg.metrics_ms, &g_writer);
+		g_sessions.metrics = &g_metrics;
+	}
+	if (cfg.tape_path)
+	{
+		tapes_start(&g_tapes, cfg.tape_path);
+		g_sessions.tapes = &g_tapes;
+	}
+	if (cfg.escape || cfg.metrics_ms || cfg.tape_path)
+	{
+		fn = NULL;
+		if (cfg.escape)
+			fn = task_escape;
+		pool_start(&g_pool, cfg.pool_threads, &g_writer, fn);
+		g_pool.metrics  = g_sessions.metrics;
+		g_pool.tapes    = g_sessions.tapes;
+		g_sessions.pool = &g_pool;
+	}
 
-	validate_input_server(argc, argv);
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGTERM);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, MT_SIG_CONTROL);
+	sigprocmask(SIG_BLOCK, &stop, &wait_mask);
+	sigemptyset(&usr);
+	sigaddset(&usr, SIGUSR1);
+	sigaddset(&usr, SIGUSR2);
+	setup_signals();
+	if (cfg.takeover_pid)
+		handoff_receive(&g_sessions, cfg.takeover_pid);
+	if (cfg.workers > 0)
+	{
+		sigprocmask(SIG_BLOCK, &usr, NULL);
+		shards_start(&g_shards, cfg.workers, &g_sessions);
+		sigprocmask(SIG_UNBLOCK, &usr, NULL);
+	}
+	memset(&poll, 0, sizeof(poll));
+	if (cfg.busy_cpu >= 0 && (cfg.busy_idle_us >= 0 || cfg.workers > 0))
+		pin_to_cpu(cfg.busy_cpu);
+	if (cfg.busy_idle_us >= 0)
+	{
+		sigprocmask(SIG_BLOCK, &usr, NULL);
+		sigprocmask(SIG_UNBLOCK, &stop, NULL);
+	}
 	pid = getpid();
+	if (cfg.pid_path)
+		pid_file_write(cfg.pid_path, pid);
 	display_information_server(pid);
-	setup_signals();
-
-	while (true)
-		pause();
+	while (!g_shutdown)
+	{
+		if (cfg.busy_idle_us >= 0)
+			busy_poll(cfg.busy_idle_us, &poll);
+		else
+			sigsuspend(&wait_mask);
+		if (!g_handoff_pid)
+			continue;
+		sigprocmask(SIG_BLOCK, &usr, NULL);
+		if (g_shards.count > 0)
+			shards_stop(&g_shards, &g_sessions);
+		handoff_drain(&g_sessions);
+		if (g_sessions.pool)
+			pool_sync(&g_pool);
+		writer_sync(&g_writer);
+		if (handoff_send(&g_sessions, g_handoff_pid))
+		{
+			if (g_sessions.pool)
+				pool_stop(&g_pool);
+			if (g_sessions.metrics)
+				metrics_stop(&g_metrics);
+			if (g_sessions.tapes)
+				tapes_stop(&g_tapes);
+			writer_stop(&g_writer);
+			trace_flush(&g_trace);
+			stats_close(page);
+			return (EXIT_SUCCESS);
+		}
+		g_handoff_pid = 0;
+		if (cfg.workers > 0)
+			shards_start(&g_shards, cfg.workers, &g_sessions);
+		if (cfg.busy_idle_us < 0)
+			sigprocmask(SIG_UNBLOCK, &usr, NULL);
+	}
+	sigprocmask(SIG_BLOCK, &usr, NULL);
+	if (g_shards.count > 0)
+		shards_stop(&g_shards, &g_sessions);
+	sigprocmask(SIG_UNBLOCK, &stop, NULL);
+	sigprocmask(SIG_UNBLOCK, &usr, NULL);
 
+	drain_sessions(cfg.drain_timeout);
+	if (g_sessions.pool)
+		pool_stop(&g_pool);
+	if (g_sessions.metrics)
+		metrics_stop(&g_metrics);
+	if (g_sessions.tapes)
+		tapes_stop(&g_tapes);
+	writer_stop(&g_writer);
+	stats_close(page);
+	if (cfg.pid_path && pid_file_read(cfg.pid_path) == pid)
+		unlink(cfg.pid_path);
+	print_summary(&g_sessions.stats, &g_writer, cfg.writer_depth);
+	if (cfg.busy_idle_us >= 0)
+		fprintf(stderr,
+				"Server: busy-polled %lu time(s), %lu signal(s) taken, "
+				"%lu idle wait(s).\n",
+				poll.polls, poll.hits, poll.naps);
+	if (cfg.workers > 0)
+		shards_report(&g_shards);
+	if (g_sessions.pool)
+		fprintf(stderr,
+				"Server: %zu pool thread(s) processed %lu chunk(s); "
+				"%lu stolen, %lu completed out of order.\n",
+				g_pool.count, (unsigned long) g_pool.tasks,
+				(unsigned long) g_pool.stolen, (unsigned long) g_pool.parked);
+	if (cfg.metrics_ms)
+		fprintf(stderr,
+				"Server: aggregated %lu metric line(s) into %lu line(s) "
+				"over %lu flush(es); %lu passed through, %lu dropped.\n",
+				(unsigned long) g_metrics.lines, g_metrics.emitted,
+				g_metrics.flushes, (unsigned long) g_metrics.passed,
+				g_metrics.dropped);
+	if (cfg.tape_path)
+		fprintf(stderr,
+				"Server: indexed %lu JSON message(s) with %s; %lu not JSON, "
+				"%lu too long.\n",
+				(unsigned long) g_tapes.indexed, json_backend(),
+				(unsigned long) g_tapes.invalid,
+				(unsigned long) g_tapes.skipped);
 	return (EXIT_SUCCESS);
 }
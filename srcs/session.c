@@ -0,0 +1,653 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   session.c                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 14:02:19 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 14:02:19 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file session.c
+ * @brief Per-client reassembly of messages on the server side.
+ *
+ * @details
+ * Each client PID that is in the middle of a message owns a session: its
+ * own decoder and an output buffer. Characters are appended to the buffer
+ * and written out in one `write()` when the message ends or the buffer
+ * fills up, so concurrent clients no longer interleave their bits and the
+ * server no longer issues one system call per character.
+ *
+ * In stream mode (see `t_sessions`) the buffer is written out every
+ * `stream` bytes as a record tagged with the client PID, so the first
+ * bytes of a long message show up while the rest is still on its way,
+ * and the end of the message is marked as committed or aborted.
+ *
+ * The table is a fixed array and only `write()`, `kill()` and
+ * writer_push() are used, so every function here is safe to call from a
+ * signal handler.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+
+/**
+ * @brief Empties a session table and sets its output descriptor.
+ *
+ * @param table The table to initialise.
+ * @param out_fd Descriptor receiving the reassembled messages.
+ *
+ * @ingroup server
+ */
+void sessions_init(t_sessions* table, int out_fd)
+{
+	memset(table, 0, sizeof(*table));
+	table->out_fd   = out_fd;
+	table->capacity = MT_MAX_SESSIONS;
+}
+
+/**
+ * @brief Finds the session of a client, optionally opening a new one.
+ *
+ * @param table The session table.
+ * @param pid The client PID.
+ * @param create Whether a free slot may be claimed for an unknown PID.
+ * @return The session, or NULL if the PID is unknown and either `create`
+ * is false or the table is at capacity.
+ *
+ * @ingroup server
+ */
+t_session* session_get(t_sessions* table, pid_t pid, bool create)
+{
+	t_session* free_slot;
+	size_t     i;
+
+	free_slot = NULL;
+	i         = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table->slots[i].pid == pid)
+			return (&table->slots[i]);
+		if (!free_slot && table->slots[i].pid == 0)
+			free_slot = &table->slots[i];
+		i++;
+	}
+	if (!create || !free_slot || table->active >= table->capacity)
+		return (NULL);
+	free_slot->pid       = pid;
+	free_slot->len       = 0;
+	free_slot->flushed   = false;
+	free_slot->frame     = 0;
+	free_slot->sack      = 0;
+	free_slot->sack_bits = 0;
+	free_slot->id        = -1;
+	decoder_init(&free_slot->dec);
+	unpack_init(&free_slot->unpack);
+	if (table->lane)
+		free_slot->start_ns = stats_now_ns();
+	table->active++;
+	table->stats.sessions++;
+	return (free_slot);
+}
+
+/**
+ * @brief Sends one chunk of a client's output on its way.
+ *
+ * With an output queue attached to the table, the bytes are queued for
+ * the writer thread instead of being written here; with a processing pool,
+ * they are submitted to it on their way to that queue.
+ *
+ * @param table The session table.
+ * @param pid The client the chunk comes from.
+ * @param kind Work the pool does on the chunk; without a pool, it must be
+ * `MT_TASK_PLAIN`.
+ * @param buf The chunk.
+ * @param len Its length, at most `MT_SESSION_BUFFER`.
+ *
+ * @note If `write` fails, the program exits with an error message using
+ * `sys_error()`.
+ *
+ * @ingroup server
+ */
+static void session_output(t_sessions* table, pid_t pid, t_task_kind kind,
+						   const char* buf, size_t len)
+{
+	size_t  done;
+	ssize_t n;
+
+	done = 0;
+	if (table->pool)
+	{
+		pool_submit(table->pool, pid, kind, buf, len);
+		done = len;
+	}
+	else if (table->writer)
+	{
+		writer_push(table->writer, buf, len);
+		done = len;
+	}
+	while (done < len)
+	{
+		n = write(table->out_fd, buf + done, len - done);
+		if (n == -1 && errno != EINTR)
+			sys_error("Server: write failed");
+		if (n > 0)
+			done += n;
+	}
+}
+
+/**
+ * @brief Writes a number in decimal, without `snprintf()`, which is not
+ * safe in a signal handler.
+ *
+ * @param dst Buffer of at least 20 bytes.
+ * @param n The number.
+ * @return Number of digits written.
+ *
+ * @ingroup server
+ */
+static size_t put_number(char* dst, unsigned long n)
+{
+	char   tmp[20];
+	size_t len;
+	size_t i;
+
+	len = 0;
+	do
+	{
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+	i = 0;
+	while (i < len)
+	{
+		dst[i] = tmp[len - 1 - i];
+		i++;
+	}
+	return (len);
+}
+
+/**
+ * @brief Outputs one stream record of a client.
+ *
+ * @details
+ * The header and the data go out as a single chunk, so that records of
+ * different clients never interleave.
+ *
+ * @param table The session table.
+ * @param pid The client.
+ * @param mark `'+'` for data, `'.'` for a commit, `'!'` for an abort.
+ * @param data Bytes carried by a data record.
+ * @param len Their number, at most `MT_SESSION_BUFFER - MT_STREAM_HEADER`.
+ *
+ * @ingroup server
+ */
+static void stream_record(t_sessions* table, pid_t pid, char mark,
+						  const char* data, size_t len)
+{
+	char   rec[MT_SESSION_BUFFER];
+	size_t n;
+
+	n        = put_number(rec, (unsigned long) pid);
+	rec[n++] = ' ';
+	rec[n++] = mark;
+	if (mark == '+')
+	{
+		rec[n++] = ' ';
+		n += put_number(rec + n, len);
+	}
+	rec[n++] = '\n';
+	if (mark == '+')
+	{
+		memcpy(rec + n, data, len);
+		n += len;
+	}
+	session_output(table, pid, MT_TASK_PLAIN, rec, n);
+}
+
+/**
+ * @brief Writes the buffered part of a message to the output.
+ *
+ * In stream mode the bytes form records of at most `stream` bytes; a
+ * session handed over by a server not streaming may hold more than one.
+ * When metrics are aggregated, the complete lines go to the pool, which
+ * folds the metrics and writes the other lines; an incomplete last line
+ * stays in the buffer, unless it fills it.
+ *
+ * @param table The session table.
+ * @param s The session whose buffer is written and emptied.
+ *
+ * @ingroup server
+ */
+void session_flush(t_sessions* table, t_session* s)
+{
+	size_t done;
+	size_t len;
+
+	done = 0;
+	if (table->metrics && !table->stream)
+	{
+		done = s->len;
+		while (done > 0 && s->buf[done - 1] != '\n')
+			done--;
+		session_output(table, s->pid, MT_TASK_METRICS, s->buf, done);
+		if (done == 0 && s->len == MT_SESSION_BUFFER)
+		{
+			session_output(table, s->pid, MT_TASK_PLAIN, s->buf, s->len);
+			done = s->len;
+		}
+		memmove(s->buf, s->buf + done, s->len - done);
+	}
+	else if (!table->stream)
+		session_output(table, s->pid, MT_TASK_PLAIN, s->buf, s->len);
+	while (table->stream && done < s->len)
+	{
+		len = s->len - done;
+		if (len > table->stream)
+			len = table->stream;
+		stream_record(table, s->pid, '+', s->buf + done, len);
+		done += len;
+	}
+	if (!table->metrics || table->stream)
+		done = s->len;
+	stats_flush(table, s->pid, done);
+	table->stats.bytes += done;
+	s->len -= done;
+	if (done > 0)
+		s->flushed = true;
+}
+
+/**
+ * @brief Releases a session slot.
+ *
+ * @details
+ * The ID of a numbered message is remembered with its client, in the
+ * entry the client already has or else the oldest one, for
+ * session_copy().
+ *
+ * @param table The session table.
+ * @param s The session to release.
+ *
+ * @ingroup server
+ */
+static void session_close(t_sessions* table, t_session* s)
+{
+	t_ended* e;
+	size_t   i;
+
+	if (s->id >= 0)
+	{
+		i = 0;
+		while (i < MT_MAX_SESSIONS && table->ended[i].pid != s->pid)
+			i++;
+		if (i == MT_MAX_SESSIONS)
+			i = table->ended_next++ % MT_MAX_SESSIONS;
+		e         = &table->ended[i];
+		e->pid    = s->pid;
+		e->id     = s->id;
+		e->end_ns = stats_now_ns();
+	}
+	s->pid = 0;
+	s->len = 0;
+	table->active--;
+}
+
+/**
+ * @brief Feeds one received signal into a client's session.
+ *
+ * @details
+ * Completed characters go through the session's decompressor, then the
+ * bytes it yields are appended to the session buffer, which is
+ * written out when it fills up, or holds a stream record. The terminating
+ * `'\0'` is output as a newline, or a commit record in stream mode,
+ * flushes the buffer and closes the session. A transport probe leaves
+ * no output and is not counted as a message. With a tape file, the
+ * complete message is indexed as JSON first. A packed payload referring
+ * to bytes it never carried aborts the session.
+ *
+ * @param table The session table.
+ * @param s The session of the sender.
+ * @param sig The received signal.
+ * @return true if the signal completed or aborted the message, false
+ * otherwise.
+ *
+ * @ingroup server
+ */
+bool session_feed(t_sessions* table, t_session* s, int sig)
+{
+	char out[MT_LZ_MAX_OUTPUT];
+	int  c;
+	int  n;
+	int  i;
+
+	c = decoder_feed(&s->dec, sig);
+	if (c < 0)
+		return (false);
+	n = unpack_feed(&s->unpack, c, out);
+	i = 0;
+	while (i < n)
+	{
+		if (s->len == MT_SESSION_BUFFER)
+			session_flush(table, s);
+		s->buf[s->len++] = out[i++];
+		if (table->stream && s->len >= table->stream)
+			session_flush(table, s);
+	}
+	if (n == MT_UNPACK_CORRUPT)
+	{
+		session_abort(table, s, false);
+		return (true);
+	}
+	if (n >= 0)
+		return (false);
+	if (s->unpack.codec == MT_CODEC_PROBE)
+	{
+		session_close(table, s);
+		return (true);
+	}
+	if (table->tapes)
+		tapes_submit(table->tapes, table->pool, s);
+	if (s->len == MT_SESSION_BUFFER)
+		session_flush(table, s);
+	if (!table->stream)
+		s->buf[s->len++] = '\n';
+	session_flush(table, s);
+	if (table->stream)
+		stream_record(table, s->pid, '.', NULL, 0);
+	stats_message(table, s);
+	session_close(table, s);
+	table->stats.messages++;
+	return (true);
+}
+
+/**
+ * @brief Ends a session before its terminator arrived.
+ *
+ * @details
+ * Whatever was received is flushed, followed by a newline so that the
+ * next message starts on its own line, or by an abort record in stream
+ * mode; an interrupted transport probe leaves nothing. When `notify` is
+ * set the client is
+ * sent `SIGUSR2` to tell it the server will not take the rest of the
+ * message; it must not be set for clients that are gone, whose PID may
+ * already belong to another process.
+ *
+ * @param table The session table.
+ * @param s The session to abort.
+ * @param notify Whether to send the closing signal to the client.
+ *
+ * @ingroup server
+ */
+void session_abort(t_sessions* table, t_session* s, bool notify)
+{
+	bool probe;
+
+	probe = s->unpack.codec == MT_CODEC_PROBE;
+	if (!table->stream && !probe && (s->len > 0 || s->dec.bit != 7))
+	{
+		if (s->len == MT_SESSION_BUFFER)
+			session_flush(table, s);
+		s->buf[s->len++] = '\n';
+	}
+	session_flush(table, s);
+	if (table->stream && !probe)
+		stream_record(table, s->pid, '!', NULL, 0);
+	if (notify)
+		kill(s->pid, SIGUSR2);
+	session_close(table, s);
+	table->stats.aborted++;
+}
+
+/**
+ * @brief Aborts the sessions whose client process no longer exists.
+ *
+ * @param table The session table.
+ * @return Number of sessions reaped.
+ *
+ * @ingroup server
+ */
+size_t sessions_reap(t_sessions* table)
+{
+	size_t reaped;
+	size_t i;
+
+	reaped = 0;
+	i      = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table->slots[i].pid != 0 && kill(table->slots[i].pid, 0) == -1
+			&& errno == ESRCH)
+		{
+			session_abort(table, &table->slots[i], false);
+			reaped++;
+		}
+		i++;
+	}
+	return (reaped);
+}
+
+/**
+ * @brief Tells whether a numbered frame belongs to a message of its client
+ * that already ended.
+ *
+ * @details
+ * It does if it carries the ID of the client's last message and that
+ * message ended less than `MT_LATE_COPY_NS` ago; past that, the PID may
+ * belong to a new client.
+ *
+ * @param table The session table.
+ * @param pid The client PID.
+ * @param frame The frame number with its message ID.
+ * @return true if the frame is a copy, false otherwise.
+ *
+ * @ingroup server
+ */
+bool session_copy(const t_sessions* table, pid_t pid, int frame)
+{
+	const t_ended* e;
+	size_t         i;
+
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		e = &table->ended[i++];
+		if (e->pid == pid)
+			return (e->id == frame >> MT_MSG_SHIFT
+					&& stats_now_ns() - e->end_ns < MT_LATE_COPY_NS);
+	}
+	return (false);
+}
+
+/**
+ * @brief Finds the session a data signal goes to, opening it if needed.
+ *
+ * @details
+ * A signal sent with `kill()` opens a session if `create` allows it. Of
+ * numbered frames, only frame 0 does, since clients send it alone, and
+ * only if it is not a copy from the client's last message (see
+ * session_copy()). A frame 0 with another ID than the client's session
+ * means the client sends its message again, after a server asked it to
+ * or with a PID that was reused: the old session is dropped first, its
+ * content written out and the session counted as aborted if part of it
+ * already was.
+ *
+ * @param table The session table.
+ * @param pid The client PID.
+ * @param frame The frame number with its message ID, or -1 for a signal
+ * sent with `kill()`.
+ * @param create Whether a new session may be opened for the client.
+ * @return The session, or NULL if the signal has none.
+ *
+ * @ingroup server
+ */
+t_session* session_open(t_sessions* table, pid_t pid, int frame,
+						bool create)
+{
+	t_session* s;
+
+	if (frame < 0)
+		return (session_get(table, pid, create));
+	s = session_get(table, pid, false);
+	if ((frame & MT_FRAME_MASK) || (s && s->id == frame >> MT_MSG_SHIFT)
+		|| session_copy(table, pid, frame))
+		return (s);
+	if (s && s->flushed)
+		session_abort(table, s, false);
+	else if (s)
+		session_close(table, s);
+	s = session_get(table, pid, create);
+	if (s)
+		s->id = frame >> MT_MSG_SHIFT;
+	return (s);
+}
+
+/**
+ * @brief Feeds one numbered frame into a client's session.
+ *
+ * @details
+ * The frame expected next is decoded at once, followed by any frames
+ * after it that arrived early. A frame up to `MT_SACK_WINDOW - 1` ahead
+ * is held in the SACK bitmap until the gap before it is filled. Anything
+ * else is a copy of a frame already decoded and is ignored, and so is a
+ * frame whose message ID is not the session's: it is a copy from one of
+ * the client's previous messages.
+ *
+ * @param table The session table.
+ * @param s The session of the sender.
+ * @param sig The received signal.
+ * @param frame The frame number with its message ID, or -1 for an
+ * unnumbered signal, which is decoded as it comes.
+ * @return true if the frame completed a message, false otherwise.
+ *
+ * @ingroup server
+ */
+bool session_frame(t_sessions* table, t_session* s, int sig, int frame)
+{
+	unsigned ahead;
+	bool     done;
+
+	if (frame < 0)
+		return (session_feed(table, s, sig));
+	if (s->id != frame >> MT_MSG_SHIFT)
+		return (false);
+	frame &= MT_FRAME_MASK;
+	ahead = (frame - s->frame) & MT_FRAME_MASK;
+	if (ahead >= MT_SACK_WINDOW)
+		return (false);
+	if (ahead > 0)
+	{
+		s->sack |= 1u << ahead;
+		s->sack_bits &= ~(1u << ahead);
+		if (sig == SIGUSR1)
+			s->sack_bits |= 1u << ahead;
+		return (false);
+	}
+	done = session_feed(table, s, sig);
+	s->frame = (s->frame + 1) & MT_FRAME_MASK;
+	s->sack >>= 1;
+	s->sack_bits >>= 1;
+	while (!done && (s->sack & 1))
+	{
+		done = session_feed(table, s, (s->sack_bits & 1) ? SIGUSR1 : SIGUSR2);
+		s->frame = (s->frame + 1) & MT_FRAME_MASK;
+		s->sack >>= 1;
+		s->sack_bits >>= 1;
+	}
+	return (done);
+}
+
+/**
+ * @brief Handles one data signal from a client and acknowledges it.
+ *
+ * @details
+ * The signal is fed to the client's session, opened first if needed and
+ * allowed by `create`, then acknowledged with `SIGUSR1`. A client that
+ * gets no session is answered with `SIGUSR2` so that it stops instead of
+ * waiting for an acknowledgment forever. If the acknowledgment cannot be
+ * delivered because the client is gone, its session is aborted. A
+ * session aborted by the signal itself, for a corrupt payload, is
+ * answered with `SIGUSR2` instead of being acknowledged.
+ *
+ * Numbered frames are acknowledged with an `MT_SIG_ACK` signal instead,
+ * its value holding the next frame expected and the SACK bitmap (see
+ * `t_window`), and open a session as session_open() tells. A frame
+ * without a session is dropped if it is a copy from a message that ended,
+ * since that message was acknowledged whole. Any other frame but frame 0
+ * without one means the session was lost, to a restart of the server for
+ * instance: the client is asked to send its message again with an ack
+ * holding `MT_ACK_RESTART` and the frame's message ID.
+ *
+ * With a stats page, the signal is published once answered, along with
+ * the time it took (see stats_signal()).
+ *
+ * @param table The session table.
+ * @param pid The client PID.
+ * @param sig The received signal.
+ * @param frame The frame number with its message ID, or -1 for a signal
+ * sent with `kill()`.
+ * @param create Whether a new session may be opened for the client.
+ * @return true if the signal completed a message, false otherwise.
+ *
+ * @note Any `kill` failure other than a vanished client ends the program
+ * through `sys_error()`.
+ *
+ * @ingroup server
+ */
+bool session_serve(t_sessions* table, pid_t pid, int sig, int frame,
+				   bool create)
+{
+	t_session*    s;
+	union sigval  ack;
+	unsigned long aborted;
+	long          start;
+	bool          copy;
+	bool          done;
+	int           ret;
+
+	start = 0;
+	if (table->lane)
+		start = stats_now_ns();
+	s    = session_open(table, pid, frame, create);
+	copy = !s && frame >= 0 && session_copy(table, pid, frame);
+	if (!s && !copy && frame >= 0 && (frame & MT_FRAME_MASK))
+	{
+		ack.sival_int = (int) (MT_ACK_RESTART | frame >> MT_MSG_SHIFT);
+		sigqueue(pid, MT_SIG_ACK, ack);
+	}
+	else if (!s && !copy)
+	{
+		table->stats.rejected++;
+		kill(pid, SIGUSR2);
+	}
+	if (!s)
+	{
+		stats_signal(table, start);
+		return (false);
+	}
+	aborted = table->stats.aborted;
+	done    = session_frame(table, s, sig, frame);
+	if (table->stats.aborted != aborted)
+		ret = kill(pid, SIGUSR2);
+	else if (frame < 0)
+		ret = kill(pid, SIGUSR1);
+	else
+	{
+		ack.sival_int = s->frame << 16 | s->sack;
+		ret           = sigqueue(pid, MT_SIG_ACK, ack);
+	}
+	if (ret == -1)
+	{
+		if (errno != ESRCH)
+			sys_error("Server: ACK failed");
+		if (!done)
+			session_abort(table, s, false);
+	}
+	stats_signal(table, start);
+	return (done);
+}
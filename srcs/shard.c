@@ -0,0 +1,462 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   shard.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 19:41:27 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 19:41:27 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file shard.c
+ * @brief Session worker threads, each owning the clients hashed to it.
+ *
+ * @details
+ * Clients keep signalling the one server PID. The main thread takes each
+ * `SIGUSR1`/`SIGUSR2`, hashes the sender's PID to a worker and forwards
+ * the bit with `rt_tgsigqueueinfo()`, which queues an `MT_SIG_SHARD`
+ * signal on that very thread. The value carries the client PID, and
+ * `si_uid` the bit, the frame number and whether a new session may be
+ * opened: the kernel passes a signal queued to the caller's own process
+ * on as given. Each worker waits for its signals with `sigwaitinfo()` and
+ * decodes, buffers and acknowledges on its own session table, so workers
+ * share nothing but the lock-free output queue.
+ *
+ * A bit that cannot be forwarded after `MT_SHARD_RETRIES` attempts is
+ * dropped, and the worker is told to abort the client's session, which
+ * lets the client know instead of leaving a hole in its message.
+ *
+ * Stopping the workers moves their sessions back into the server's table,
+ * and starting them spreads that table again, so draining and handoffs
+ * work on a single table as before.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief Picks the worker owning a client.
+ *
+ * @param pid The client PID.
+ * @param count Number of workers.
+ * @return Index of the worker.
+ *
+ * @ingroup server
+ */
+static size_t shard_of(pid_t pid, size_t count)
+{
+	return ((((uint32_t) pid * 2654435761u) >> 16) % count);
+}
+
+/**
+ * @brief Queues a forwarded bit, or a stop request, on a worker.
+ *
+ * @details
+ * Retries while the real-time signal queue of the user is full, at most
+ * `MT_SHARD_RETRIES` times, since this runs in the signal handler.
+ *
+ * @param shards The workers.
+ * @param sh The destination worker.
+ * @param pid Client PID; 0 asks the worker to stop.
+ * @param bits Bit, session flag and frame number; see shards_dispatch().
+ * @return true if the signal was queued, false if the queue stayed full.
+ *
+ * @note Exits with an error message if the signal cannot be queued for
+ * another reason.
+ *
+ * @ingroup server
+ */
+static bool shard_send(t_shards* shards, const t_shard* sh, pid_t pid,
+					   uint32_t bits)
+{
+	siginfo_t info;
+	int       tries;
+
+	memset(&info, 0, sizeof(info));
+	info.si_signo           = MT_SIG_SHARD;
+	info.si_code            = SI_QUEUE;
+	info.si_pid             = shards->tgid;
+	info.si_uid             = bits;
+	info.si_value.sival_int = pid;
+	tries                   = 0;
+	while (syscall(SYS_rt_tgsigqueueinfo, shards->tgid, sh->tid, MT_SIG_SHARD,
+				   &info) == -1)
+	{
+		if (errno != EAGAIN)
+			sys_error("Server: cannot forward a signal to a worker");
+		if (++tries == MT_SHARD_RETRIES)
+			return (false);
+		shards->retries++;
+		cpu_relax();
+	}
+	return (true);
+}
+
+/**
+ * @brief Asks a worker to abort the session of a client whose bit was
+ * dropped.
+ *
+ * @details
+ * Called from the signal handler; the worker applies the request before
+ * the next signal it serves. If every entry is taken, which needs as many
+ * clients as the table has slots, the client is told directly.
+ *
+ * @param sh The worker owning the client.
+ * @param pid The client PID.
+ *
+ * @ingroup server
+ */
+static void shard_lose(t_shard* sh, pid_t pid)
+{
+	size_t i;
+	int    expected;
+
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		expected = 0;
+		if (atomic_load(&sh->lost[i]) == pid)
+			return;
+		if (atomic_compare_exchange_strong(&sh->lost[i], &expected, pid))
+		{
+			atomic_fetch_add(&sh->nlost, 1);
+			return;
+		}
+		i++;
+	}
+	kill(pid, SIGUSR2);
+}
+
+/**
+ * @brief Aborts the sessions of the clients whose bits were dropped.
+ *
+ * @param sh The worker.
+ *
+ * @ingroup server
+ */
+static void shard_abort_lost(t_shard* sh)
+{
+	t_session* s;
+	pid_t      pid;
+	size_t     i;
+
+	i = 0;
+	while (atomic_load(&sh->nlost) > 0 && i < MT_MAX_SESSIONS)
+	{
+		pid = atomic_exchange(&sh->lost[i++], 0);
+		if (pid == 0)
+			continue;
+		atomic_fetch_sub(&sh->nlost, 1);
+		s = session_get(&sh->table, pid, false);
+		if (s)
+			session_abort(&sh->table, s, true);
+	}
+}
+
+/**
+ * @brief Pins a worker to one of the CPUs the server may run on.
+ *
+ * @details
+ * Workers take the allowed CPUs in turn, so a server confined to a few
+ * CPUs by its affinity mask never pins a worker outside of them.
+ *
+ * @param sh The worker.
+ *
+ * @ingroup server
+ */
+static void shard_pin(const t_shard* sh)
+{
+	cpu_set_t cpus;
+	int       n;
+	int       cpu;
+
+	n = CPU_COUNT(&sh->owner->cpus);
+	if (n == 0)
+		return;
+	n   = (sh - sh->owner->shard) % n;
+	cpu = -1;
+	while (n >= 0)
+		if (CPU_ISSET(++cpu, &sh->owner->cpus))
+			n--;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+/**
+ * @brief Moves a session into another table.
+ *
+ * @param from The table holding the session.
+ * @param s The session to move.
+ * @param to The destination table.
+ * @return true on success, false if `to` has no free slot.
+ *
+ * @ingroup server
+ */
+static bool session_move(t_sessions* from, t_session* s, t_sessions* to)
+{
+	size_t i;
+
+	i = 0;
+	while (i < MT_MAX_SESSIONS && to->slots[i].pid != 0)
+		i++;
+	if (i == MT_MAX_SESSIONS)
+		return (false);
+	to->slots[i] = *s;
+	to->active++;
+	s->pid = 0;
+	s->len = 0;
+	from->active--;
+	return (true);
+}
+
+/**
+ * @brief Body of a worker thread.
+ *
+ * @details
+ * Pins itself to one CPU (best effort), publishes its thread ID, then
+ * serves forwarded bits until it receives a zero PID. Since queued
+ * real-time signals are delivered in order, every bit forwarded before
+ * the stop request is served first. Sessions whose bits were dropped are
+ * aborted before each signal is served.
+ *
+ * @param arg The worker's `t_shard`.
+ * @return Always NULL.
+ *
+ * @ingroup server
+ */
+static void* shard_main(void* arg)
+{
+	t_shard*  sh;
+	siginfo_t info;
+	sigset_t  set;
+	uint32_t  bits;
+
+	sh = arg;
+	shard_pin(sh);
+	sigemptyset(&set);
+	sigaddset(&set, MT_SIG_SHARD);
+	sh->tid = syscall(SYS_gettid);
+	sem_post(&sh->owner->ready);
+	while (true)
+	{
+		if (sigwaitinfo(&set, &info) == -1 || info.si_code != SI_QUEUE
+			|| info.si_pid != sh->owner->tgid)
+			continue;
+		shard_abort_lost(sh);
+		if (info.si_value.sival_int == 0)
+			break;
+		bits = info.si_uid;
+		session_serve(&sh->table, info.si_value.sival_int,
+					  (bits & 1) ? SIGUSR1 : SIGUSR2, (int) (bits >> 2) - 1,
+					  (bits & 2) != 0);
+	}
+	return (NULL);
+}
+
+/**
+ * @brief Starts the session workers and hands them the open sessions.
+ *
+ * @details
+ * Each worker gets an equal share of `MT_MAX_SESSIONS` and the sessions
+ * of `table` whose PID hashes to it; `table` keeps its counters. Workers
+ * run with every signal blocked, and so does `MT_SIG_SHARD` in the
+ * calling thread, so forwarded bits only reach their worker.
+ *
+ * @param shards The workers, zeroed before the first start.
+ * @param count Number of workers, at most `MT_MAX_SHARDS`.
+ * @param table The server's session table.
+ *
+ * @note `SIGUSR1` and `SIGUSR2` must be blocked by the caller. Exits with
+ * an error message if a thread cannot be created.
+ *
+ * @ingroup server
+ */
+void shards_start(t_shards* shards, size_t count, t_sessions* table)
+{
+	sigset_t set;
+	sigset_t old;
+	t_shard* sh;
+	size_t   i;
+
+	if (shards->used == 0)
+	{
+		sem_init(&shards->ready, 0, 0);
+		if (sched_getaffinity(0, sizeof(shards->cpus), &shards->cpus) == -1)
+			CPU_ZERO(&shards->cpus);
+	}
+	if (count > shards->used)
+		shards->used = count;
+	shards->tgid = getpid();
+	sigemptyset(&set);
+	sigaddset(&set, MT_SIG_SHARD);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+	i = 0;
+	while (i < count)
+	{
+		sh = &shards->shard[i];
+		sessions_init(&sh->table, table->out_fd);
+		sh->table.writer   = table->writer;
+		sh->table.pool     = table->pool;
+		sh->table.stream   = table->stream;
+		sh->table.metrics  = table->metrics;
+		sh->table.tapes    = table->tapes;
+		sh->table.capacity = MT_MAX_SESSIONS / count
+							 + (i < MT_MAX_SESSIONS % count);
+		if (table->lane)
+			sh->table.lane = table->lane + 1 + i;
+		sh->owner = shards;
+		i++;
+	}
+	i = 0;
+	while (i < MT_MAX_SESSIONS)
+	{
+		if (table->slots[i].pid != 0)
+			session_move(table, &table->slots[i],
+						 &shards->shard[shard_of(table->slots[i].pid, count)]
+							  .table);
+		i++;
+	}
+	i = 0;
+	while (i < count)
+		stats_publish(&shards->shard[i++].table);
+	stats_publish(table);
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	i = 0;
+	while (i < count)
+	{
+		if (pthread_create(&shards->shard[i].thread, NULL, shard_main,
+						   &shards->shard[i])
+			!= 0)
+			sys_error("Server: cannot start a session worker");
+		i++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	i = 0;
+	while (i < count)
+	{
+		while (sem_wait(&shards->ready) == -1)
+			;
+		i++;
+	}
+	shards->count = count;
+}
+
+/**
+ * @brief Forwards a data signal to the worker owning its client.
+ *
+ * @details
+ * The bits sent along hold the frame number, with its message ID, plus
+ * one from bit 2, whether a session may be opened in bit 1 and the bit value
+ * in bit 0. If the worker's queue stays full, the bit is dropped and
+ * counted, and the client's session is aborted.
+ *
+ * @param shards The running workers.
+ * @param pid The client PID.
+ * @param sig The received signal.
+ * @param frame The frame number with its message ID, or -1 if the signal
+ * had none.
+ * @param create Whether the worker may open a session for the client.
+ *
+ * @ingroup server
+ */
+void shards_dispatch(t_shards* shards, pid_t pid, int sig, int frame,
+					 bool create)
+{
+	t_shard* sh;
+
+	sh = &shards->shard[shard_of(pid, shards->count)];
+	if (shard_send(shards, sh, pid,
+				   (uint32_t) (frame + 1) << 2 | create << 1
+					   | (sig == SIGUSR1)))
+		return;
+	shards->lost++;
+	shard_lose(sh, pid);
+}
+
+/**
+ * @brief Stops the session workers and takes their sessions back.
+ *
+ * @details
+ * Sessions still open in a worker move back into `table` and the worker's
+ * counters are added to the table's. Those counters are already in the
+ * worker's lane of the stats page, so they are marked as shown for the
+ * table's lane as well. A session that does not fit, which
+ * only happens when a handoff brought in more clients than a worker's
+ * share, is aborted and its client notified.
+ *
+ * @param shards The running workers.
+ * @param table The server's session table.
+ *
+ * @note `SIGUSR1` and `SIGUSR2` must be blocked by the caller.
+ *
+ * @ingroup server
+ */
+void shards_stop(t_shards* shards, t_sessions* table)
+{
+	t_shard* sh;
+	size_t   i;
+	size_t   j;
+
+	i = 0;
+	while (i < shards->count)
+		if (shard_send(shards, &shards->shard[i], 0, 0))
+			i++;
+	i = 0;
+	while (i < shards->count)
+	{
+		sh = &shards->shard[i++];
+		pthread_join(sh->thread, NULL);
+		j = 0;
+		while (j < MT_MAX_SESSIONS)
+		{
+			if (sh->table.slots[j].pid != 0
+				&& !session_move(&sh->table, &sh->table.slots[j], table))
+				session_abort(&sh->table, &sh->table.slots[j], true);
+			j++;
+		}
+		table->stats.messages += sh->table.stats.messages;
+		table->stats.bytes += sh->table.stats.bytes;
+		table->stats.sessions += sh->table.stats.sessions;
+		table->stats.aborted += sh->table.stats.aborted;
+		table->stats.rejected += sh->table.stats.rejected;
+		sh->opened += sh->table.stats.sessions;
+		stats_publish(&sh->table);
+		table->shown.messages += sh->table.shown.messages;
+		table->shown.bytes += sh->table.shown.bytes;
+		table->shown.sessions += sh->table.shown.sessions;
+		table->shown.aborted += sh->table.shown.aborted;
+		table->shown.rejected += sh->table.shown.rejected;
+	}
+	stats_publish(table);
+	shards->count = 0;
+}
+
+/**
+ * @brief Prints how sessions were spread over the workers.
+ *
+ * @param shards The workers, stopped.
+ *
+ * @ingroup server
+ */
+void shards_report(const t_shards* shards)
+{
+	size_t i;
+
+	fprintf(stderr, "Server: %zu session worker(s), sessions per worker:",
+			shards->used);
+	i = 0;
+	while (i < shards->used)
+		fprintf(stderr, " %lu", shards->shard[i++].opened);
+	fprintf(stderr, "; %lu forward(s) retried, %lu dropped.\n",
+			shards->retries, shards->lost);
+}
@@ -0,0 +1,936 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   simulator.c                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 10:21:50 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 10:21:50 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file simulator.c
+ * @brief Runs client-to-server transfers over a simulated signal transport.
+ *
+ * @details
+ * The simulator drives the real protocol encoder and decoder through a
+ * discrete-event model of signal delivery. Every signal travels with a
+ * configurable one-way latency (plus optional jitter), each handler
+ * invocation costs a configurable amount of virtual time, and the
+ * receiving side can lose, coalesce or overflow pending signals exactly
+ * like the kernel does for standard signals; real-time acks are queued
+ * instead.
+ *
+ * The client models the numbered transport of transport.c: a window of
+ * up to `MT_SACK_WINDOW` frames in flight, SACK acks that grow or halve
+ * it and trigger resends of the frames missing, and a retransmission
+ * timeout derived from the measured round trip, doubling up to
+ * `MT_RTO_MAX_NS`. The server holds early frames in a SACK bitmap like
+ * session_frame() and drops frames once the message ended. With `-k` the
+ * classic transport is modelled instead: bare signals, one at a time,
+ * each answered with a bare `SIGUSR1` and never sent again.
+ *
+ * Everything runs in virtual time with a seeded PRNG, so a given set of
+ * options always produces the same result. Alongside the virtual transfer
+ * figures the simulator reports the real CPU cost per byte of the encoder
+ * and decoder, measured outside the event loop.
+ *
+ * Usage: ./simulator [-s size] [-f file] [-l latency_us] [-j jitter_us]
+ *        [-c server_cost_us] [-C client_cost_us] [-p loss] [-q limit]
+ *        [-n] [-k] [-S seed]
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup simulator
+ */
+#include "minitalk.h"
+#include <getopt.h>
+
+/** Timeouts in a row after which the simulated client gives up. */
+#define SIM_MAX_RETRIES 16
+
+/**
+ * @internal
+ * @brief Kinds of events scheduled on the virtual timeline.
+ */
+enum e_sim_event
+{
+	SIM_SERVER_ARRIVE, ///< A signal reaches the server's pending set.
+	SIM_SERVER_DONE,   ///< The server's handler returns.
+	SIM_CLIENT_ARRIVE, ///< An acknowledgment reaches the client.
+	SIM_CLIENT_DONE,   ///< The client's handler returns.
+	SIM_CLIENT_TIMEOUT ///< The client's retransmission timer fires.
+};
+
+/**
+ * @typedef t_sim_config
+ * @brief Parameters of the simulated transport.
+ *
+ * @details
+ * All durations are in nanoseconds of virtual time. `loss` is the
+ * probability for any signal to vanish in flight; `queue_limit` bounds
+ * how many signals may be pending at a receiver, and `coalesce` merges a
+ * signal with an identical one already pending, as standard signals do.
+ * `classic` selects the transport of bare signals over numbered frames.
+ */
+typedef struct s_sim_config
+{
+	long          latency_ns;     ///< One-way delivery latency.
+	long          jitter_ns;      ///< Maximum extra random latency.
+	long          server_cost_ns; ///< Virtual cost of one server handler.
+	long          client_cost_ns; ///< Virtual cost of one client handler.
+	double        loss;           ///< Per-signal loss probability.
+	bool          coalesce;       ///< Merge identical pending signals.
+	bool          classic;        ///< Bare signals, one at a time.
+	int           queue_limit;    ///< Maximum pending signals per receiver.
+	unsigned long seed;           ///< PRNG seed.
+	size_t        size;           ///< Size of the generated message.
+	const char*   file;           ///< Optional message file.
+} t_sim_config;
+
+/**
+ * @typedef t_sim_event
+ * @brief One scheduled event on the virtual timeline.
+ *
+ * @details
+ * Events are ordered by time, then by scheduling order so that
+ * simultaneous events are processed deterministically.
+ */
+typedef struct s_sim_event
+{
+	long          time;  ///< Virtual time of the event.
+	unsigned long seq;   ///< Tie-breaker preserving scheduling order.
+	int           type;  ///< One of `e_sim_event`.
+	int           sig;   ///< Signal carried by the event.
+	int           value; ///< Its payload, or the generation of a timer.
+} t_sim_event;
+
+/**
+ * @typedef t_sim_signal
+ * @brief One pending signal and the value queued with it.
+ */
+typedef struct s_sim_signal
+{
+	int sig;   ///< Signal number.
+	int value; ///< Frame number or ack payload; 0 for a bare signal.
+} t_sim_signal;
+
+/**
+ * @typedef t_sim_endpoint
+ * @brief Receiving side of a simulated process.
+ *
+ * @details
+ * Models the pending signal set of a process and whether its handler is
+ * currently running. Pending signals are kept in arrival order. A
+ * standard signal merging with a pending one keeps that one's value, as
+ * the kernel does.
+ */
+typedef struct s_sim_endpoint
+{
+	t_sim_signal* pending; ///< Pending signals in arrival order.
+	int           count;   ///< Number of pending signals.
+	bool          busy;    ///< True while the handler runs.
+} t_sim_endpoint;
+
+/**
+ * @typedef t_sim
+ * @brief Full state of a simulated transfer.
+ *
+ * @details
+ * Holds the event heap, both endpoints, the codec state, the window of
+ * the client, the SACK state of the server and the counters reported at
+ * the end of the run.
+ */
+typedef struct s_sim
+{
+	t_sim_config   cfg;        ///< Transport parameters.
+	t_sim_event*   heap;       ///< Binary min-heap of events.
+	size_t         heap_len;   ///< Number of queued events.
+	size_t         heap_cap;   ///< Allocated heap slots.
+	unsigned long  next_seq;   ///< Next event sequence number.
+	unsigned long  rng;        ///< PRNG state.
+	long           now;        ///< Current virtual time.
+	t_sim_endpoint server;     ///< Server pending set.
+	t_sim_endpoint client;     ///< Client pending set.
+	t_encoder      enc;        ///< Client-side encoder.
+	t_window       win;        ///< Client frames in flight.
+	int            next_sig;   ///< Next signal to send, 0 at the end.
+	long           rtt_ns;     ///< Client's round-trip estimate.
+	int            timer;      ///< Generation of the armed timer.
+	int            retries;    ///< Timeouts in a row without progress.
+	bool           gave_up;    ///< The client stopped retrying.
+	t_decoder      dec;        ///< Server-side decoder.
+	uint16_t       frame;      ///< Next frame the server expects.
+	uint16_t       sack;       ///< Frames held ahead, bit i: frame+i.
+	uint16_t       sack_bits;  ///< Bits carried by those frames.
+	char*          out;        ///< Bytes rebuilt by the server.
+	size_t         out_len;    ///< Number of rebuilt bytes.
+	size_t         out_cap;    ///< Capacity of the output buffer.
+	bool           finished;   ///< Terminator decoded by the server.
+	unsigned long  sent;       ///< Signals emitted by both sides.
+	unsigned long  lost;       ///< Signals lost in flight.
+	unsigned long  coalesced;  ///< Signals merged at a receiver.
+	unsigned long  overflowed; ///< Signals rejected by a full queue.
+	unsigned long  timeouts;   ///< Retransmission timeouts.
+} t_sim;
+
+/**
+ * @internal
+ * @brief Returns the next value of the xorshift64* generator.
+ */
+static unsigned long sim_rand(t_sim* sim)
+{
+	sim->rng ^= sim->rng >> 12;
+	sim->rng ^= sim->rng << 25;
+	sim->rng ^= sim->rng >> 27;
+	return (sim->rng * 2685821657736338717UL);
+}
+
+/**
+ * @internal
+ * @brief Returns whether the first event must be processed before the second.
+ */
+static bool event_before(const t_sim_event* a, const t_sim_event* b)
+{
+	if (a->time != b->time)
+		return (a->time < b->time);
+	return (a->seq < b->seq);
+}
+
+/**
+ * @brief Schedules an event `delay` nanoseconds after the current time.
+ *
+ * @param sim The simulation.
+ * @param delay Virtual delay before the event fires.
+ * @param type The kind of event.
+ * @param sig The signal carried by the event.
+ * @param value The value queued with the signal, or the generation of a
+ * timer.
+ *
+ * @ingroup simulator
+ */
+static void schedule(t_sim* sim, long delay, int type, int sig, int value)
+{
+	t_sim_event ev;
+	size_t      i;
+
+	if (sim->heap_len == sim->heap_cap)
+	{
+		sim->heap_cap = sim->heap_cap ? sim->heap_cap * 2 : 64;
+		sim->heap     = realloc(sim->heap, sim->heap_cap * sizeof(*sim->heap));
+		if (!sim->heap)
+			sys_error("Simulator: malloc failed");
+	}
+	ev = (t_sim_event){sim->now + delay, sim->next_seq++, type, sig, value};
+	i  = sim->heap_len++;
+	while (i > 0 && event_before(&ev, &sim->heap[(i - 1) / 2]))
+	{
+		sim->heap[i] = sim->heap[(i - 1) / 2];
+		i            = (i - 1) / 2;
+	}
+	sim->heap[i] = ev;
+}
+
+/**
+ * @brief Removes and returns the earliest scheduled event.
+ *
+ * @param sim The simulation; its heap must not be empty.
+ * @return The earliest event.
+ *
+ * @ingroup simulator
+ */
+static t_sim_event next_event(t_sim* sim)
+{
+	t_sim_event top;
+	t_sim_event last;
+	size_t      i;
+	size_t      child;
+
+	top  = sim->heap[0];
+	last = sim->heap[--sim->heap_len];
+	i    = 0;
+	while ((child = 2 * i + 1) < sim->heap_len)
+	{
+		if (child + 1 < sim->heap_len
+			&& event_before(&sim->heap[child + 1], &sim->heap[child]))
+			child++;
+		if (!event_before(&sim->heap[child], &last))
+			break;
+		sim->heap[i] = sim->heap[child];
+		i            = child;
+	}
+	sim->heap[i] = last;
+	return (top);
+}
+
+/**
+ * @brief Emits a signal towards the other side of the simulated link.
+ *
+ * @details
+ * The signal may be lost according to the configured loss rate; otherwise
+ * it arrives after the base latency plus a random jitter.
+ *
+ * @param sim The simulation.
+ * @param delay Virtual time spent before the signal is emitted.
+ * @param type Arrival event type (`SIM_SERVER_ARRIVE` or `SIM_CLIENT_ARRIVE`).
+ * @param sig The signal to emit.
+ * @param value The value queued with it.
+ *
+ * @ingroup simulator
+ */
+static void emit(t_sim* sim, long delay, int type, int sig, int value)
+{
+	long jitter;
+
+	sim->sent++;
+	if (sim->cfg.loss > 0
+		&& (double) (sim_rand(sim) >> 11) / 9007199254740992.0 < sim->cfg.loss)
+	{
+		sim->lost++;
+		return;
+	}
+	jitter = 0;
+	if (sim->cfg.jitter_ns > 0)
+		jitter = (long) (sim_rand(sim)
+						 % (unsigned long) (sim->cfg.jitter_ns + 1));
+	schedule(sim, delay + sim->cfg.latency_ns + jitter, type, sig, value);
+}
+
+/**
+ * @brief Starts the handler of an endpoint if it is idle and has work.
+ *
+ * @details
+ * With coalescing enabled the lowest-numbered pending signal is delivered
+ * first, as the kernel does for standard signals; otherwise pending
+ * signals are delivered in arrival order.
+ *
+ * @param sim The simulation.
+ * @param ep The endpoint to run.
+ * @param done_type Event fired when the handler returns.
+ * @param cost Virtual duration of one handler invocation.
+ *
+ * @ingroup simulator
+ */
+static void run_handler(t_sim* sim, t_sim_endpoint* ep, int done_type,
+						long cost)
+{
+	t_sim_signal sig;
+	int          pick;
+
+	if (ep->busy || ep->count == 0)
+		return;
+	pick = 0;
+	if (sim->cfg.coalesce && ep->count > 1
+		&& ep->pending[1].sig < ep->pending[0].sig)
+		pick = 1;
+	sig = ep->pending[pick];
+	memmove(&ep->pending[pick], &ep->pending[pick + 1],
+			(ep->count - pick - 1) * sizeof(*ep->pending));
+	ep->count--;
+	ep->busy = true;
+	schedule(sim, cost, done_type, sig.sig, sig.value);
+}
+
+/**
+ * @brief Queues an arriving signal at an endpoint.
+ *
+ * Only standard signals coalesce; real-time ones are always queued.
+ *
+ * @param sim The simulation.
+ * @param ep The receiving endpoint.
+ * @param sig The arriving signal.
+ * @param value The value queued with it.
+ *
+ * @ingroup simulator
+ */
+static void deliver(t_sim* sim, t_sim_endpoint* ep, int sig, int value)
+{
+	int i;
+
+	i = 0;
+	while (sim->cfg.coalesce && sig < SIGRTMIN && i < ep->count)
+	{
+		if (ep->pending[i++].sig == sig)
+		{
+			sim->coalesced++;
+			return;
+		}
+	}
+	if (ep->count >= sim->cfg.queue_limit)
+	{
+		sim->overflowed++;
+		return;
+	}
+	ep->pending[ep->count++] = (t_sim_signal){sig, value};
+}
+
+/**
+ * @brief Sends the next bit of the message from the simulated classic
+ * client.
+ *
+ * @param sim The simulation.
+ * @param delay Virtual time spent by the client before sending.
+ *
+ * @ingroup simulator
+ */
+static void client_send_next(t_sim* sim, long delay)
+{
+	int sig;
+
+	sig = encoder_next_signal(&sim->enc);
+	if (sig)
+		emit(sim, delay, SIM_SERVER_ARRIVE, sig, 0);
+}
+
+/**
+ * @brief Arms the client's timer for the oldest frame in flight.
+ *
+ * @details
+ * Timers are never cancelled: arming a new one makes the previous ones
+ * stale, and a stale timer is ignored when it fires.
+ *
+ * @param sim The simulation.
+ *
+ * @ingroup simulator
+ */
+static void arm_timer(t_sim* sim)
+{
+	long delay;
+
+	sim->timer++;
+	if (sim->win.base == sim->win.next)
+		return;
+	delay = sim->win.sent_ns[sim->win.base % MT_SACK_WINDOW]
+			+ sim->win.rto_ns - sim->now;
+	if (delay < 0)
+		delay = 0;
+	schedule(sim, delay, SIM_CLIENT_TIMEOUT, 0, sim->timer);
+}
+
+/**
+ * @brief Sends a frame of the window, numbered like send_frame() does.
+ *
+ * @param sim The simulation.
+ * @param frame Number of the frame.
+ *
+ * @ingroup simulator
+ */
+static void send_frame(t_sim* sim, uint32_t frame)
+{
+	sim->win.sent_ns[frame % MT_SACK_WINDOW] = sim->now;
+	emit(sim, 0, SIM_SERVER_ARRIVE, sim->win.sig[frame % MT_SACK_WINDOW],
+		 frame & MT_FRAME_MASK);
+}
+
+/**
+ * @brief Sends again the frames in flight the server does not hold.
+ *
+ * @param sim The simulation.
+ * @param end Frames from this one on are left alone.
+ * @param min_age_ns Frames sent more recently than this are left alone.
+ *
+ * @ingroup simulator
+ */
+static void resend_missing(t_sim* sim, uint32_t end, long min_age_ns)
+{
+	t_window* win;
+	uint32_t  frame;
+
+	win   = &sim->win;
+	frame = win->base;
+	while (frame < end)
+	{
+		if (!(win->sack & (1u << (frame - win->base)))
+			&& sim->now - win->sent_ns[frame % MT_SACK_WINDOW] >= min_age_ns)
+		{
+			win->resent[frame % MT_SACK_WINDOW] = true;
+			win->resends++;
+			send_frame(sim, frame);
+		}
+		frame++;
+	}
+}
+
+/**
+ * @brief Tells whether a frame with the same signal is still in flight.
+ *
+ * @param win The window.
+ * @param sig The signal of the next frame.
+ * @return true if sending it now could merge it with that frame.
+ *
+ * @ingroup simulator
+ */
+static bool in_flight(const t_window* win, int sig)
+{
+	uint32_t frame;
+
+	frame = win->base;
+	while (frame < win->next)
+	{
+		if (win->sig[frame % MT_SACK_WINDOW] == sig
+			&& !(win->sack & (1u << (frame - win->base))))
+			return (true);
+		frame++;
+	}
+	return (false);
+}
+
+/**
+ * @brief Sends new frames while the window has room, then arms the timer.
+ *
+ * @param sim The simulation.
+ *
+ * @ingroup simulator
+ */
+static void client_fill(t_sim* sim)
+{
+	t_window* win;
+
+	win = &sim->win;
+	while (sim->next_sig && win->next - win->base < win->size
+		   && (win->base > 0 || win->next == 0)
+		   && !in_flight(win, sim->next_sig))
+	{
+		win->sig[win->next % MT_SACK_WINDOW]    = sim->next_sig;
+		win->resent[win->next % MT_SACK_WINDOW] = false;
+		send_frame(sim, win->next++);
+		sim->next_sig = encoder_next_signal(&sim->enc);
+	}
+	arm_timer(sim);
+}
+
+/**
+ * @brief Applies a SACK ack to the client's window, like window_ack().
+ *
+ * @param sim The simulation.
+ * @param value Payload of the ack.
+ *
+ * @ingroup simulator
+ */
+static void client_ack(t_sim* sim, int value)
+{
+	t_window* win;
+	uint32_t  adv;
+	uint32_t  last;
+
+	win = &sim->win;
+	adv = (((uint32_t) value >> 16) - win->base) & MT_FRAME_MASK;
+	if (adv > win->next - win->base)
+		return;
+	if (adv > 0)
+	{
+		last = win->base + adv - 1;
+		if (!win->resent[last % MT_SACK_WINDOW]
+			&& !(win->sack & (1u << (adv - 1))))
+			sim->rtt_ns += (sim->now - win->sent_ns[last % MT_SACK_WINDOW]
+							- sim->rtt_ns) / 8;
+		while (win->base <= last)
+			win->resent[win->base++ % MT_SACK_WINDOW] = false;
+		win->sack    = value & 0xffff;
+		win->rto_ns  = 4 * sim->rtt_ns;
+		sim->retries = 0;
+		if (win->rto_ns < MT_RTO_MIN_NS)
+			win->rto_ns = MT_RTO_MIN_NS;
+	}
+	else
+		win->sack |= value & 0xffff;
+	if (win->sack == 0)
+	{
+		if (win->size < MT_SACK_WINDOW)
+			win->size++;
+		return;
+	}
+	if (win->size > 1)
+		win->size /= 2;
+	last = win->base;
+	while (win->sack >> (last - win->base + 1))
+		last++;
+	resend_missing(sim, last, sim->rtt_ns);
+}
+
+/**
+ * @brief Handles the client's timeout, like window_recover().
+ *
+ * @details
+ * The window shrinks to one frame, the missing frames are sent again and
+ * the timeout doubles, up to `MT_RTO_MAX_NS`. Unlike the real client,
+ * which keeps trying while the server exists, the simulated one gives up
+ * after `SIM_MAX_RETRIES` timeouts in a row, so that a lost final ack
+ * does not run the simulation forever.
+ *
+ * @param sim The simulation.
+ *
+ * @ingroup simulator
+ */
+static void client_timeout(t_sim* sim)
+{
+	if (++sim->retries > SIM_MAX_RETRIES)
+	{
+		sim->gave_up = true;
+		return;
+	}
+	sim->timeouts++;
+	sim->win.size = 1;
+	resend_missing(sim, sim->win.next, 0);
+	sim->win.rto_ns *= 2;
+	if (sim->win.rto_ns > MT_RTO_MAX_NS)
+		sim->win.rto_ns = MT_RTO_MAX_NS;
+}
+
+/**
+ * @brief Feeds one bit into the server's decoder.
+ *
+ * @param sim The simulation.
+ * @param sig The signal carrying the bit.
+ *
+ * @ingroup simulator
+ */
+static void server_decode(t_sim* sim, int sig)
+{
+	int c;
+
+	c = decoder_feed(&sim->dec, sig);
+	if (c == 0)
+		sim->finished = true;
+	else if (c > 0 && sim->out_len < sim->out_cap)
+		sim->out[sim->out_len++] = (char) c;
+}
+
+/**
+ * @brief Serves one numbered frame, like session_frame() and
+ * session_serve().
+ *
+ * @details
+ * Frames ahead of the expected one are held in the SACK bitmap until the
+ * gap is filled. Each frame is acknowledged with the next frame expected
+ * and the bitmap, until the message ended: the session is then closed
+ * and later copies are dropped without an answer.
+ *
+ * @param sim The simulation.
+ * @param sig The received signal.
+ * @param frame The frame number.
+ *
+ * @ingroup simulator
+ */
+static void server_frame(t_sim* sim, int sig, int frame)
+{
+	unsigned ahead;
+
+	if (sim->finished)
+		return;
+	ahead = (frame - sim->frame) & MT_FRAME_MASK;
+	if (ahead > 0 && ahead < MT_SACK_WINDOW)
+	{
+		sim->sack |= 1u << ahead;
+		sim->sack_bits &= ~(1u << ahead);
+		if (sig == SIGUSR1)
+			sim->sack_bits |= 1u << ahead;
+	}
+	else if (ahead == 0)
+	{
+		server_decode(sim, sig);
+		sim->frame = (sim->frame + 1) & MT_FRAME_MASK;
+		sim->sack >>= 1;
+		sim->sack_bits >>= 1;
+		while (!sim->finished && (sim->sack & 1))
+		{
+			server_decode(sim, (sim->sack_bits & 1) ? SIGUSR1 : SIGUSR2);
+			sim->frame = (sim->frame + 1) & MT_FRAME_MASK;
+			sim->sack >>= 1;
+			sim->sack_bits >>= 1;
+		}
+	}
+	emit(sim, 0, SIM_CLIENT_ARRIVE, MT_SIG_ACK, sim->frame << 16 | sim->sack);
+}
+
+/**
+ * @brief Processes one event of the simulation.
+ *
+ * @param sim The simulation.
+ * @param ev The event to process; `sim->now` is already set to its time.
+ *
+ * @ingroup simulator
+ */
+static void handle_event(t_sim* sim, t_sim_event ev)
+{
+	if (ev.type == SIM_SERVER_ARRIVE)
+		deliver(sim, &sim->server, ev.sig, ev.value);
+	else if (ev.type == SIM_CLIENT_ARRIVE)
+		deliver(sim, &sim->client, ev.sig, ev.value);
+	else if (ev.type == SIM_SERVER_DONE)
+	{
+		sim->server.busy = false;
+		if (sim->cfg.classic)
+		{
+			server_decode(sim, ev.sig);
+			emit(sim, 0, SIM_CLIENT_ARRIVE, SIGUSR1, 0);
+		}
+		else
+			server_frame(sim, ev.sig, ev.value);
+	}
+	else if (ev.type == SIM_CLIENT_DONE)
+	{
+		sim->client.busy = false;
+		if (sim->cfg.classic)
+			client_send_next(sim, 0);
+		else if (!sim->gave_up)
+		{
+			client_ack(sim, ev.value);
+			client_fill(sim);
+		}
+	}
+	else if (ev.value == sim->timer && !sim->gave_up)
+	{
+		client_timeout(sim);
+		if (!sim->gave_up)
+			client_fill(sim);
+	}
+	run_handler(sim, &sim->server, SIM_SERVER_DONE, sim->cfg.server_cost_ns);
+	run_handler(sim, &sim->client, SIM_CLIENT_DONE, sim->cfg.client_cost_ns);
+}
+
+/**
+ * @brief Measures the real CPU cost of encoding and decoding a message.
+ *
+ * @details
+ * Runs the encoder straight into the decoder, with no transport in
+ * between, enough times to last a few milliseconds.
+ *
+ * @param msg The message to encode.
+ * @param len Length of the message.
+ * @return Nanoseconds of CPU time per message byte.
+ *
+ * @ingroup simulator
+ */
+static double measure_codec_cost(const char* msg, size_t len)
+{
+	struct timespec start;
+	struct timespec end;
+	t_encoder       enc;
+	t_decoder       dec;
+	unsigned long   rounds;
+	volatile int    sink;
+	int             sig;
+	double          elapsed;
+
+	rounds  = 0;
+	elapsed = 0;
+	decoder_init(&dec);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (elapsed < 5e6)
+	{
+		encoder_init(&enc, msg);
+		while ((sig = encoder_next_signal(&enc)))
+			sink = decoder_feed(&dec, sig);
+		rounds++;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9
+				  + (end.tv_nsec - start.tv_nsec);
+	}
+	(void) sink;
+	return (elapsed / ((double) rounds * (double) (len + 1)));
+}
+
+/**
+ * @brief Loads the message to transfer from a file or generates one.
+ *
+ * @details
+ * Generated messages consist of printable characters drawn from the
+ * seeded PRNG. File contents are truncated at the first null byte, since
+ * the protocol cannot carry one.
+ *
+ * @param sim The simulation, already seeded.
+ * @param len Set to the length of the message.
+ * @return The message, allocated with malloc.
+ *
+ * @ingroup simulator
+ */
+static char* load_message(t_sim* sim, size_t* len)
+{
+	char*  msg;
+	FILE*  f;
+	size_t i;
+
+	if (sim->cfg.file)
+	{
+		f = fopen(sim->cfg.file, "rb");
+		if (!f || fseek(f, 0, SEEK_END) == -1)
+			sys_error("Simulator: cannot open message file");
+		*len = (size_t) ftell(f);
+		rewind(f);
+		msg = malloc(*len + 1);
+		if (!msg || fread(msg, 1, *len, f) != *len)
+			sys_error("Simulator: cannot read message file");
+		fclose(f);
+		msg[*len] = '\0';
+		*len      = strlen(msg);
+		return (msg);
+	}
+	*len = sim->cfg.size;
+	msg  = malloc(*len + 1);
+	if (!msg)
+		sys_error("Simulator: malloc failed");
+	i = 0;
+	while (i < *len)
+		msg[i++] = (char) (' ' + sim_rand(sim) % 95);
+	msg[*len] = '\0';
+	return (msg);
+}
+
+/**
+ * @brief Parses the command-line options of the simulator.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param cfg Configuration filled with defaults and the parsed options.
+ *
+ * @note Exits with a usage message on an unknown option.
+ *
+ * @ingroup simulator
+ */
+static void parse_options(int argc, char** argv, t_sim_config* cfg)
+{
+	int opt;
+
+	*cfg = (t_sim_config){.latency_ns     = 5000,
+						  .server_cost_ns = 2000,
+						  .client_cost_ns = 1000,
+						  .coalesce       = true,
+						  .queue_limit    = 64,
+						  .seed           = 42,
+						  .size           = 1024};
+	while ((opt = getopt(argc, argv, "s:f:l:j:c:C:p:q:nkS:")) != -1)
+	{
+		if (opt == 's')
+			cfg->size = strtoul(optarg, NULL, 10);
+		else if (opt == 'f')
+			cfg->file = optarg;
+		else if (opt == 'l')
+			cfg->latency_ns = (long) (atof(optarg) * 1000);
+		else if (opt == 'j')
+			cfg->jitter_ns = (long) (atof(optarg) * 1000);
+		else if (opt == 'c')
+			cfg->server_cost_ns = (long) (atof(optarg) * 1000);
+		else if (opt == 'C')
+			cfg->client_cost_ns = (long) (atof(optarg) * 1000);
+		else if (opt == 'p')
+			cfg->loss = atof(optarg);
+		else if (opt == 'q')
+			cfg->queue_limit = atoi(optarg);
+		else if (opt == 'n')
+			cfg->coalesce = false;
+		else if (opt == 'k')
+			cfg->classic = true;
+		else if (opt == 'S')
+			cfg->seed = strtoul(optarg, NULL, 10);
+		else
+		{
+			fprintf(stderr, "Usage: ./simulator [-s size] [-f file] "
+							"[-l latency_us] [-j jitter_us] "
+							"[-c server_cost_us] [-C client_cost_us] "
+							"[-p loss] [-q limit] [-n] [-k] [-S seed]\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (cfg->queue_limit < 1)
+		cfg->queue_limit = 1;
+	if (cfg->seed == 0)
+		cfg->seed = 1;
+}
+
+/**
+ * @brief Prints the outcome of a simulated transfer.
+ *
+ * @param sim The finished simulation.
+ * @param msg The message that was sent.
+ * @param len Length of the message.
+ *
+ * @ingroup simulator
+ */
+static void report(const t_sim* sim, const char* msg, size_t len)
+{
+	bool   intact;
+	double seconds;
+
+	intact  = sim->finished && sim->out_len == len
+			 && memcmp(sim->out, msg, len) == 0;
+	seconds = sim->now / 1e9;
+	printf("status:          %s\n", sim->finished ? "complete" : "stalled");
+	printf("intact:          %s\n", intact ? "yes" : "no");
+	printf("bytes:           %zu/%zu\n", sim->out_len, len);
+	printf("virtual_time_s:  %.6f\n", seconds);
+	if (seconds > 0)
+		printf("goodput_Bps:     %.1f\n", sim->out_len / seconds);
+	printf("signals_sent:    %lu\n", sim->sent);
+	printf("signals_lost:    %lu\n", sim->lost);
+	printf("signals_merged:  %lu\n", sim->coalesced);
+	printf("signals_dropped: %lu\n", sim->overflowed);
+	if (!sim->cfg.classic)
+	{
+		printf("frames_resent:   %lu\n", sim->win.resends);
+		printf("timeouts:        %lu\n", sim->timeouts);
+		printf("client:          %s\n", sim->gave_up ? "gave up" : "done");
+	}
+	printf("cpu_ns_per_byte: %.2f\n", measure_codec_cost(msg, len));
+}
+
+/**
+ * @brief Entry point of the transport simulator.
+ *
+ * Builds the message, runs the transfer until the event queue drains and
+ * prints the report. A transfer that drains the queue without decoding
+ * the terminator is reported as stalled: with `-k`, the stop-and-wait
+ * protocol has no way to recover from a lost bit or acknowledgment, and
+ * the numbered one stalls once the client gives up.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS if the message arrived intact, EXIT_FAILURE otherwise.
+ *
+ * @ingroup simulator
+ */
+int main(int argc, char** argv)
+{
+	t_sim  sim;
+	char*  msg;
+	size_t len;
+
+	memset(&sim, 0, sizeof(sim));
+	parse_options(argc, argv, &sim.cfg);
+	sim.rng            = sim.cfg.seed;
+	msg                = load_message(&sim, &len);
+	sim.out_cap        = len;
+	sim.out            = malloc(len + 1);
+	sim.server.pending = malloc(sim.cfg.queue_limit * sizeof(t_sim_signal));
+	sim.client.pending = malloc(sim.cfg.queue_limit * sizeof(t_sim_signal));
+	if (!sim.out || !sim.server.pending || !sim.client.pending)
+		sys_error("Simulator: malloc failed");
+	encoder_init(&sim.enc, msg);
+	decoder_init(&sim.dec);
+	sim.win.size   = 1;
+	sim.win.rto_ns = MT_RTO_MIN_NS;
+	sim.rtt_ns     = MT_RTT_INITIAL_NS;
+	if (sim.cfg.classic)
+		client_send_next(&sim, 0);
+	else
+	{
+		sim.next_sig = encoder_next_signal(&sim.enc);
+		client_fill(&sim);
+	}
+	while (sim.heap_len > 0)
+	{
+		t_sim_event ev = next_event(&sim);
+
+		sim.now = ev.time;
+		handle_event(&sim, ev);
+	}
+	report(&sim, msg, len);
+	free(sim.heap);
+	free(sim.server.pending);
+	free(sim.client.pending);
+	free(sim.out);
+	free(msg);
+	return (sim.finished ? EXIT_SUCCESS : EXIT_FAILURE);
+}
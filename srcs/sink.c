@@ -0,0 +1,471 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   sink.c                                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 17:12:50 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 17:12:50 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file sink.c
+ * @brief Batched output through io_uring, with a `writev()` fallback.
+ *
+ * @details
+ * The writer thread hands each batch of queued chunks to its sink as one
+ * vector. With io_uring the batch becomes a single `WRITEV` submission,
+ * linked to an `FSYNC` when the output is a regular file opened with
+ * syncing on. The submission stays in flight while the writer gathers the
+ * next batch, and its completion is reaped from the ring on the next
+ * pass; the writer only blocks on it when it has nothing else to do or
+ * the next batch is ready first. Without io_uring, or when it is
+ * disabled, each batch is written with `writev()` followed by
+ * `fdatasync()` before the call returns.
+ *
+ * The ring is driven with raw system calls, so no library is needed; the
+ * layout comes from `<linux/io_uring.h>`. Only the writer thread uses a
+ * sink.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/** Submission queue entries requested from the kernel. */
+#define MT_SINK_ENTRIES 4
+
+/**
+ * @brief Maps the submission and completion rings of a new io_uring.
+ *
+ * @param s The sink, whose `ring_fd` is the new ring.
+ * @param p Parameters filled in by `io_uring_setup()`.
+ * @return true on success, false if a mapping failed.
+ *
+ * @ingroup server
+ */
+static bool uring_map(t_sink* s, const struct io_uring_params* p)
+{
+	s->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	s->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if ((p->features & IORING_FEAT_SINGLE_MMAP) && s->cq_len > s->sq_len)
+		s->sq_len = s->cq_len;
+	s->sq_ptr = mmap(NULL, s->sq_len, PROT_READ | PROT_WRITE,
+					 MAP_SHARED | MAP_POPULATE, s->ring_fd, IORING_OFF_SQ_RING);
+	if (s->sq_ptr == MAP_FAILED)
+		return (false);
+	s->cq_ptr = s->sq_ptr;
+	if (!(p->features & IORING_FEAT_SINGLE_MMAP))
+		s->cq_ptr = mmap(NULL, s->cq_len, PROT_READ | PROT_WRITE,
+						 MAP_SHARED | MAP_POPULATE, s->ring_fd,
+						 IORING_OFF_CQ_RING);
+	s->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+	s->sqes     = mmap(NULL, s->sqes_len, PROT_READ | PROT_WRITE,
+					   MAP_SHARED | MAP_POPULATE, s->ring_fd, IORING_OFF_SQES);
+	if (s->cq_ptr == MAP_FAILED || s->sqes == MAP_FAILED)
+		return (false);
+	s->sq_tail  = (unsigned*) ((char*) s->sq_ptr + p->sq_off.tail);
+	s->sq_mask  = *(unsigned*) ((char*) s->sq_ptr + p->sq_off.ring_mask);
+	s->sq_array = (unsigned*) ((char*) s->sq_ptr + p->sq_off.array);
+	s->cq_head  = (unsigned*) ((char*) s->cq_ptr + p->cq_off.head);
+	s->cq_tail  = (unsigned*) ((char*) s->cq_ptr + p->cq_off.tail);
+	s->cq_mask  = *(unsigned*) ((char*) s->cq_ptr + p->cq_off.ring_mask);
+	s->cqes = (struct io_uring_cqe*) ((char*) s->cq_ptr + p->cq_off.cqes);
+	return (true);
+}
+
+/**
+ * @brief Releases the io_uring of a sink, if any.
+ *
+ * @param s The sink.
+ *
+ * @ingroup server
+ */
+static void uring_close(t_sink* s)
+{
+	if (s->sqes && s->sqes != MAP_FAILED)
+		munmap(s->sqes, s->sqes_len);
+	if (s->cq_ptr && s->cq_ptr != MAP_FAILED && s->cq_ptr != s->sq_ptr)
+		munmap(s->cq_ptr, s->cq_len);
+	if (s->sq_ptr && s->sq_ptr != MAP_FAILED)
+		munmap(s->sq_ptr, s->sq_len);
+	if (s->ring_fd != -1)
+		close(s->ring_fd);
+	s->ring_fd = -1;
+}
+
+/**
+ * @brief Prepares the output of a sink.
+ *
+ * @details
+ * Syncing is only kept for regular files, the only outputs `fdatasync()`
+ * applies to. The io_uring is set up unless `MT_SINK_WRITEV` is given;
+ * any failure there silently selects the `writev()` path.
+ *
+ * @param s The sink to initialise.
+ * @param fd Output descriptor.
+ * @param flags `MT_SINK_WRITEV` and/or `MT_SINK_SYNC`.
+ *
+ * @ingroup server
+ */
+void sink_open(t_sink* s, int fd, unsigned flags)
+{
+	struct io_uring_params p;
+	struct stat            st;
+
+	memset(s, 0, sizeof(*s));
+	s->fd      = fd;
+	s->ring_fd = -1;
+	s->sync = (flags & MT_SINK_SYNC) && fstat(fd, &st) == 0
+			  && S_ISREG(st.st_mode);
+	if (flags & MT_SINK_WRITEV)
+		return;
+	memset(&p, 0, sizeof(p));
+	s->ring_fd = syscall(__NR_io_uring_setup, MT_SINK_ENTRIES, &p);
+	if (s->ring_fd < 0)
+		s->ring_fd = -1;
+	else if (!uring_map(s, &p))
+		uring_close(s);
+	s->uring = s->ring_fd != -1;
+}
+
+/**
+ * @brief Adds one entry to the submission queue.
+ *
+ * @param s The sink.
+ * @param sqe Entry to copy.
+ *
+ * @ingroup server
+ */
+static void uring_queue(t_sink* s, const struct io_uring_sqe* sqe)
+{
+	unsigned tail;
+	unsigned idx;
+
+	tail             = *s->sq_tail;
+	idx              = tail & s->sq_mask;
+	s->sqes[idx]     = *sqe;
+	s->sq_array[idx] = idx;
+	__atomic_store_n(s->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Moves the vector in flight past bytes the kernel has written.
+ *
+ * @details
+ * An interrupted or would-block write is simply tried again. A write that
+ * makes no progress is an error, not a reason to try forever.
+ *
+ * @param s The sink.
+ * @param n Bytes written, or a negated `errno` value.
+ *
+ * @note On a write error the program exits with an error message using
+ * `sys_error()`.
+ *
+ * @ingroup server
+ */
+static void sink_advance(t_sink* s, long n)
+{
+	if (n == -EINTR || n == -EAGAIN)
+		return;
+	if (n == 0)
+		n = -EIO;
+	if (n < 0)
+	{
+		errno = -n;
+		sys_error("Server: write failed");
+	}
+	while (s->cnt > 0 && (size_t) n >= s->iov->iov_len)
+	{
+		n -= s->iov->iov_len;
+		s->iov++;
+		s->cnt--;
+	}
+	if (s->cnt > 0)
+	{
+		s->iov->iov_base = (char*) s->iov->iov_base + n;
+		s->iov->iov_len -= n;
+	}
+}
+
+/**
+ * @brief Writes the vector in flight with `writev()`, then syncs it.
+ *
+ * @param s The sink.
+ *
+ * @note On a write error the program exits with an error message using
+ * `sys_error()`.
+ *
+ * @ingroup server
+ */
+static void fd_writev(t_sink* s)
+{
+	ssize_t n;
+
+	while (s->cnt > 0)
+	{
+		n = writev(s->fd, s->iov, s->cnt);
+		if (n < 0)
+			n = -errno;
+		s->submits++;
+		sink_advance(s, n);
+	}
+	if (s->sync && fdatasync(s->fd) == -1)
+		sys_error("Server: fdatasync failed");
+}
+
+/**
+ * @brief Submits the entries queued so far, and optionally waits for one
+ * completion.
+ *
+ * @details
+ * Entries the kernel did not take stay counted in `unsent` and go with
+ * the next call; nothing is queued twice, so no byte can be written twice
+ * after an interrupted or refused call.
+ *
+ * @param s The sink.
+ * @param wait Whether to wait for a completion.
+ *
+ * @note Exits with an error message using `sys_error()` if the ring
+ * fails for another reason than an interruption or a busy kernel.
+ *
+ * @ingroup server
+ */
+static void uring_enter(t_sink* s, bool wait)
+{
+	unsigned flags;
+	long     ret;
+
+	flags = 0;
+	if (wait)
+		flags = IORING_ENTER_GETEVENTS;
+	ret = syscall(__NR_io_uring_enter, s->ring_fd, s->unsent, (unsigned) wait,
+				  flags, NULL, 0);
+	if (ret >= 0)
+		s->unsent -= ret;
+	else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		sys_error("Server: io_uring_enter failed");
+}
+
+/**
+ * @brief Queues the vector in flight, and a sync if enabled, and hands
+ * them to the kernel without waiting.
+ *
+ * @details
+ * The `WRITEV` entry is linked to an `FSYNC` entry when syncing. A short
+ * write breaks the link, so the sync is cancelled and redone with the
+ * rest of the vector.
+ *
+ * @param s The sink.
+ *
+ * @ingroup server
+ */
+static void uring_submit(t_sink* s)
+{
+	struct io_uring_sqe sqe;
+
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode    = IORING_OP_WRITEV;
+	sqe.fd        = s->fd;
+	sqe.addr      = (uintptr_t) s->iov;
+	sqe.len       = s->cnt;
+	sqe.off       = (uint64_t) -1;
+	sqe.user_data = IORING_OP_WRITEV;
+	sqe.flags     = s->sync ? IOSQE_IO_LINK : 0;
+	uring_queue(s, &sqe);
+	s->pending = 1;
+	if (s->sync)
+	{
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode      = IORING_OP_FSYNC;
+		sqe.fd          = s->fd;
+		sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+		sqe.user_data   = IORING_OP_FSYNC;
+		uring_queue(s, &sqe);
+		s->pending = 2;
+	}
+	s->unsent = s->pending;
+	s->res    = 0;
+	s->submits++;
+	uring_enter(s, false);
+}
+
+/**
+ * @brief Consumes the completions the kernel has posted so far.
+ *
+ * @param s The sink.
+ *
+ * @ingroup server
+ */
+static void uring_reap(t_sink* s)
+{
+	struct io_uring_cqe cqe;
+	unsigned            head;
+
+	head = *s->cq_head;
+	while (s->pending > 0
+		   && head != __atomic_load_n(s->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		cqe = s->cqes[head & s->cq_mask];
+		head++;
+		if (cqe.user_data == IORING_OP_WRITEV)
+			s->res = cqe.res;
+		else if (cqe.res < 0 && cqe.res != -ECANCELED && s->res >= 0)
+			s->res = cqe.res;
+		s->pending--;
+	}
+	__atomic_store_n(s->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Moves the batch in flight on through the io_uring.
+ *
+ * @details
+ * Applies the completions posted so far and submits the rest of the
+ * vector after a short write. Only one submission is ever in flight, so
+ * the output keeps the order of the batches.
+ *
+ * @param s The sink.
+ * @param wait Whether to block until the whole batch is written.
+ * @return true once nothing is left in flight.
+ *
+ * @ingroup server
+ */
+static bool uring_progress(t_sink* s, bool wait)
+{
+	while (s->cnt > 0)
+	{
+		uring_reap(s);
+		if (s->pending > 0)
+		{
+			if (!wait && s->unsent == 0)
+				return (false);
+			uring_enter(s, wait);
+			if (!wait)
+				return (false);
+			continue;
+		}
+		sink_advance(s, s->res);
+		if (s->cnt > 0)
+			uring_submit(s);
+	}
+	return (true);
+}
+
+/**
+ * @brief Starts writing a vector to the sink's output.
+ *
+ * @details
+ * With io_uring the call returns once the vector is submitted: `iov` and
+ * the bytes it points to must stay untouched until sink_poll() returns
+ * true or sink_finish() returns. Without it, the vector is written before
+ * the call returns. A batch still in flight is finished first.
+ *
+ * @param s The sink.
+ * @param iov Vector to write; modified.
+ * @param cnt Number of entries, at most `IOV_MAX`.
+ *
+ * @note On a write error the program exits with an error message using
+ * `sys_error()`.
+ *
+ * @ingroup server
+ */
+void sink_start(t_sink* s, struct iovec* iov, int cnt)
+{
+	sink_finish(s);
+	s->iov = iov;
+	s->cnt = cnt;
+	if (s->ring_fd == -1)
+		fd_writev(s);
+	else if (cnt > 0)
+		uring_submit(s);
+}
+
+/**
+ * @brief Tells whether the batch in flight is written, without blocking.
+ *
+ * @param s The sink.
+ * @return true if nothing is left in flight.
+ *
+ * @ingroup server
+ */
+bool sink_poll(t_sink* s)
+{
+	if (s->ring_fd == -1)
+		return (true);
+	return (uring_progress(s, false));
+}
+
+/**
+ * @brief Waits until the batch in flight, if any, is written.
+ *
+ * @details
+ * When syncing, the data has reached the disk on return.
+ *
+ * @param s The sink.
+ *
+ * @ingroup server
+ */
+void sink_finish(t_sink* s)
+{
+	if (s->ring_fd != -1)
+		uring_progress(s, true);
+}
+
+/**
+ * @brief Writes a whole vector to the sink's output before returning.
+ *
+ * @details
+ * Short writes are resumed where they stopped; `iov` is updated in place
+ * to do so. When syncing, the data has reached the disk on return.
+ *
+ * @param s The sink.
+ * @param iov Vector to write; modified.
+ * @param cnt Number of entries, at most `IOV_MAX`.
+ *
+ * @note On a write error the program exits with an error message using
+ * `sys_error()`.
+ *
+ * @ingroup server
+ */
+void sink_writev(t_sink* s, struct iovec* iov, int cnt)
+{
+	sink_start(s, iov, cnt);
+	sink_finish(s);
+}
+
+/**
+ * @brief Names the backend a sink ended up with, even once closed.
+ *
+ * @param s The sink.
+ * @return `"io_uring"` or `"writev"`.
+ *
+ * @ingroup server
+ */
+const char* sink_backend(const t_sink* s)
+{
+	if (s->uring)
+		return ("io_uring");
+	return ("writev");
+}
+
+/**
+ * @brief Releases the resources of a sink; the output stays open.
+ *
+ * @param s The sink.
+ *
+ * @ingroup server
+ */
+void sink_close(t_sink* s)
+{
+	sink_finish(s);
+	uring_close(s);
+}
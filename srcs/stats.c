@@ -0,0 +1,481 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   stats.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 22:41:16 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 22:41:16 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file stats.c
+ * @brief Live counters of the server in a shared-memory page.
+ *
+ * @details
+ * With `-m` the server maps `/minitalk-stats.<pid>` and keeps it current
+ * as it works: every thread handling sessions owns a lane of the page and
+ * updates it after each acknowledgment, the writer thread owns the output
+ * section and updates it after each round of writes. Each section is
+ * written by one thread only, under a seqlock: the sequence number is odd
+ * while an update is in progress, so a reader copies the section, checks
+ * that the number was even and did not move, and tries again otherwise.
+ *
+ * Publishing costs the server a few stores per signal and never waits;
+ * readers never signal, lock or otherwise disturb it, and may poll as
+ * often as they like.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup stats
+ */
+#include "minitalk.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Entries of a lane's client table looked at for a PID. */
+#define MT_STATS_PROBE 8
+
+/**
+ * @brief Builds the name of the shared-memory object of a server.
+ *
+ * @param name Buffer receiving the name.
+ * @param size Size of the buffer.
+ * @param pid PID of the server.
+ *
+ * @ingroup stats
+ */
+static void stats_name(char* name, size_t size, pid_t pid)
+{
+	snprintf(name, size, "/minitalk-stats.%d", (int) pid);
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in nanoseconds.
+ *
+ * @ingroup stats
+ */
+long stats_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+/**
+ * @brief Creates the stats page of this server.
+ *
+ * A page left behind by a crashed process that had the same PID is
+ * replaced. The magic bytes are written last, so a reader never takes a
+ * half-initialised page for a valid one.
+ *
+ * @return The page, mapped read-write.
+ *
+ * @note Exits with an error message if the page cannot be created.
+ *
+ * @ingroup stats
+ */
+t_stats_page* stats_open(void)
+{
+	t_stats_page* page;
+	char          name[64];
+	int           fd;
+
+	stats_name(name, sizeof(name), getpid());
+	shm_unlink(name);
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd == -1)
+		sys_error("Server: cannot create the stats page");
+	page = MAP_FAILED;
+	if (ftruncate(fd, sizeof(t_stats_page)) == 0)
+		page = mmap(NULL, sizeof(t_stats_page), PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+	{
+		shm_unlink(name);
+		sys_error("Server: cannot map the stats page");
+	}
+	page->pid     = getpid();
+	page->lanes   = MT_STATS_LANES;
+	page->started = time(NULL);
+	atomic_thread_fence(memory_order_release);
+	memcpy(page->magic, MT_STATS_MAGIC, 8);
+	return (page);
+}
+
+/**
+ * @brief Unmaps and removes the stats page of this server.
+ *
+ * @param page The page, or NULL if the server has none.
+ *
+ * @ingroup stats
+ */
+void stats_close(t_stats_page* page)
+{
+	char name[64];
+
+	if (!page)
+		return;
+	munmap(page, sizeof(t_stats_page));
+	stats_name(name, sizeof(name), getpid());
+	shm_unlink(name);
+}
+
+/**
+ * @brief Starts an update of a section.
+ *
+ * @param seq Sequence number of the section.
+ * @return The odd sequence number, to pass to seq_end().
+ *
+ * @ingroup stats
+ */
+static unsigned seq_begin(atomic_uint* seq)
+{
+	unsigned s;
+
+	s = atomic_load_explicit(seq, memory_order_relaxed) + 1;
+	atomic_store_explicit(seq, s, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	return (s);
+}
+
+/**
+ * @brief Ends an update of a section, making it readable again.
+ *
+ * @ingroup stats
+ */
+static void seq_end(atomic_uint* seq, unsigned s)
+{
+	atomic_store_explicit(seq, s + 1, memory_order_release);
+}
+
+/**
+ * @brief Returns the histogram bucket of a value.
+ *
+ * Bucket i holds the values from 2^i up to 2^(i+1) - 1; 0 and 1 go to
+ * the first one and anything too large to the last one.
+ *
+ * @ingroup stats
+ */
+static size_t stats_bucket(long value)
+{
+	size_t b;
+
+	if (value < 2)
+		return (0);
+	b = 63 - __builtin_clzl((unsigned long) value);
+	if (b >= MT_STATS_BUCKETS)
+		b = MT_STATS_BUCKETS - 1;
+	return (b);
+}
+
+/**
+ * @brief Adds what the table counted since the last update to its lane.
+ *
+ * @details
+ * Lanes only move forward. Counters reach the lane as differences with
+ * `shown`, so the counters a stopped session worker passes to the main
+ * table are not counted twice (see shards_stop()).
+ *
+ * @param table The session table.
+ * @param l Its lane, being updated.
+ *
+ * @ingroup stats
+ */
+static void lane_sync(t_sessions* table, t_stats_lane* l)
+{
+	l->messages += table->stats.messages - table->shown.messages;
+	l->bytes += table->stats.bytes - table->shown.bytes;
+	l->sessions += table->stats.sessions - table->shown.sessions;
+	l->aborted += table->stats.aborted - table->shown.aborted;
+	l->rejected += table->stats.rejected - table->shown.rejected;
+	l->active    = table->active;
+	table->shown = table->stats;
+}
+
+/**
+ * @brief Publishes a served data signal.
+ *
+ * @param table The session table that served it.
+ * @param start_ns When the signal was taken, from stats_now_ns(); the
+ * time since then, its acknowledgment included, goes to the histogram.
+ *
+ * @ingroup stats
+ */
+void stats_signal(t_sessions* table, long start_ns)
+{
+	t_stats_lane* l;
+	unsigned      seq;
+
+	l = table->lane;
+	if (!l)
+		return;
+	seq = seq_begin(&l->seq);
+	l->signals++;
+	l->ack_ns[stats_bucket(stats_now_ns() - start_ns)]++;
+	lane_sync(table, l);
+	seq_end(&l->seq, seq);
+}
+
+/**
+ * @brief Publishes the counters of a session table.
+ *
+ * Used outside of signal handling, when sessions were moved or aborted.
+ *
+ * @param table The session table.
+ *
+ * @ingroup stats
+ */
+void stats_publish(t_sessions* table)
+{
+	t_stats_lane* l;
+	unsigned      seq;
+
+	l = table->lane;
+	if (!l)
+		return;
+	seq = seq_begin(&l->seq);
+	lane_sync(table, l);
+	seq_end(&l->seq, seq);
+}
+
+/**
+ * @brief Finds the entry of a client in a lane, claiming one if needed.
+ *
+ * @details
+ * The PID is hashed into the table and the next `MT_STATS_PROBE` entries
+ * are searched. A client that is not there takes the first free entry, or
+ * else the one with the least traffic, so the busiest clients stay.
+ *
+ * @param l The lane, being updated.
+ * @param pid The client PID.
+ * @return The entry of the client.
+ *
+ * @ingroup stats
+ */
+static t_stats_client* client_entry(t_stats_lane* l, pid_t pid)
+{
+	t_stats_client* victim;
+	t_stats_client* e;
+	size_t          home;
+	size_t          k;
+
+	home   = (uint32_t) pid * 2654435761u % MT_STATS_CLIENTS;
+	victim = &l->clients[home];
+	k      = 0;
+	while (k < MT_STATS_PROBE)
+	{
+		e = &l->clients[(home + k++) % MT_STATS_CLIENTS];
+		if (e->pid == pid)
+			return (e);
+		if (e->pid == 0)
+		{
+			victim = e;
+			break;
+		}
+		if (e->bytes < victim->bytes)
+			victim = e;
+	}
+	victim->pid      = pid;
+	victim->bytes    = 0;
+	victim->messages = 0;
+	return (victim);
+}
+
+/**
+ * @brief Publishes bytes of a client written to the output.
+ *
+ * @param table The session table.
+ * @param pid The client PID.
+ * @param len Number of bytes.
+ *
+ * @ingroup stats
+ */
+void stats_flush(t_sessions* table, pid_t pid, size_t len)
+{
+	t_stats_lane* l;
+	unsigned      seq;
+
+	l = table->lane;
+	if (!l || len == 0)
+		return;
+	seq = seq_begin(&l->seq);
+	client_entry(l, pid)->bytes += len;
+	seq_end(&l->seq, seq);
+}
+
+/**
+ * @brief Publishes a completed message.
+ *
+ * @param table The session table.
+ * @param s The session that received it, still open.
+ *
+ * @ingroup stats
+ */
+void stats_message(t_sessions* table, const t_session* s)
+{
+	t_stats_lane* l;
+	unsigned      seq;
+
+	l = table->lane;
+	if (!l)
+		return;
+	seq = seq_begin(&l->seq);
+	l->msg_us[stats_bucket((stats_now_ns() - s->start_ns) / 1000)]++;
+	client_entry(l, s->pid)->messages++;
+	seq_end(&l->seq, seq);
+}
+
+/**
+ * @brief Publishes the state of the output queue.
+ *
+ * Called by the writer thread only.
+ *
+ * @param out The output section of the page.
+ * @param w The writer.
+ *
+ * @ingroup stats
+ */
+void stats_output(t_stats_output* out, t_writer* w)
+{
+	unsigned seq;
+
+	seq           = seq_begin(&out->seq);
+	out->capacity = w->mask + 1;
+	out->depth    = atomic_load_explicit(&w->head, memory_order_relaxed)
+				 - atomic_load_explicit(&w->tail, memory_order_relaxed);
+	out->max_depth = w->max_depth;
+	out->written   = w->written;
+	out->dropped   = atomic_load_explicit(&w->stats.dropped,
+										 memory_order_relaxed);
+	out->spilled   = atomic_load_explicit(&w->stats.spilled,
+										 memory_order_relaxed);
+	out->blocked   = atomic_load_explicit(&w->stats.blocked,
+										 memory_order_relaxed);
+	seq_end(&out->seq, seq);
+}
+
+/**
+ * @brief Maps the stats page of a running server, read-only.
+ *
+ * @param pid PID of the server.
+ * @return The page, or NULL if the server publishes none or it does not
+ * have the expected layout.
+ *
+ * @ingroup stats
+ */
+const t_stats_page* stats_attach(pid_t pid)
+{
+	t_stats_page* page;
+	struct stat   st;
+	char          name[64];
+	int           fd;
+
+	stats_name(name, sizeof(name), pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1)
+		return (NULL);
+	page = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size == sizeof(t_stats_page))
+		page = mmap(NULL, sizeof(t_stats_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+		return (NULL);
+	if (memcmp(page->magic, MT_STATS_MAGIC, 8) != 0
+		|| page->lanes != MT_STATS_LANES)
+	{
+		munmap(page, sizeof(t_stats_page));
+		return (NULL);
+	}
+	atomic_thread_fence(memory_order_acquire);
+	return (page);
+}
+
+/**
+ * @brief Copies a section of the page as one consistent snapshot.
+ *
+ * @param seq Sequence number of the section.
+ * @param src The section.
+ * @param dst Buffer receiving the copy.
+ * @param size Size of the section.
+ * @return true on success, false if the section kept changing, or was
+ * left mid-update by a server that died.
+ *
+ * @ingroup stats
+ */
+static bool section_copy(const atomic_uint* seq, const void* src, void* dst,
+						 size_t size)
+{
+	unsigned before;
+	int      tries;
+
+	tries = 0;
+	while (tries++ < MT_STATS_RETRIES)
+	{
+		before = atomic_load_explicit(seq, memory_order_acquire);
+		if (!(before & 1))
+		{
+			memcpy(dst, src, size);
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(seq, memory_order_relaxed) == before)
+				return (true);
+		}
+		cpu_relax();
+	}
+	return (false);
+}
+
+/**
+ * @brief Reads a stats page and sums its lanes.
+ *
+ * Each lane is consistent in itself; lanes are read one after the other,
+ * so the sums may mix moments a few microseconds apart.
+ *
+ * @param page The page, from stats_attach().
+ * @param view Receives the totals, the output queue and every client.
+ * @return true on success, false if a section could not be read.
+ *
+ * @ingroup stats
+ */
+bool stats_read(const t_stats_page* page, t_stats_view* view)
+{
+	t_stats_lane l;
+	size_t       i;
+	size_t       j;
+
+	memset(view, 0, sizeof(*view));
+	if (!section_copy(&page->output.seq, &page->output, &view->output,
+					  sizeof(view->output)))
+		return (false);
+	i = 0;
+	while (i < MT_STATS_LANES)
+	{
+		if (!section_copy(&page->lane[i].seq, &page->lane[i], &l, sizeof(l)))
+			return (false);
+		view->total.signals += l.signals;
+		view->total.messages += l.messages;
+		view->total.bytes += l.bytes;
+		view->total.sessions += l.sessions;
+		view->total.aborted += l.aborted;
+		view->total.rejected += l.rejected;
+		view->total.active += l.active;
+		j = 0;
+		while (j < MT_STATS_BUCKETS)
+		{
+			view->total.ack_ns[j] += l.ack_ns[j];
+			view->total.msg_us[j] += l.msg_us[j];
+			j++;
+		}
+		j = 0;
+		while (j < MT_STATS_CLIENTS)
+			if (l.clients[j++].pid != 0)
+				view->clients[view->nclients++] = l.clients[j - 1];
+		i++;
+	}
+	return (true);
+}
@@ -0,0 +1,121 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   trace.c                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 11:05:12 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 11:05:12 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file trace.c
+ * @brief Binary recording of the signals received by the server.
+ *
+ * @details
+ * A trace file starts with the 8-byte magic `MT_TRACE_MAGIC` followed by
+ * fixed-size `t_trace_record` entries, one per received signal, in host
+ * byte order. Records are staged in a small in-memory buffer and written
+ * with `write()` only, so recording is safe from inside a signal handler.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup trace
+ */
+#include "minitalk.h"
+#include <fcntl.h>
+
+/**
+ * @brief Creates a trace file and writes its header.
+ *
+ * @param trace The trace writer to initialise.
+ * @param path Path of the file to create; an existing file is truncated.
+ *
+ * @note Exits with an error message using `sys_error()` if the file
+ * cannot be created.
+ *
+ * @ingroup trace
+ */
+void trace_open(t_trace* trace, const char* path)
+{
+	trace->len = 0;
+	trace->fd  = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (trace->fd == -1)
+		sys_error("Server: cannot create trace file");
+	if (write(trace->fd, MT_TRACE_MAGIC, 8) != 8)
+		sys_error("Server: cannot write trace file");
+}
+
+/**
+ * @brief Writes every staged record to the trace file.
+ *
+ * @param trace The trace writer; does nothing if recording is disabled.
+ *
+ * @note Async-signal-safe. Exits with an error message using `sys_error()`
+ * if the write fails.
+ *
+ * @ingroup trace
+ */
+void trace_flush(t_trace* trace)
+{
+	ssize_t size;
+
+	if (trace->fd < 0 || trace->len == 0)
+		return;
+	size = (ssize_t) (trace->len * sizeof(t_trace_record));
+	if (write(trace->fd, trace->buf, size) != size)
+		sys_error("Server: trace write failed");
+	trace->len = 0;
+}
+
+/**
+ * @brief Appends one received signal to the trace.
+ *
+ * @details
+ * Stamps the record with `CLOCK_MONOTONIC` and stages it, flushing the
+ * buffer once it is full.
+ *
+ * @param trace The trace writer; does nothing if recording is disabled.
+ * @param sig The received signal.
+ * @param info The sender information delivered with the signal.
+ *
+ * @note Async-signal-safe: only `clock_gettime()` and `write()` are used.
+ *
+ * @ingroup trace
+ */
+void trace_record(t_trace* trace, int sig, const siginfo_t* info)
+{
+	struct timespec  now;
+	t_trace_record*  rec;
+
+	if (trace->fd < 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rec        = &trace->buf[trace->len++];
+	rec->ns    = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	rec->sig   = sig;
+	rec->pid   = info->si_pid;
+	rec->value = info->si_value.sival_int;
+	rec->code  = info->si_code;
+	if (trace->len == MT_TRACE_BUFFER)
+		trace_flush(trace);
+}
+
+/**
+ * @brief Checks the header of a trace file opened for reading.
+ *
+ * @param fd A file descriptor positioned at the start of the trace.
+ * @return true if the file starts with `MT_TRACE_MAGIC`, false otherwise.
+ *
+ * @ingroup trace
+ */
+bool trace_check_header(int fd)
+{
+	char magic[8];
+
+	if (read(fd, magic, 8) != 8)
+		return (false);
+	return (memcmp(magic, MT_TRACE_MAGIC, 8) == 0);
+}
@@ -0,0 +1,938 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   transport.c                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 21:18:40 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 21:18:40 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file transport.c
+ * @brief Sending side of the Minitalk protocol, shared by every sender.
+ *
+ * @details
+ * Turns a message into bits and sends them to the server using SIGUSR1
+ * and SIGUSR2, each bit being a numbered frame. The server acknowledges
+ * every frame with the number of the first one it is missing and a bitmap
+ * of those it holds after it, so the sender keeps a small window of
+ * frames in flight and sends again only the ones that were lost, which
+ * signal coalescing makes common.
+ *
+ * Frames can also go as bare signals sent with `kill()`, one at a time,
+ * which every server accepts too. Which of the two is faster depends on
+ * the host, so a sender may probe both and cache the winner for later
+ * runs (see transport_select()).
+ *
+ * Used by the client for a single message and by the aggregator for a
+ * stream of batches; both install the handlers with setup_ack_signal().
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup client
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Acknowledgment flag set by the server.
+ *
+ * This global variable is used by the client to synchronize the sending
+ * of bits. After sending, the client waits until the server responds with
+ * a SIGUSR1 signal. This signal sets `g_ack_received` to 1, allowing the
+ * client to look at what was acknowledged.
+ *
+ * It is declared as `volatile sig_atomic_t` to ensure:
+ * - `volatile`: The compiler doesn't optimize out reads/writes due to changes
+ *    happening asynchronously from a signal handler.
+ * - `sig_atomic_t`: Ensures the variable is accessed atomically and safely
+ *    across signal handler and main code context.
+ * @ingroup client
+ */
+volatile sig_atomic_t g_ack_received = 0;
+
+/**
+ * @brief Payload of the last acknowledgment, or -1 if it had none.
+ *
+ * Servers that number frames queue their acks as `MT_SIG_ACK` with the
+ * next expected frame and the SACK bitmap as value; older ones send a bare
+ * `SIGUSR1`.
+ *
+ * @ingroup client
+ */
+volatile sig_atomic_t g_ack_value = -1;
+
+/**
+ * @brief Set when the server answers with `SIGUSR2`.
+ *
+ * The server sends `SIGUSR2` instead of an acknowledgment when it is
+ * shutting down or cannot open a session for this client, meaning the
+ * rest of the message will not be accepted.
+ *
+ * @ingroup client
+ */
+volatile sig_atomic_t g_server_closing = 0;
+
+/**
+ * @brief PID of the server that took over from the current one, or 0.
+ *
+ * Set when the server hands its sessions over to a new process during a
+ * live upgrade: it then sends `SIGUSR2` queued with the new PID as value.
+ *
+ * @ingroup client
+ */
+volatile sig_atomic_t g_redirect_pid = 0;
+
+/**
+ * @brief Transfer rate measured so far and codecs used.
+ *
+ * @ingroup client
+ */
+static t_link g_link = {MT_LINK_INITIAL_BPS, {0, 0, 0}, 0, 0,
+						MT_TRANSPORT_QUEUED, false, {0, 0}};
+
+/**
+ * @brief Signal handler for SIGUSR1 sent by the server to acknowledge
+ * receipt of a bit.
+ *
+ * This function is called asynchronously when the client receives the
+ * `SIGUSR1` signal from the server, which acts as an acknowledgment that
+ * a bit has been successfully received and processed.
+ *
+ * When triggered, the function stores the payload of the ack in
+ * `g_ack_value` (-1 if it was not queued with one) and sets the global
+ * variable `g_ack_received` to 1, informing the main sending loop in the
+ * client that frames were acknowledged. Acks that arrive before the loop
+ * looks only leave the latest payload, which covers the earlier ones.
+ *
+ * @param sig The signal number received (`SIGUSR1` or `MT_SIG_ACK`).
+ * @param info Information about the signal, including its value.
+ * @param context Additional context information (unused).
+ *
+ * @ingroup client
+ */
+void ack_handler(int sig, siginfo_t* info, void* context)
+{
+	(void) context;
+	g_ack_value = -1;
+	if (sig == MT_SIG_ACK)
+		g_ack_value = info->si_value.sival_int;
+	g_ack_received = 1;
+}
+
+/**
+ * @brief Signal handler for SIGUSR2 sent by a server that stops serving us.
+ *
+ * A plain `SIGUSR2` means the server refuses the message. A `SIGUSR2`
+ * queued with a positive value means the server handed its sessions over
+ * to the process whose PID is that value, which the client must use from
+ * now on.
+ *
+ * @param sig The signal number received (expected to be SIGUSR2).
+ * @param info Information about the signal, including its value.
+ * @param context Additional context information (unused).
+ *
+ * @ingroup client
+ */
+void closing_handler(int sig, siginfo_t* info, void* context)
+{
+	(void) sig;
+	(void) context;
+	if (info->si_code == SI_QUEUE && info->si_value.sival_int > 0)
+		g_redirect_pid = info->si_value.sival_int;
+	else
+		g_server_closing = 1;
+}
+
+/**
+ * @brief Sets up the signal handler for SIGUSR1 to acknowledge received bits.
+ *
+ * This function configures the client to listen for `MT_SIG_ACK`, which
+ * the server sends to acknowledge frames, and for the bare `SIGUSR1` that
+ * older servers send instead.
+ *
+ * It uses the `sigaction` system call to set the `ack_handler` function
+ * as the signal handler, with `SA_SIGINFO` so that it gets the payload of
+ * the ack. The `SA_RESTART` flag ensures that interrupted
+ * system calls (like `pause()` or `read()`) are automatically restarted
+ * after the signal handler returns.
+ *
+ * The signal mask is initialized to an empty set, meaning no signals are
+ * blocked while the handler runs.
+ *
+ * `SIGUSR2` is handled by `closing_handler`, so that a server refusing the
+ * message stops the client cleanly instead of terminating it, and a server
+ * handing over to a new process can redirect the client.
+ *
+ * @note If `sigaction` fails to set the handler, the program exits with an
+ * error message using `sys_error()`.
+ *
+ * @ingroup client
+ */
+void setup_ack_signal(void)
+{
+	struct sigaction sa;
+
+	sa.sa_sigaction = ack_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	if (sigaction(SIGUSR1, &sa, NULL) == -1
+		|| sigaction(MT_SIG_ACK, &sa, NULL) == -1)
+		sys_error("Client: sigaction failed");
+	sa.sa_sigaction = closing_handler;
+	if (sigaction(SIGUSR2, &sa, NULL) == -1)
+		sys_error("Client: sigaction failed");
+}
+
+/**
+ * @brief Returns the current `CLOCK_MONOTONIC` time in nanoseconds.
+ *
+ * @ingroup client
+ */
+static long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+/**
+ * @brief Initialises the adaptive ack wait.
+ *
+ * On a single CPU the server can only answer once the client stops
+ * running, so spinning is disabled altogether.
+ *
+ * @param aw The wait state.
+ *
+ * @ingroup client
+ */
+static void ack_wait_init(t_ack_wait* aw)
+{
+	memset(aw, 0, sizeof(*aw));
+	aw->rtt_ns     = MT_RTT_INITIAL_NS;
+	aw->single_cpu = sysconf(_SC_NPROCESSORS_ONLN) < 2;
+	aw->spin_ns    = aw->single_cpu ? 0 : 2 * MT_RTT_INITIAL_NS;
+}
+
+/**
+ * @brief Folds a measured round-trip time into the wait state.
+ *
+ * The average moves by an eighth of the difference. The spin budget is
+ * twice the average, so most acks land inside it, unless the average
+ * exceeds `MT_SPIN_MAX_NS`: acks that slow are not worth a busy core.
+ *
+ * @param aw The wait state.
+ * @param rtt Round-trip time of the last bit, in nanoseconds.
+ *
+ * @ingroup client
+ */
+static void ack_wait_update(t_ack_wait* aw, long rtt)
+{
+	aw->rtt_ns += (rtt - aw->rtt_ns) / 8;
+	if (aw->single_cpu || aw->rtt_ns > MT_SPIN_MAX_NS)
+		aw->spin_ns = 0;
+	else if (2 * aw->rtt_ns > MT_SPIN_MAX_NS)
+		aw->spin_ns = MT_SPIN_MAX_NS;
+	else
+		aw->spin_ns = 2 * aw->rtt_ns;
+}
+
+/**
+ * @brief Waits for the server to answer, at most until a deadline.
+ *
+ * Busy-waits on the flags for the current spin budget, then blocks the
+ * answer signals and sleeps in `ppoll()`, which unblocks them atomically,
+ * so an answer arriving between the check and the sleep still wakes the
+ * client up.
+ *
+ * @param aw The wait state.
+ * @param sent_ns Time the last frame was sent.
+ * @param deadline_ns Time after which unacknowledged frames are resent.
+ * @return true if the server answered, false on timeout.
+ *
+ * @ingroup client
+ */
+static bool wait_ack(t_ack_wait* aw, long sent_ns, long deadline_ns)
+{
+	struct timespec timeout;
+	sigset_t        answers;
+	sigset_t        old;
+	long            spin_end;
+	long            left;
+
+	spin_end = sent_ns + aw->spin_ns;
+	while (!g_ack_received && !g_server_closing && !g_redirect_pid
+		   && now_ns() < spin_end)
+		cpu_relax();
+	if (g_ack_received)
+	{
+		aw->spun++;
+		return (true);
+	}
+	sigemptyset(&answers);
+	sigaddset(&answers, SIGUSR1);
+	sigaddset(&answers, SIGUSR2);
+	sigaddset(&answers, MT_SIG_ACK);
+	sigprocmask(SIG_BLOCK, &answers, &old);
+	while (!g_ack_received && !g_server_closing && !g_redirect_pid)
+	{
+		left = deadline_ns - now_ns();
+		if (left <= 0)
+			break;
+		timeout = (struct timespec){left / 1000000000L, left % 1000000000L};
+		ppoll(NULL, 0, &timeout, &old);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	aw->blocked++;
+	return (g_ack_received || g_server_closing || g_redirect_pid);
+}
+
+/**
+ * @brief Sends one frame of the window to the server.
+ *
+ * The bit is carried by the signal itself:
+ * - `SIGUSR1` for a bit value of 1
+ * - `SIGUSR2` for a bit value of 0
+ *
+ * and the frame number and the ID of the message by the value queued
+ * with it, unless the window is `classic`: the signal is then sent bare
+ * with `kill()`.
+ *
+ * @param pid The process ID of the server.
+ * @param win The window holding the frame.
+ * @param frame Number of the frame.
+ *
+ * If sending fails for any reason but a full signal queue, the server
+ * is taken as gone, unless a redirect to a new server just arrived; a
+ * frame that could not be queued is sent again after the timeout.
+ *
+ * @ingroup client
+ */
+static void send_frame(pid_t pid, t_window* win, uint32_t frame)
+{
+	union sigval val;
+	size_t       slot;
+	int          ret;
+
+	slot               = frame % MT_SACK_WINDOW;
+	val.sival_int      = win->id << MT_MSG_SHIFT | (frame & MT_FRAME_MASK);
+	win->sent_ns[slot] = now_ns();
+	if (win->classic)
+		ret = kill(pid, win->sig[slot]);
+	else
+		ret = sigqueue(pid, win->sig[slot], val);
+	if (ret == -1 && errno != EAGAIN && !g_redirect_pid)
+		win->status = MT_SEND_GONE;
+}
+
+/**
+ * @brief Sends again the frames in flight the server does not hold.
+ *
+ * @param pid The process ID of the server.
+ * @param win The window.
+ * @param end Frames from this one on are left alone.
+ * @param min_age_ns Frames sent more recently than this are left alone.
+ *
+ * @ingroup client
+ */
+static void resend_missing(pid_t pid, t_window* win, uint32_t end,
+						   long min_age_ns)
+{
+	uint32_t frame;
+	long     now;
+
+	now   = now_ns();
+	frame = win->base;
+	while (frame < end)
+	{
+		if (!(win->sack & (1u << (frame - win->base)))
+			&& now - win->sent_ns[frame % MT_SACK_WINDOW] >= min_age_ns)
+		{
+			win->resent[frame % MT_SACK_WINDOW] = true;
+			win->resends++;
+			send_frame(pid, win, frame);
+		}
+		frame++;
+	}
+}
+
+/**
+ * @brief Applies an acknowledgment to the window.
+ *
+ * @details
+ * A bare ack, from a server that does not number frames, acknowledges the
+ * single frame in flight and keeps the window at one frame. A SACK ack
+ * moves the window to the first frame the server misses, unless it is
+ * older than what is already known. The window then grows by one frame;
+ * if the bitmap shows a gap, it is halved instead and the missing frames
+ * not sent within the last round trip are sent again.
+ *
+ * @param pid The process ID of the server.
+ * @param win The window.
+ * @param aw The wait state, fed with the round-trip time of the newest
+ * frame acknowledged, if it was sent once and not already held.
+ * @param value Payload of the ack, or -1 for a bare one.
+ *
+ * @ingroup client
+ */
+static void window_ack(pid_t pid, t_window* win, t_ack_wait* aw, int value)
+{
+	uint32_t adv;
+	uint32_t last;
+
+	if (value < 0)
+	{
+		win->sack_ok = false;
+		win->size    = 1;
+		if (win->next > win->base)
+			win->base++;
+		return;
+	}
+	win->sack_ok = true;
+	adv          = ((uint32_t) value >> 16) - win->base;
+	adv &= MT_FRAME_MASK;
+	if (adv > win->next - win->base)
+		return;
+	if (adv > 0)
+	{
+		last = win->base + adv - 1;
+		if (!win->resent[last % MT_SACK_WINDOW]
+			&& !(win->sack & (1u << (adv - 1))))
+			ack_wait_update(aw, now_ns() - win->sent_ns[last % MT_SACK_WINDOW]);
+		while (win->base <= last)
+			win->resent[win->base++ % MT_SACK_WINDOW] = false;
+		win->sack = value & 0xffff;
+		win->rto_ns = 4 * aw->rtt_ns;
+		if (win->rto_ns < MT_RTO_MIN_NS)
+			win->rto_ns = MT_RTO_MIN_NS;
+	}
+	else
+		win->sack |= value & 0xffff;
+	if (win->sack == 0)
+	{
+		if (win->size < MT_SACK_WINDOW)
+			win->size++;
+		return;
+	}
+	if (win->size > 1)
+		win->size /= 2;
+	last = win->base;
+	while (win->sack >> (last - win->base + 1))
+		last++;
+	resend_missing(pid, win, last, aw->rtt_ns);
+}
+
+/**
+ * @brief Handles a redirect or a timeout while frames are in flight.
+ *
+ * @details
+ * On a redirect the new server's PID replaces `*pid` for the rest of the
+ * message and every frame the old server did not hold is sent to it; the
+ * caller applies any ack still pending first, so that frames the old
+ * server acknowledged before handing over are not sent twice. On a
+ * timeout the window shrinks to one frame, the missing frames are sent
+ * again and the timeout doubles, up to `MT_RTO_MAX_NS`; a server that no
+ * longer exists ends the transfer with `MT_SEND_GONE`. A `classic` frame
+ * is never sent again, on a redirect or a timeout: without a number, the
+ * server could not tell the copy from the next bit, so the sender just
+ * keeps waiting.
+ *
+ * @param pid The process ID of the server; updated on a redirect.
+ * @param win The window.
+ *
+ * @ingroup client
+ */
+static void window_recover(pid_t* pid, t_window* win)
+{
+	if (g_redirect_pid)
+	{
+		*pid           = g_redirect_pid;
+		g_redirect_pid = 0;
+		if (!win->classic)
+			resend_missing(*pid, win, win->next, 0);
+		return;
+	}
+	if (kill(*pid, 0) == -1)
+	{
+		win->status = MT_SEND_GONE;
+		return;
+	}
+	win->size = 1;
+	if (!win->classic)
+		resend_missing(*pid, win, win->next, 0);
+	win->rto_ns *= 2;
+	if (win->rto_ns > MT_RTO_MAX_NS)
+		win->rto_ns = MT_RTO_MAX_NS;
+}
+
+/**
+ * @brief Tells whether a frame with the same signal is still in flight.
+ *
+ * @param win The window.
+ * @param sig The signal of the next frame.
+ * @return true if sending it now could merge it with that frame.
+ *
+ * @ingroup client
+ */
+static bool in_flight(const t_window* win, int sig)
+{
+	uint32_t frame;
+
+	frame = win->base;
+	while (frame < win->next)
+	{
+		if (win->sig[frame % MT_SACK_WINDOW] == sig
+			&& !(win->sack & (1u << (frame - win->base))))
+			return (true);
+		frame++;
+	}
+	return (false);
+}
+
+/**
+ * @brief Consumes the pending acknowledgment.
+ *
+ * The ack signals are blocked meanwhile, so that an ack arriving at that moment
+ * is not cleared along with the one being read.
+ *
+ * @return Payload of the ack, or -1 for a bare one.
+ *
+ * @ingroup client
+ */
+static int take_ack(void)
+{
+	sigset_t ack;
+	sigset_t old;
+	int      value;
+
+	sigemptyset(&ack);
+	sigaddset(&ack, SIGUSR1);
+	sigaddset(&ack, MT_SIG_ACK);
+	sigprocmask(SIG_BLOCK, &ack, &old);
+	value          = g_ack_value;
+	g_ack_received = 0;
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return (value);
+}
+
+/**
+ * @brief Starts sending a buffer from its first frame, under a new ID.
+ *
+ * @details
+ * IDs follow each other from a value taken from the clock, so that a
+ * process that gets the PID of a sender that just ended is unlikely to
+ * start with that sender's last ID. Only the transport and the counters
+ * of the window outlive a restart.
+ *
+ * @param win The window.
+ * @param enc The encoder, set to walk the buffer from its first bit.
+ * @param buf The bytes to transmit.
+ * @param len Their number.
+ * @return The signal of the first frame.
+ *
+ * @ingroup client
+ */
+static int window_start(t_window* win, t_encoder* enc, const char* buf,
+						size_t len)
+{
+	static uint32_t next_id;
+
+	if (next_id == 0)
+		next_id = now_ns();
+	encoder_init_len(enc, buf, len);
+	win->id     = next_id++ & MT_MSG_MASK;
+	win->base   = 0;
+	win->next   = 0;
+	win->sack   = 0;
+	win->size   = 1;
+	win->rto_ns = MT_RTO_MIN_NS;
+	return (encoder_next_signal(enc));
+}
+
+/**
+ * @brief Sends a buffer to the server via signals.
+ *
+ * The buffer is walked by the protocol encoder, which yields one signal
+ * per bit (most significant bit first), each sent as the next frame. New
+ * frames go out while the window has room; the first one goes alone, so
+ * the server knows a session starts with frame 0. Each answer then moves
+ * the window, and frames that are not acknowledged in time are sent again.
+ * The frames carry an ID that changes with every message, so that
+ * copies of the previous message's frames the server gets late are not
+ * taken for frames of this one. A server that lost the session of the
+ * message asks for it again from the start (see `MT_ACK_RESTART`), which
+ * the transfer does under a new ID.
+ *
+ * The encoder also emits the null character ('\0') after the last
+ * byte, signalling the end of transmission to the server.
+ *
+ * The transfer stops early when the server refuses the message or no
+ * longer exists; the caller decides what becomes of the message then, as
+ * the server may have kept part of it.
+ *
+ * @param pid The PID of the server process to which the message is sent;
+ * updated if the server redirects the client to a new process.
+ * @param buf The bytes to transmit.
+ * @param len Their number.
+ * @return `MT_SEND_OK` once the whole buffer is acknowledged, otherwise
+ * the reason it was not delivered.
+ *
+ * @ingroup client
+ */
+static t_send_status send_frames(pid_t* pid, const char* buf, size_t len)
+{
+	t_encoder  enc;
+	t_ack_wait aw;
+	t_window   win;
+	long       last_ns;
+	int        value;
+	int        sig;
+
+	ack_wait_init(&aw);
+	memset(&win, 0, sizeof(win));
+	win.classic      = g_link.transport == MT_TRANSPORT_CLASSIC;
+	sig              = window_start(&win, &enc, buf, len);
+	last_ns          = now_ns();
+	g_server_closing = 0;
+	take_ack();
+	while ((sig || win.base != win.next) && win.status == MT_SEND_OK)
+	{
+		while (sig && win.next - win.base < win.size
+			   && (win.base > 0 || win.next == 0) && !in_flight(&win, sig))
+		{
+			win.sig[win.next % MT_SACK_WINDOW] = sig;
+			win.resent[win.next % MT_SACK_WINDOW] = false;
+			send_frame(*pid, &win, win.next++);
+			last_ns = now_ns();
+			sig     = encoder_next_signal(&enc);
+		}
+		if (win.status != MT_SEND_OK)
+			break;
+		if (!wait_ack(&aw, last_ns,
+					  win.sent_ns[win.base % MT_SACK_WINDOW] + win.rto_ns))
+			window_recover(pid, &win);
+		else if (g_server_closing)
+			win.status = MT_SEND_REFUSED;
+		else
+		{
+			if (g_ack_received)
+			{
+				value = take_ack();
+				if (value == -1 || !((uint32_t) value & MT_ACK_RESTART))
+					window_ack(*pid, &win, &aw, value);
+				else if (((uint32_t) value & MT_MSG_MASK) == win.id)
+					sig = window_start(&win, &enc, buf, len);
+			}
+			if (g_redirect_pid)
+				window_recover(pid, &win);
+		}
+	}
+	return (win.status);
+}
+
+/**
+ * @brief Packs a message with the codec that should deliver it soonest.
+ *
+ * @details
+ * A message is sent plain when no codec pays off, unless it starts with
+ * `MT_CODEC_MARK`: it is then packed with `MT_CODEC_NONE` so that the
+ * server does not mistake it for a packed one. A codec that turns out not
+ * to shrink the message is dropped the same way.
+ *
+ * @param msg The message.
+ * @param len Its length.
+ * @param codec Receives the codec used.
+ * @param wire_len Receives the length of the packed message.
+ * @return The packed message, allocated with malloc, or NULL to send the
+ * message as it is.
+ *
+ * @note Exits with an error message using `sys_error()` if allocating
+ * fails.
+ *
+ * @ingroup client
+ */
+static char* pack_message(const char* msg, size_t len, t_codec* codec,
+						  size_t* wire_len)
+{
+	char*  packed;
+	size_t n;
+
+	*codec = codec_choose(msg, len, g_link.bytes_per_s);
+	if (*codec == MT_CODEC_NONE && (unsigned char) msg[0] != MT_CODEC_MARK)
+		return (NULL);
+	packed = malloc(MT_CODEC_HEADER + codec_bound(len));
+	if (!packed)
+		sys_error("Client: malloc failed");
+	n = codec_compress(*codec, msg, len, packed + MT_CODEC_HEADER);
+	if (*codec != MT_CODEC_NONE && n >= len)
+	{
+		*codec = MT_CODEC_NONE;
+		if ((unsigned char) msg[0] != MT_CODEC_MARK)
+		{
+			free(packed);
+			return (NULL);
+		}
+		n = codec_compress(*codec, msg, len, packed + MT_CODEC_HEADER);
+	}
+	codec_header(packed, *codec, n);
+	*wire_len = MT_CODEC_HEADER + n;
+	return (packed);
+}
+
+/**
+ * @brief Sends a null-terminated string to the server, compressed when
+ * that gets it across sooner.
+ *
+ * @details
+ * The codec is chosen from the transfer rate measured on the previous
+ * messages (see codec_choose()), and this message's rate then updates
+ * that measure.
+ *
+ * @param pid The PID of the server process to which the message is sent;
+ * updated if the server redirects the client to a new process.
+ * @param msg The null-terminated message string to transmit.
+ * @return `MT_SEND_OK` once the whole message is acknowledged, otherwise
+ * the reason it was not delivered.
+ *
+ * @ingroup client
+ */
+t_send_status send_message(pid_t* pid, const char* msg)
+{
+	t_send_status status;
+	t_codec       codec;
+	char*         packed;
+	size_t        len;
+	size_t        wire_len;
+	long          start;
+	double        rate;
+
+	len      = strlen(msg);
+	wire_len = len;
+	packed   = pack_message(msg, len, &codec, &wire_len);
+	start    = now_ns();
+	if (packed)
+		status = send_frames(pid, packed, wire_len);
+	else
+		status = send_frames(pid, msg, len);
+	free(packed);
+	if (status != MT_SEND_OK)
+		return (status);
+	rate = (wire_len + 1) * 1e9 / (now_ns() - start + 1);
+	g_link.bytes_per_s = (g_link.bytes_per_s + rate) / 2;
+	g_link.codec[codec]++;
+	g_link.raw += len;
+	g_link.wire += wire_len;
+	return (status);
+}
+
+/**
+ * @brief Returns what the transport measured so far.
+ *
+ * @ingroup client
+ */
+const t_link* transport_link(void)
+{
+	return (&g_link);
+}
+
+/**
+ * @brief Names of the transports, as written in the tuning cache.
+ *
+ * @ingroup client
+ */
+static const char* g_transport_names[MT_TRANSPORT_COUNT] = {"queued",
+															"classic"};
+
+/**
+ * @brief Returns the name of a transport.
+ *
+ * @ingroup client
+ */
+const char* transport_name(t_transport t)
+{
+	return (g_transport_names[t]);
+}
+
+/**
+ * @brief Builds the path of the current user's tuning cache.
+ *
+ * @param path Buffer receiving the path.
+ * @param size Size of the buffer.
+ *
+ * @ingroup client
+ */
+static void tune_path(char* path, size_t size)
+{
+	snprintf(path, size, MT_TUNE_PATH, (int) getuid());
+}
+
+/**
+ * @brief Reads the transport cached on this host, if it is recent enough.
+ *
+ * The cache is a single line: the name of the transport, the rate it was
+ * probed at in bytes per second and the time of the probe in seconds
+ * since the Epoch. Since it lives in a shared directory, it is only
+ * trusted if it is a regular file of the current user that no one else
+ * may write to.
+ *
+ * @return true if the transport and the link rate were taken from it.
+ *
+ * @ingroup client
+ */
+static bool tune_load(void)
+{
+	struct stat st;
+	char        path[64];
+	char        name[16];
+	double      rate;
+	long        when;
+	FILE*       f;
+	int         fd;
+	int         n;
+	int         t;
+
+	tune_path(path, sizeof(path));
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1)
+		return (false);
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)
+		|| st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH)))
+	{
+		close(fd);
+		return (false);
+	}
+	f = fdopen(fd, "r");
+	if (!f)
+	{
+		close(fd);
+		return (false);
+	}
+	n = fscanf(f, "%15s %lf %ld", name, &rate, &when);
+	fclose(f);
+	if (n != 3 || rate <= 0 || when > time(NULL)
+		|| time(NULL) - when > MT_TUNE_TTL)
+		return (false);
+	t = 0;
+	while (t < MT_TRANSPORT_COUNT && strcmp(name, g_transport_names[t]) != 0)
+		t++;
+	if (t == MT_TRANSPORT_COUNT)
+		return (false);
+	g_link.transport   = t;
+	g_link.bytes_per_s = rate;
+	g_link.cached      = true;
+	return (true);
+}
+
+/**
+ * @brief Writes the transport in use to the tuning cache.
+ *
+ * The line goes to a file of this process first, then replaces the cache
+ * with `rename()`, so that senders probing at the same time never leave a
+ * mixed line. Failing to write the cache only costs a probe next time.
+ *
+ * @ingroup client
+ */
+static void tune_save(void)
+{
+	char path[64];
+	char tmp[80];
+	int  fd;
+
+	tune_path(path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+	if (fd == -1)
+		return;
+	dprintf(fd, "%s %.0f %ld\n", g_transport_names[g_link.transport],
+			g_link.bytes_per_s, (long) time(NULL));
+	if (close(fd) == -1 || rename(tmp, path) == -1)
+		unlink(tmp);
+}
+
+/**
+ * @brief Times one transport on a probe message.
+ *
+ * @details
+ * The probe is packed with `MT_CODEC_PROBE`, so the server decodes it like
+ * any message and then drops it. Its payload is text, whose bits switch
+ * between the two signals as often as in real messages: numbered frames
+ * only get ahead when they alternate.
+ *
+ * @param pid The PID of the server; updated if it redirects the sender.
+ * @param t The transport to time.
+ * @return `MT_SEND_OK` once the probe is acknowledged, otherwise the
+ * reason it was not delivered.
+ *
+ * @ingroup client
+ */
+static t_send_status probe_transport(pid_t* pid, t_transport t)
+{
+	char          msg[MT_CODEC_HEADER + MT_PROBE_BYTES];
+	t_send_status status;
+	long          start;
+	size_t        i;
+
+	codec_header(msg, MT_CODEC_PROBE, MT_PROBE_BYTES);
+	i = 0;
+	while (i < MT_PROBE_BYTES)
+	{
+		msg[MT_CODEC_HEADER + i] = "minitalk probe "[i % 15];
+		i++;
+	}
+	g_link.transport = t;
+	start            = now_ns();
+	status           = send_frames(pid, msg, sizeof(msg));
+	if (status == MT_SEND_OK)
+		g_link.probed[t] = (sizeof(msg) + 1) * 1e9 / (now_ns() - start + 1);
+	return (status);
+}
+
+/**
+ * @brief Chooses the transport for the messages to come.
+ *
+ * @details
+ * A choice cached on this host less than `MT_TUNE_TTL` seconds ago is
+ * used as is, its rate seeding the codec choice. Otherwise, when `probe`
+ * is set, every transport sends the server a probe, and the fastest one
+ * is kept and cached for the next senders; without `probe` numbered
+ * frames are used, which is also what a failed probe leaves.
+ *
+ * @param pid The PID of the server; updated if it redirects the sender.
+ * @param probe Whether to probe the transports when nothing is cached.
+ * @return `MT_SEND_OK`, or the reason a probe could not be delivered.
+ *
+ * @ingroup client
+ */
+t_send_status transport_select(pid_t* pid, bool probe)
+{
+	t_send_status status;
+	int           t;
+
+	if (tune_load() || !probe)
+		return (MT_SEND_OK);
+	t = 0;
+	while (t < MT_TRANSPORT_COUNT)
+	{
+		status = probe_transport(pid, t++);
+		if (status != MT_SEND_OK)
+		{
+			g_link.transport = MT_TRANSPORT_QUEUED;
+			return (status);
+		}
+	}
+	g_link.transport = MT_TRANSPORT_QUEUED;
+	t                = MT_TRANSPORT_QUEUED;
+	while (++t < MT_TRANSPORT_COUNT)
+		if (g_link.probed[t] > g_link.probed[g_link.transport])
+			g_link.transport = t;
+	g_link.bytes_per_s = g_link.probed[g_link.transport];
+	tune_save();
+	return (MT_SEND_OK);
+}
@@ -25,10 +25,15 @@
  * @ingroup utils
  */
 #include "minitalk.h"
+#include <fcntl.h>
+#include <getopt.h>
 
 /**
  * @brief Displays the server's PID and a waiting message.
  *
+ * Standard output is flushed so that the PID is visible right away even
+ * when it is redirected to a file or a pipe.
+ *
  * @param pid The process ID of the server.
  *
  * @ingroup utils
@@ -37,25 +42,156 @@ void display_information_server(pid_t pid)
 {
 	printf("PID: %d\n", pid);
 	printf("Waiting for a message...\n");
+	fflush(stdout);
 }
 
 /**
- * @brief Validates the number of arguments passed to the server.
+ * @brief Parses and validates the options passed to the server.
+ *
+ * Recognised options:
+ * - `-r <file>`: record every received signal to a trace file.
+ * - `-d <seconds>`: time given to active sessions on shutdown.
+ * - `-t <pid>`: take over the sessions of a running server.
+ * - `-q <depth>`: number of chunks the output queue holds, a power of two.
+ * - `-p <policy>`: what to do when the output queue is full, one of
+ *   `block`, `drop` (oldest chunk) or `spill` (to a temporary file).
+ * - `-w`: write output with `writev()` even if io_uring is available.
+ * - `-s`: sync output to disk after each batch when it is a regular file.
+ * - `-H`: back the output queue with huge pages when the system has them.
+ * - `-B <idle_us>`: busy-poll for signals instead of sleeping, falling back
+ *   to short blocking waits after that many idle microseconds (0: never).
+ * - `-C <cpu>`: pin the busy-polling or forwarding thread to a CPU; no
+ *   effect without `-B` or `-j`.
+ * - `-j <workers>`: hand sessions to that many worker threads, at most
+ *   `MT_MAX_SHARDS`.
+ * - `-e`: escape control characters in the output, on a thread pool.
+ * - `-P <threads>`: size of that pool, also used by `-A`, at most
+ *   `MT_MAX_POOL` (default: one thread per online CPU).
+ * - `-S <bytes>`: stream messages as records of that many bytes, with a
+ *   commit or abort marker at the end; not combined with `-e`, which
+ *   would change the length of the records.
+ * - `-m`: publish live counters in the shared-memory stats page.
+ * - `-A <interval_ms>`: aggregate statsd metric lines and write the
+ *   aggregates at that interval; not combined with `-S`.
+ * - `-J <tape_file>`: index the messages that are JSON documents and
+ *   write their tapes to that file.
+ * - `-i <pid_file>`: publish the PID in that file, for senders that find
+ *   the server again after a restart (see pid_file_write()).
  *
  * @param argc Argument count.
- * @param argv Argument values (unused).
+ * @param argv Argument values.
+ * @param cfg Configuration filled with defaults and the parsed options.
  *
- * Exits with an error message if the argument count is invalid.
+ * Exits with an error message if an option is unknown or arguments remain.
  *
  * @ingroup utils
  */
-void validate_input_server(int argc, char** argv)
+void validate_input_server(int argc, char** argv, t_server_config* cfg)
 {
-	(void) argv;
-	if (argc != 1)
+	int  opt;
+	int  n;
+	bool valid;
+
+	cfg->trace_path    = NULL;
+	cfg->drain_timeout = MT_DRAIN_TIMEOUT;
+	cfg->takeover_pid  = 0;
+	cfg->writer_depth  = MT_WRITER_DEPTH;
+	cfg->writer_policy = MT_POLICY_BLOCK;
+	cfg->output_flags  = 0;
+	cfg->busy_idle_us  = -1;
+	cfg->busy_cpu      = -1;
+	cfg->workers       = 0;
+	cfg->escape        = false;
+	cfg->pool_threads  = sysconf(_SC_NPROCESSORS_ONLN);
+	cfg->stream_chunk  = 0;
+	cfg->stats_page    = false;
+	cfg->metrics_ms    = 0;
+	cfg->tape_path     = NULL;
+	cfg->pid_path      = NULL;
+	if (cfg->pool_threads == 0 || cfg->pool_threads > MT_MAX_POOL)
+		cfg->pool_threads = MT_MAX_POOL;
+	valid = true;
+	while (valid
+		   && (opt = getopt(argc, argv, "r:d:t:q:p:wsHB:C:j:eP:S:mA:J:i:")) != -1)
+	{
+		if (opt == 'r')
+			cfg->trace_path = optarg;
+		else if (opt == 'd')
+			cfg->drain_timeout = ft_atoi(optarg);
+		else if (opt == 't')
+			cfg->takeover_pid = ft_atoi(optarg);
+		else if (opt == 'q')
+		{
+			n                 = ft_atoi(optarg);
+			valid             = n > 0 && (n & (n - 1)) == 0;
+			cfg->writer_depth = n;
+		}
+		else if (opt == 'p' && strcmp(optarg, "block") == 0)
+			cfg->writer_policy = MT_POLICY_BLOCK;
+		else if (opt == 'p' && strcmp(optarg, "drop") == 0)
+			cfg->writer_policy = MT_POLICY_DROP;
+		else if (opt == 'p' && strcmp(optarg, "spill") == 0)
+			cfg->writer_policy = MT_POLICY_SPILL;
+		else if (opt == 'w')
+			cfg->output_flags |= MT_SINK_WRITEV;
+		else if (opt == 's')
+			cfg->output_flags |= MT_SINK_SYNC;
+		else if (opt == 'H')
+			cfg->output_flags |= MT_WRITER_HUGE;
+		else if (opt == 'B')
+		{
+			cfg->busy_idle_us = ft_atoi(optarg);
+			valid             = cfg->busy_idle_us >= 0;
+		}
+		else if (opt == 'C')
+		{
+			cfg->busy_cpu = ft_atoi(optarg);
+			valid         = cfg->busy_cpu >= 0;
+		}
+		else if (opt == 'j')
+		{
+			n            = ft_atoi(optarg);
+			valid        = n > 0 && n <= MT_MAX_SHARDS;
+			cfg->workers = n;
+		}
+		else if (opt == 'e')
+			cfg->escape = true;
+		else if (opt == 'P')
+		{
+			n                 = ft_atoi(optarg);
+			valid             = n > 0 && n <= MT_MAX_POOL;
+			cfg->pool_threads = n;
+		}
+		else if (opt == 'S')
+		{
+			n                 = ft_atoi(optarg);
+			valid = n > 0 && n <= MT_SESSION_BUFFER - MT_STREAM_HEADER;
+			cfg->stream_chunk = n;
+		}
+		else if (opt == 'm')
+			cfg->stats_page = true;
+		else if (opt == 'A')
+		{
+			cfg->metrics_ms = atol(optarg);
+			valid           = cfg->metrics_ms > 0;
+		}
+		else if (opt == 'J')
+			cfg->tape_path = optarg;
+		else if (opt == 'i')
+			cfg->pid_path = optarg;
+		else
+			valid = false;
+	}
+	if (!valid || optind != argc || cfg->drain_timeout < 0
+		|| cfg->takeover_pid < 0 || (cfg->escape && cfg->stream_chunk)
+		|| (cfg->metrics_ms && cfg->stream_chunk))
 	{
 		fprintf(stderr, "Error: wrong format\n");
-		fprintf(stderr, "Usage: ./server\n");
+		fprintf(stderr, "Usage: ./server [-r trace_file] [-d seconds] "
+						"[-t old_pid] [-q depth] [-p block|drop|spill] "
+						"[-w] [-s] [-H] [-B idle_us] [-C cpu] "
+						"[-j workers] [-e] [-P threads] [-S bytes] [-m] "
+						"[-A interval_ms] [-J tape_file] [-i pid_file]\n");
 		exit(EXIT_FAILURE);
 	}
 }
@@ -74,7 +210,7 @@ void validate_input_client(int argc)
 	if (argc != 3)
 	{
 		fprintf(stderr, "Error: wrong format\n");
-		fprintf(stderr, "Usage: ./client <PID> <\"MESSAGE\">\n");
+		fprintf(stderr, "Usage: ./client [-T] <PID> <\"MESSAGE\" | ->\n");
 		exit(EXIT_FAILURE);
 	}
 }
@@ -102,6 +238,60 @@ pid_t get_server_pid_from_input(char** argv)
 	return (pid);
 }
 
+/**
+ * @brief Publishes the PID of the server in a file.
+ *
+ * The PID goes to a file of this process first, then replaces `path` with
+ * `rename()`, so that a reader never sees a partial line. A server taking
+ * over from another one with the same file publishes its own PID there.
+ *
+ * @param path The file.
+ * @param pid The PID of the server.
+ *
+ * @note Exits with an error message using `sys_error()` if the file
+ * cannot be written.
+ *
+ * @ingroup utils
+ */
+void pid_file_write(const char* path, pid_t pid)
+{
+	char tmp[4096];
+	int  fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) pid);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+	if (fd == -1)
+		sys_error("Server: cannot write the PID file");
+	dprintf(fd, "%d\n", (int) pid);
+	if (close(fd) == -1 || rename(tmp, path) == -1)
+	{
+		unlink(tmp);
+		sys_error("Server: cannot write the PID file");
+	}
+}
+
+/**
+ * @brief Reads the PID a server published with pid_file_write().
+ *
+ * @param path The file.
+ * @return The PID, or 0 if the file is missing or holds no valid PID.
+ *
+ * @ingroup utils
+ */
+pid_t pid_file_read(const char* path)
+{
+	FILE* f;
+	int   pid;
+
+	f = fopen(path, "r");
+	if (!f)
+		return (0);
+	if (fscanf(f, "%d", &pid) != 1 || pid <= 0)
+		pid = 0;
+	fclose(f);
+	return (pid);
+}
+
 /**
  * @brief Prints an error message and exits the program.
  *
@@ -116,4 +306,20 @@ void sys_error(char* error_message)
 	fprintf(stderr, "Error: %s\n", error_message);
 	perror("System call error");
 	exit(EXIT_FAILURE);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Hints the CPU that the caller is busy-waiting.
+ *
+ * Lets a sibling hardware thread run and saves power while spinning.
+ *
+ * @ingroup utils
+ */
+void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile("yield");
+#endif
+}
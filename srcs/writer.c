@@ -0,0 +1,590 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   writer.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: nlouis <nlouis@student.hive.fi>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/18 16:05:37 by nlouis            #+#    #+#             */
+/*   Updated: 2026/10/18 16:05:37 by nlouis           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/**
+ * @file writer.c
+ * @brief Output writer thread fed by a bounded lock-free queue.
+ *
+ * @details
+ * Session buffers are copied into a fixed ring of cells and written out by
+ * a dedicated thread, so a slow consumer of the server's output no longer
+ * delays the acknowledgments sent from the signal handler. The thread
+ * writes whatever is ready in batches through a sink (see sink.c), and
+ * gathers the next batch while the previous one is being written.
+ *
+ * The ring is a bounded multi-producer queue in the style of Dmitry
+ * Vyukov's: each cell carries a sequence number telling whether it is
+ * free for the producer at a given position or ready for the consumer.
+ * Pushing only uses atomics, `write()`/`pwrite()`, `nanosleep()` and
+ * `sem_post()`, so it is safe from a signal handler.
+ *
+ * When the ring is full the configured policy applies:
+ * - `MT_POLICY_BLOCK` waits for the writer to free a cell;
+ * - `MT_POLICY_DROP` discards the oldest queued chunk, or the new one if
+ *   the only older chunks are being written;
+ * - `MT_POLICY_SPILL` appends chunks to an unlinked temporary file until
+ *   the writer has caught up; spilled chunks are written after everything
+ *   queued before them.
+ *
+ * @author nlouis
+ * @date 2026/10/18
+ * @ingroup server
+ */
+#include "minitalk.h"
+#include <errno.h>
+#include <stddef.h>
+
+_Static_assert(offsetof(t_writer, tail) - offsetof(t_writer, head)
+				   >= MT_CACHE_LINE,
+			   "producer and writer indices share a cache line");
+_Static_assert(sizeof(t_writer_cell) % MT_CACHE_LINE == 0,
+			   "queue cells are not a whole number of cache lines");
+
+/**
+ * @brief Reserves the cell at the head of the ring for a producer.
+ *
+ * @param w The writer.
+ * @param pos Receives the position of the reserved cell.
+ * @return The cell, or NULL if the ring is full.
+ *
+ * @ingroup server
+ */
+static t_writer_cell* ring_reserve(t_writer* w, size_t* pos)
+{
+	t_writer_cell* cell;
+	size_t         seq;
+	size_t         p;
+
+	p = atomic_load_explicit(&w->head, memory_order_relaxed);
+	while (true)
+	{
+		cell = &w->cells[p & w->mask];
+		seq  = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		if (seq == p)
+		{
+			if (atomic_compare_exchange_weak_explicit(
+					&w->head, &p, p + 1, memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		}
+		else if ((intptr_t) (seq - p) < 0)
+			return (NULL);
+		else
+			p = atomic_load_explicit(&w->head, memory_order_relaxed);
+	}
+	*pos = p;
+	return (cell);
+}
+
+/**
+ * @brief Claims the oldest ready cell of the ring for a consumer.
+ *
+ * @details
+ * The cell stays owned by the caller, and its bytes valid, until it is
+ * handed back with ring_release().
+ *
+ * @param w The writer.
+ * @param pos Receives the position of the claimed cell.
+ * @return The cell, or NULL if the ring is empty.
+ *
+ * @ingroup server
+ */
+static t_writer_cell* ring_claim(t_writer* w, size_t* pos)
+{
+	t_writer_cell* cell;
+	size_t         seq;
+	size_t         p;
+
+	p = atomic_load_explicit(&w->tail, memory_order_relaxed);
+	while (true)
+	{
+		cell = &w->cells[p & w->mask];
+		seq  = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		if (seq == p + 1)
+		{
+			if (atomic_compare_exchange_weak_explicit(
+					&w->tail, &p, p + 1, memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		}
+		else if ((intptr_t) (seq - (p + 1)) < 0)
+			return (NULL);
+		else
+			p = atomic_load_explicit(&w->tail, memory_order_relaxed);
+	}
+	*pos = p;
+	return (cell);
+}
+
+/**
+ * @brief Hands a claimed cell back to the producers.
+ *
+ * @param w The writer.
+ * @param cell The cell returned by ring_claim().
+ * @param pos Its position.
+ *
+ * @ingroup server
+ */
+static void ring_release(t_writer* w, t_writer_cell* cell, size_t pos)
+{
+	atomic_store_explicit(&cell->seq, pos + w->mask + 1, memory_order_release);
+}
+
+/**
+ * @brief Copies a chunk into the ring if a cell is free.
+ *
+ * @param w The writer.
+ * @param buf Bytes to queue.
+ * @param len Number of bytes, at most `MT_SESSION_BUFFER`.
+ * @return true if the chunk was queued, false if the ring is full.
+ *
+ * @ingroup server
+ */
+static bool ring_push(t_writer* w, const char* buf, size_t len)
+{
+	t_writer_cell* cell;
+	size_t         pos;
+
+	cell = ring_reserve(w, &pos);
+	if (!cell)
+		return (false);
+	memcpy(cell->data, buf, len);
+	cell->len = len;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return (true);
+}
+
+/**
+ * @brief Acquires the spin lock guarding the spill file.
+ *
+ * @ingroup server
+ */
+static void spill_lock(t_writer* w)
+{
+	while (atomic_flag_test_and_set_explicit(&w->spill_lock,
+											 memory_order_acquire))
+		;
+}
+
+/**
+ * @brief Releases the spin lock guarding the spill file.
+ *
+ * @ingroup server
+ */
+static void spill_unlock(t_writer* w)
+{
+	atomic_flag_clear_explicit(&w->spill_lock, memory_order_release);
+}
+
+/**
+ * @brief Appends a chunk to the spill file.
+ *
+ * @details
+ * Each chunk is stored as its length followed by its bytes. Called with
+ * the spill lock held.
+ *
+ * @param w The writer.
+ * @param buf Bytes to spill.
+ * @param len Number of bytes.
+ *
+ * @note If the spill file cannot be written, the program exits with an
+ * error message using `sys_error()`.
+ *
+ * @ingroup server
+ */
+static void spill_append(t_writer* w, const char* buf, size_t len)
+{
+	if (pwrite(w->spill_fd, &len, sizeof(len), w->spill_wr) != sizeof(len)
+		|| pwrite(w->spill_fd, buf, len, w->spill_wr + sizeof(len))
+			   != (ssize_t) len)
+		sys_error("Server: spill write failed");
+	w->spill_wr += sizeof(len) + len;
+	atomic_store_explicit(&w->spilling, true, memory_order_release);
+	w->stats.spilled++;
+}
+
+/**
+ * @brief Queues a chunk of output for the writer thread.
+ *
+ * @details
+ * Safe to call from a signal handler, and from several producers at once.
+ * Chunks pushed by one producer are written in the order they were pushed.
+ * When the ring is full the writer's policy decides whether the call
+ * waits, drops the oldest chunk or spills to disk.
+ *
+ * @param w The writer.
+ * @param buf Bytes to write.
+ * @param len Number of bytes, at most `MT_SESSION_BUFFER`.
+ *
+ * @ingroup server
+ */
+void writer_push(t_writer* w, const char* buf, size_t len)
+{
+	const struct timespec pause = {0, 50000};
+	t_writer_cell*        cell;
+	size_t                pos;
+	bool                  waited;
+
+	if (len == 0)
+		return;
+	w->stats.pushed++;
+	if (w->policy == MT_POLICY_SPILL
+		&& atomic_load_explicit(&w->spilling, memory_order_acquire))
+	{
+		spill_lock(w);
+		if (atomic_load_explicit(&w->spilling, memory_order_relaxed))
+		{
+			spill_append(w, buf, len);
+			spill_unlock(w);
+			sem_post(&w->items);
+			return;
+		}
+		spill_unlock(w);
+	}
+	waited = false;
+	while (!ring_push(w, buf, len))
+	{
+		if (w->policy == MT_POLICY_DROP)
+		{
+			w->stats.dropped++;
+			cell = ring_claim(w, &pos);
+			if (!cell)
+				return;
+			ring_release(w, cell, pos);
+			atomic_fetch_add_explicit(&w->retired, 1, memory_order_release);
+		}
+		else if (w->policy == MT_POLICY_SPILL)
+		{
+			spill_lock(w);
+			spill_append(w, buf, len);
+			spill_unlock(w);
+			break;
+		}
+		else
+		{
+			if (!waited)
+				w->stats.blocked++;
+			waited = true;
+			nanosleep(&pause, NULL);
+		}
+	}
+	sem_post(&w->items);
+}
+
+/**
+ * @brief Writes out everything spilled so far and leaves spill mode once
+ * the file is empty.
+ *
+ * @details
+ * Only called by the writer thread when the ring is empty, so spilled
+ * chunks always follow the queued ones they overflowed from.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+static void spill_drain(t_writer* w)
+{
+	char         buf[MT_SESSION_BUFFER];
+	struct iovec iov;
+	size_t       len;
+	off_t        end;
+
+	spill_lock(w);
+	end = w->spill_wr;
+	spill_unlock(w);
+	while (w->spill_rd < end)
+	{
+		if (pread(w->spill_fd, &len, sizeof(len), w->spill_rd) != sizeof(len)
+			|| len > sizeof(buf)
+			|| pread(w->spill_fd, buf, len, w->spill_rd + sizeof(len))
+				   != (ssize_t) len)
+			sys_error("Server: spill read failed");
+		iov = (struct iovec){buf, len};
+		sink_writev(&w->sink, &iov, 1);
+		w->spill_rd += sizeof(len) + len;
+		w->written++;
+	}
+	spill_lock(w);
+	if (w->spill_rd == w->spill_wr)
+	{
+		w->spill_rd = 0;
+		w->spill_wr = 0;
+		if (ftruncate(w->spill_fd, 0) == -1)
+			sys_error("Server: spill truncate failed");
+		atomic_store_explicit(&w->spilling, false, memory_order_release);
+	}
+	spill_unlock(w);
+}
+
+/**
+ * @brief Releases the cells of a batch the sink has finished writing.
+ *
+ * @param w The writer.
+ * @param b The batch.
+ *
+ * @ingroup server
+ */
+static void batch_retire(t_writer* w, t_writer_batch* b)
+{
+	int i;
+
+	i = 0;
+	while (i < b->n)
+	{
+		ring_release(w, b->cells[i], b->pos[i]);
+		i++;
+	}
+	atomic_fetch_add_explicit(&w->retired, b->n, memory_order_release);
+	w->written += b->n;
+	b->n = 0;
+}
+
+/**
+ * @brief Waits for the batch in flight, if any, and releases its cells.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+static void writer_settle(t_writer* w)
+{
+	t_writer_batch* b;
+
+	b = &w->batch[!w->next];
+	if (b->n == 0)
+		return;
+	sink_finish(&w->sink);
+	batch_retire(w, b);
+}
+
+/**
+ * @brief Hands up to `MT_WRITER_BATCH` ready cells to the sink in one
+ * submission.
+ *
+ * @details
+ * The previous batch is retired first if the sink has written it by now,
+ * without waiting. The new batch is gathered while it may still be in
+ * flight, and only then waited for, so the kernel writes one batch while
+ * the next one is claimed. The backlog is sampled here, once per batch,
+ * so that producers never read the writer's index to keep the statistic.
+ *
+ * @param w The writer.
+ * @return Number of cells submitted.
+ *
+ * @ingroup server
+ */
+static int writer_batch(t_writer* w)
+{
+	t_writer_batch* b;
+	size_t          depth;
+
+	b = &w->batch[!w->next];
+	if (b->n > 0 && sink_poll(&w->sink))
+		batch_retire(w, b);
+	depth = atomic_load_explicit(&w->head, memory_order_relaxed)
+			- atomic_load_explicit(&w->tail, memory_order_relaxed);
+	if (depth > w->max_depth)
+		w->max_depth = depth;
+	b = &w->batch[w->next];
+	while (b->n < MT_WRITER_BATCH
+		   && (b->cells[b->n] = ring_claim(w, &b->pos[b->n])))
+	{
+		b->iov[b->n] = (struct iovec){b->cells[b->n]->data,
+									  b->cells[b->n]->len};
+		b->n++;
+	}
+	if (b->n == 0)
+		return (0);
+	writer_settle(w);
+	sink_start(&w->sink, b->iov, b->n);
+	w->next = !w->next;
+	return (b->n);
+}
+
+/**
+ * @brief Waits for work.
+ *
+ * @details
+ * With a batch in flight, only takes a pushed chunk if one is already
+ * there; otherwise waits for the batch to be written, so that its cells
+ * are released without another chunk having to come first.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+static void writer_wait(t_writer* w)
+{
+	if (w->batch[!w->next].n > 0)
+	{
+		if (sem_trywait(&w->items) == -1)
+			writer_settle(w);
+		return;
+	}
+	while (sem_wait(&w->items) == -1)
+		if (errno != EINTR)
+			sys_error("Server: writer wait failed");
+}
+
+/**
+ * @brief Body of the writer thread.
+ *
+ * @details
+ * Sleeps on the `items` semaphore, then submits every ready cell, up to
+ * `MT_WRITER_BATCH` of them per sink submission, and writes any spilled
+ * chunks once the batch in flight is done, then updates the stats page,
+ * if `report` was set before the first push. Exits once a stop was
+ * requested and nothing is left.
+ *
+ * @param arg The writer.
+ * @return Always NULL.
+ *
+ * @ingroup server
+ */
+static void* writer_main(void* arg)
+{
+	t_writer* w;
+
+	w = arg;
+	while (true)
+	{
+		writer_wait(w);
+		while (writer_batch(w) > 0)
+			;
+		if (atomic_load_explicit(&w->spilling, memory_order_acquire))
+		{
+			writer_settle(w);
+			spill_drain(w);
+		}
+		if (w->report)
+			stats_output(w->report, w);
+		if (atomic_load(&w->stop) && writer_idle(w))
+			return (NULL);
+	}
+}
+
+/**
+ * @brief Returns whether every pushed chunk has been written or dropped.
+ *
+ * @details
+ * Compares the head with `retired`, not `tail`: the tail moves as soon as
+ * the writer claims a cell, before the sink has written it.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+bool writer_idle(t_writer* w)
+{
+	return (atomic_load(&w->head) == atomic_load(&w->retired)
+			&& !atomic_load(&w->spilling));
+}
+
+/**
+ * @brief Allocates the ring and starts the writer thread.
+ *
+ * @details
+ * The ring is mapped and pre-faulted up front (see region.c), so pushes
+ * never take a page fault.
+ *
+ * Every signal is blocked in the writer thread, so the server's handlers
+ * always run on the main thread and never wait on the thread they feed.
+ *
+ * @param w The writer to initialise.
+ * @param out_fd Descriptor the chunks are written to.
+ * @param depth Number of cells in the ring, a power of two.
+ * @param policy What writer_push() does when the ring is full.
+ * @param flags `MT_SINK_*` flags for the output, and `MT_WRITER_HUGE` to
+ * back the ring with huge pages.
+ *
+ * @note Exits with an error message if a resource cannot be obtained.
+ *
+ * @ingroup server
+ */
+void writer_start(t_writer* w, int out_fd, size_t depth,
+				  t_writer_policy policy, unsigned flags)
+{
+	char     spill_path[] = "/tmp/minitalk-spill.XXXXXX";
+	sigset_t all;
+	sigset_t old;
+	size_t   i;
+
+	memset(w, 0, sizeof(*w));
+	w->policy   = policy;
+	w->mask     = depth - 1;
+	w->spill_fd = -1;
+	atomic_flag_clear(&w->spill_lock);
+	sink_open(&w->sink, out_fd, flags);
+	region_map(&w->mem, depth * sizeof(t_writer_cell), flags & MT_WRITER_HUGE);
+	w->cells = w->mem.addr;
+	if (sem_init(&w->items, 0, 0) == -1)
+		sys_error("Server: writer setup failed");
+	i = 0;
+	while (i < depth)
+	{
+		atomic_init(&w->cells[i].seq, i);
+		i++;
+	}
+	if (policy == MT_POLICY_SPILL)
+	{
+		w->spill_fd = mkstemp(spill_path);
+		if (w->spill_fd == -1)
+			sys_error("Server: cannot create spill file");
+		unlink(spill_path);
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	if (pthread_create(&w->thread, NULL, writer_main, w) != 0)
+		sys_error("Server: cannot start writer thread");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief Waits until the writer has caught up with every pushed chunk.
+ *
+ * @details
+ * The caller must keep producers quiet, e.g. by blocking the data
+ * signals, for the result to still hold when the call returns.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+void writer_sync(t_writer* w)
+{
+	const struct timespec tick = {0, 1000000};
+
+	while (!writer_idle(w))
+		nanosleep(&tick, NULL);
+}
+
+/**
+ * @brief Writes out everything still queued, stops the thread and unmaps
+ * the ring.
+ *
+ * @param w The writer.
+ *
+ * @ingroup server
+ */
+void writer_stop(t_writer* w)
+{
+	atomic_store(&w->stop, true);
+	sem_post(&w->items);
+	pthread_join(w->thread, NULL);
+	sem_destroy(&w->items);
+	if (w->spill_fd != -1)
+		close(w->spill_fd);
+	sink_close(&w->sink);
+	region_unmap(&w->mem);
+	w->cells = NULL;
+}